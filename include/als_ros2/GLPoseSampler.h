@@ -30,127 +30,52 @@
 #include <nav_msgs/msg/odometry.hpp>
 #include <sensor_msgs/msg/laser_scan.hpp>
 #include <geometry_msgs/msg/pose_array.hpp>
+#include <geometry_msgs/msg/pose_stamped.hpp>
 #include <geometry_msgs/msg/transform_stamped.hpp>
+#include <geometry_msgs/msg/vector3_stamped.hpp>
 #include <visualization_msgs/msg/marker.hpp>
+#include <std_msgs/msg/empty.hpp>
 
 #include "tf2_ros/transform_listener.h"
 #include "tf2_ros/buffer.h"
 #include <tf2_ros/create_timer_ros.h>
 
 #include "rclcpp/rclcpp.hpp"
-#include "als_ros2/Pose.h"
+#include "als_ros2/GLPoseSamplerCore.h"
+#include "als_ros2/LatestWinsQueue.h"
+#include "als_ros2/KeyScanScheduler.h"
+#if defined(ALS_ROS2_ENABLE_PROFILING)
+#include <diagnostic_msgs/msg/diagnostic_array.hpp>
+#endif
 
 #include <tf2/LinearMath/Quaternion.h>
 #include <tf2_geometry_msgs/tf2_geometry_msgs.hpp>
 #include <rclcpp/qos.hpp>
+#include <builtin_interfaces/msg/time.hpp>
+
+#include <mutex>
+#include <thread>
+#include <condition_variable>
 
 using namespace std::chrono_literals;
 
 namespace als_ros2
 {
 
-    /**
-     * @brief Represents a keypoint with its coordinates and type.
-     *
-     * The Keypoint class stores the coordinates (u, v) and the corresponding
-     * world coordinates (x, y) of a keypoint. It also stores the type of the
-     * keypoint, which can be -2 (invalid), -1 (local minima), 0 (saddle), or
-     * 1 (local maxima).
-     */
-    class Keypoint
-    {
-    private:
-        int u_, v_;
-        double x_, y_;
-        char type_;
-        // type values -2, -1, 0, or 1.
-        // -2: invalid, -1: local minima, 0: saddle, 1: local maxima
-
-    public:
-        Keypoint(void) : u_(0), v_(0), x_(0.0), y_(0.0), type_(-2) {}
-
-        Keypoint(int u, int v) : u_(u), v_(v), x_(0.0), y_(0.0), type_(-2) {}
-
-        Keypoint(double x, double y) : u_(0), v_(0), x_(x), y_(y), type_(-2) {}
-
-        Keypoint(int u, int v, double x, double y) : u_(u), v_(v), x_(x), y_(y), type_(-2) {}
-
-        Keypoint(int u, int v, double x, double y, char type) : u_(u), v_(v), x_(x), y_(y), type_(type) {}
-
-        inline int getU(void) { return u_; }
-        inline int getV(void) { return v_; }
-        inline double getX(void) { return x_; }
-        inline double getY(void) { return y_; }
-        inline char getType(void) { return type_; }
-
-        inline void setU(int u) { u_ = u; }
-        inline void setV(int v) { v_ = v; }
-        inline void setX(double x) { x_ = x; }
-        inline void setY(double y) { y_ = y; }
-        inline void setType(char type) { type_ = type; }
-    }; // class Keypoint
-
-    /**
-     * @brief Represents a feature that describes the orientation of a surface using signed distance fields (SDF).
-     */
-    class SDFOrientationFeature
-    {
-    private:
-        double dominantOrientation_;
-        double averageSDF_;
-        std::vector<int> relativeOrientationHist_;
-
-    public:
-        /**
-         * @brief Default constructor for SDFOrientationFeature.
-         */
-        SDFOrientationFeature(void) {}
-
-        /**
-         * @brief Constructor for SDFOrientationFeature.
-         * @param dominantOrientation The dominant orientation of the surface.
-         * @param averageSDF The average signed distance field value of the surface.
-         * @param relativeOrientationHist The histogram of relative orientations of the surface.
-         */
-        SDFOrientationFeature(double dominantOrientation, double averageSDF, std::vector<int> relativeOrientationHist) : dominantOrientation_(dominantOrientation),
-                                                                                                                         averageSDF_(averageSDF),
-                                                                                                                         relativeOrientationHist_(relativeOrientationHist) {}
-
-        /**
-         * @brief Get the dominant orientation of the surface.
-         * @return The dominant orientation.
-         */
-        inline double getDominantOrientation(void) { return dominantOrientation_; }
-
-        /**
-         * @brief Get the average signed distance field value of the surface.
-         * @return The average signed distance field value.
-         */
-        inline double getAverageSDF(void) { return averageSDF_; }
-
-        /**
-         * @brief Get the histogram of relative orientations of the surface.
-         * @return The histogram of relative orientations.
-         */
-        std::vector<int> getRelativeOrientationHist(void) { return relativeOrientationHist_; }
-
-        /**
-         * @brief Get the value at the specified index in the histogram of relative orientations.
-         * @param idx The index of the value to retrieve.
-         * @return The value at the specified index.
-         */
-        int getRelativeOrientationHist(int idx) { return relativeOrientationHist_[idx]; }
-    }; // class SDFOrientationFeature
-
-    class GLPoseSampler : public rclcpp::Node
+    class GLPoseSampler : public rclcpp::Node, protected GLPoseSamplerCore
     {
     private:
-        std::string mapName_, scanName_, odomName_, posesName_, localMapName_, sdfKeypointsName_, localSDFKeypointsName_;
+        std::string mapName_, scanName_, odomName_, priorPoseName_, posesName_, localMapName_, sdfKeypointsName_, localSDFKeypointsName_;
+        std::string reliabilityName_, samplingTriggerName_;
         std::string mapFrame_, odomFrame_, baseLinkFrame_, laserFrame_;
 
         rclcpp::Subscription<nav_msgs::msg::OccupancyGrid>::SharedPtr mapSub_;
         rclcpp::Subscription<sensor_msgs::msg::LaserScan>::SharedPtr scanSub_;
         rclcpp::Subscription<nav_msgs::msg::Odometry>::SharedPtr odomSub_;
+        rclcpp::Subscription<geometry_msgs::msg::PoseStamped>::SharedPtr priorPoseSub_;
+        rclcpp::Subscription<geometry_msgs::msg::Vector3Stamped>::SharedPtr reliabilitySub_;
+        rclcpp::Subscription<std_msgs::msg::Empty>::SharedPtr samplingTriggerSub_;
+        rclcpp::CallbackGroup::SharedPtr mapCallbackGroup_, scanCallbackGroup_, odomCallbackGroup_;
 
         rclcpp::Publisher<geometry_msgs::msg::PoseArray>::SharedPtr posesPub_;
         rclcpp::Publisher<nav_msgs::msg::OccupancyGrid>::SharedPtr localMapPub_;
@@ -160,33 +85,27 @@ namespace als_ros2
         std::shared_ptr<tf2_ros::TransformListener> tf_listener_{nullptr};
         std::unique_ptr<tf2_ros::Buffer> tf_buffer_;
 
-        Pose baseLink2Laser_;
-
-        int mapWidth_, mapHeight_;
-        double mapResolution_;
-        Pose mapOrigin_;
-        std::vector<signed char> mapData_;
-        bool gotMap_;
         bool flipScan_;
 
-        sensor_msgs::msg::LaserScan scan_;
         double keyScanIntervalDist_, keyScanIntervalYaw_;
-        std::vector<sensor_msgs::msg::LaserScan> keyScans_;
+        KeyScanRing keyScans_;
         int keyScansNum_;
         Pose odomPose_;
-        std::vector<Pose> keyPoses_;
         bool gotOdom_;
-        std::vector<Keypoint> sdfKeypoints_;
-        std::vector<SDFOrientationFeature> sdfOrientationFeatures_;
+        bool isFirstScan_;  // accessed only by scanCB
+        Pose prevOdomPose_; // the odometry pose of the newest key scan, accessed only by scanCB
+        std::mutex priorPoseMutex_; // priorPose_ and gotPriorPose_
+        Pose priorPose_;
+        bool gotPriorPose_;
         visualization_msgs::msg::Marker sdfKeypointsMarker_;
+        std::string sdfFeatureCacheDir_;
 
-        double gradientSquareTH_;
-        double keypointsMinDistFromMap_;
-        double sdfFeatureWindowSize_;
-        double averageSDFDeltaTH_;
-        bool addRandomSamples_, addOppositeSamples_;
-        int randomSamplesNum_;
-        double positionalRandomNoise_, angularRandomNoise_, matchingRateTH_;
+        // outputs of the key scan updates; they are reused so that their buffers keep their capacity
+        nav_msgs::msg::OccupancyGrid localMap_;
+        geometry_msgs::msg::PoseArray poses_;
+        std::vector<Keypoint> localSDFKeypoints_;
+        visualization_msgs::msg::Marker localSDFKeypointsMarker_;
+        bool useIntraProcessComms_;
 
         geometry_msgs::msg::TransformStamped tfBaseLink2Laser;
 
@@ -194,199 +113,61 @@ namespace als_ros2
         std::condition_variable cv_;
         bool transform_ready_ = false;
 
-        inline double nrand(double n)
-        {
-            return (n * sqrt(-2.0 * log((double)rand() / RAND_MAX)) * cos(2.0 * M_PI * rand() / RAND_MAX));
-        }
-
-        inline void xy2uv(double x, double y, int *u, int *v)
+        // a snapshot of the key scans that is processed by the pipeline
+        struct KeyScanJob
         {
-            double dx = x - mapOrigin_.getX();
-            double dy = y - mapOrigin_.getY();
-            double yaw = -mapOrigin_.getYaw();
-            double xx = dx * cos(yaw) - dy * sin(yaw);
-            double yy = dx * sin(yaw) + dy * cos(yaw);
-            *u = (int)(xx / mapResolution_);
-            *v = (int)(yy / mapResolution_);
-        }
-
-        inline void uv2xy(int u, int v, double *x, double *y)
+            KeyScanRing keyScans;
+            Pose prevOdomPose;
+            builtin_interfaces::msg::Time stamp;
+        };
+
+        std::mutex odomMutex_; // odomPose_ and gotOdom_
+        std::mutex mapMutex_;  // everything of GLPoseSamplerCore
+        bool useAsyncPipeline_;
+        int asyncQueueSize_;
+        LatestWinsQueue<KeyScanJob> keyScanJobs_;
+        std::thread pipelineThread_;
+
+        bool useAdaptiveScheduling_;
+        KeyScanScheduler keyScanScheduler_;
+
+#if defined(ALS_ROS2_ENABLE_PROFILING)
+        std::string statsName_;
+        rclcpp::Publisher<diagnostic_msgs::msg::DiagnosticArray>::SharedPtr statsPub_;
+        rclcpp::TimerBase::SharedPtr statsTimer_;
+
+        void publishStats(void)
         {
-            double xx = (double)u * mapResolution_;
-            double yy = (double)v * mapResolution_;
-            double yaw = mapOrigin_.getYaw();
-            double dx = xx * cos(yaw) - yy * sin(yaw);
-            double dy = xx * sin(yaw) + yy * cos(yaw);
-            *x = dx + mapOrigin_.getX();
-            *y = dy + mapOrigin_.getY();
-        }
-
-        void setMapInfo(nav_msgs::msg::OccupancyGrid map)
-        {
-            mapWidth_ = map.info.width;
-            mapHeight_ = map.info.height;
-            mapResolution_ = map.info.resolution;
-            mapOrigin_.setX(map.info.origin.position.x);
-            mapOrigin_.setY(map.info.origin.position.y);
-            tf2::Quaternion q(map.info.origin.orientation.x,
-                              map.info.origin.orientation.y,
-                              map.info.origin.orientation.z,
-                              map.info.origin.orientation.w);
-            double roll, pitch, yaw;
-            tf2::Matrix3x3 m(q);
-            m.getRPY(roll, pitch, yaw);
-            mapOrigin_.setYaw(yaw);
-            mapData_ = map.data;
-        }
-
-        cv::Mat buildDistanceFieldMap(nav_msgs::msg::OccupancyGrid map)
-        {
-            cv::Mat binMap(map.info.height, map.info.width, CV_8UC1);
-            for (int v = 0; v < (int)map.info.height; v++)
+            std::vector<StageProfiler::Summary> summaries = profiler_.summarize();
+            diagnostic_msgs::msg::DiagnosticArray stats;
+            stats.header.stamp = this->now();
+            for (int i = 0; i < (int)summaries.size(); ++i)
             {
-                for (int u = 0; u < (int)map.info.width; u++)
+                diagnostic_msgs::msg::DiagnosticStatus status;
+                status.level = diagnostic_msgs::msg::DiagnosticStatus::OK;
+                status.name = std::string(this->get_name()) + ": " + summaries[i].name;
+                status.hardware_id = this->get_name();
+                const char *keys[] = {"p50", "p95", "p99", "max"};
+                double vals[] = {summaries[i].p50, summaries[i].p95, summaries[i].p99, summaries[i].max};
+                for (int j = 0; j < 4; ++j)
                 {
-                    int n = v * map.info.width + u;
-                    int val = map.data[n];
-                    if (val == 100)
-                        binMap.at<uchar>(v, u) = 0;
-                    else
-                        binMap.at<uchar>(v, u) = 1;
+                    diagnostic_msgs::msg::KeyValue keyValue;
+                    keyValue.key = keys[j];
+                    keyValue.value = std::to_string(vals[j]);
+                    status.values.push_back(keyValue);
                 }
+                diagnostic_msgs::msg::KeyValue keyValue;
+                keyValue.key = "samples_num";
+                keyValue.value = std::to_string(summaries[i].samplesNum);
+                status.values.push_back(keyValue);
+                stats.status.push_back(status);
             }
-
-            cv::Mat distMap(map.info.height, map.info.width, CV_32FC1);
-            cv::distanceTransform(binMap, distMap, cv::DIST_L2, 5);
-            for (int v = 0; v < (int)map.info.height; v++)
-            {
-                for (int u = 0; u < (int)map.info.width; u++)
-                {
-                    float d = distMap.at<float>(v, u) * (float)map.info.resolution;
-                    distMap.at<float>(v, u) = d;
-                }
-            }
-            return distMap;
+            statsPub_->publish(stats);
         }
+#endif
 
-        std::vector<Keypoint> detectKeypoints(nav_msgs::msg::OccupancyGrid map, cv::Mat distMap)
+        void setSDFKeypointsMarker(const std::vector<Keypoint> &keypoints, const std::string &frame, visualization_msgs::msg::Marker &marker)
         {
-            std::vector<Keypoint> keypoints;
-            tf2::Quaternion q(map.info.origin.orientation.x,
-                              map.info.origin.orientation.y,
-                              map.info.origin.orientation.z,
-                              map.info.origin.orientation.w);
-            double roll, pitch, yaw;
-            tf2::Matrix3x3 m(q);
-            m.getRPY(roll, pitch, yaw);
-            mapOrigin_.setYaw(yaw);
-            for (int u = 1; u < (int)map.info.width - 1; ++u)
-            {
-                for (int v = 1; v < (int)map.info.height - 1; ++v)
-                {
-                    int n = v * map.info.width + u;
-                    if (map.data[n] != 0 || distMap.at<float>(v, u) < keypointsMinDistFromMap_)
-                        continue;
-
-                    float dx = -distMap.at<float>(v - 1, u - 1) - distMap.at<float>(v, u - 1) - distMap.at<float>(v + 1, u - 1) + distMap.at<float>(v - 1, u + 1) + distMap.at<float>(v, u + 1) + distMap.at<float>(v + 1, u + 1);
-                    float dy = -distMap.at<float>(v - 1, u - 1) - distMap.at<float>(v - 1, u) - distMap.at<float>(v - 1, u + 1) + distMap.at<float>(v + 1, u - 1) + distMap.at<float>(v + 1, u) + distMap.at<float>(v + 1, u + 1);
-
-                    float dxx = distMap.at<float>(v, u - 1) - 2.0 * distMap.at<float>(v, u) + distMap.at<float>(v, u + 1);
-                    float dyy = distMap.at<float>(v - 1, u) - 2.0 * distMap.at<float>(v, u) + distMap.at<float>(v + 1, u);
-                    float dxy = distMap.at<float>(v - 1, u - 1) - distMap.at<float>(v - 1, u) - distMap.at<float>(v, u - 1) + 2.0 * distMap.at<float>(v, u) - distMap.at<float>(v, u + 1) - distMap.at<float>(v + 1, u) + distMap.at<float>(v + 1, u + 1);
-                    float det = dxx * dyy - dxy * dxy;
-
-                    if (dx * dx < gradientSquareTH_ && dy * dy < gradientSquareTH_)
-                    {
-                        double xx = (double)u * map.info.resolution;
-                        double yy = (double)v * map.info.resolution;
-                        double dx = xx * cos(yaw) - yy * sin(yaw);
-                        double dy = xx * sin(yaw) + yy * cos(yaw);
-                        double x = dx + map.info.origin.position.x;
-                        double y = dy + map.info.origin.position.y;
-                        if (det > 0.0 && dxx < 0.0) // local maxima
-                            keypoints.push_back(Keypoint(u, v, x, y, 1));
-                        else if (det > 0.0 && dxx > 0.0) // local minima
-                            keypoints.push_back(Keypoint(u, v, x, y, -1));
-                        else if (det < 0.0) // saddle
-                            keypoints.push_back(Keypoint(u, v, x, y, 0));
-                    }
-                }
-            }
-            return keypoints;
-        }
-
-        std::vector<SDFOrientationFeature> calculateFeatures(cv::Mat distMap, std::vector<Keypoint> keypoints)
-        {
-            std::vector<SDFOrientationFeature> features((int)keypoints.size());
-            for (int i = 0; i < (int)keypoints.size(); ++i)
-            {
-                int r = (int)(sdfFeatureWindowSize_ / mapResolution_);
-                int uo = keypoints[i].getU();
-                int vo = keypoints[i].getV();
-                float distSum = 0.0f;
-                int cellNum = 0;
-                std::vector<int> orientHist(36);
-                std::vector<double> orientations;
-
-                for (int u = uo - r; u <= uo + r; ++u)
-                {
-                    for (int v = vo - r; v <= vo + r; ++v)
-                    {
-                        if (u < 1 || distMap.cols - 1 < u || v < 1 || distMap.rows - 1 < v)
-                            continue;
-
-                        distSum += distMap.at<float>(v, u);
-                        cellNum++;
-
-                        float dx = -distMap.at<float>(v - 1, u - 1) - distMap.at<float>(v, u - 1) - distMap.at<float>(v + 1, u - 1) + distMap.at<float>(v - 1, u + 1) + distMap.at<float>(v, u + 1) + distMap.at<float>(v + 1, u + 1);
-                        float dy = -distMap.at<float>(v - 1, u - 1) - distMap.at<float>(v - 1, u) - distMap.at<float>(v - 1, u + 1) + distMap.at<float>(v + 1, u - 1) + distMap.at<float>(v + 1, u) + distMap.at<float>(v + 1, u + 1);
-                        double t = atan2((double)dy, (double)dx) * 180.0 / M_PI;
-                        if (t < 0.0)
-                            t += 360.0;
-                        int orientIdx = (int)(t / 10.0);
-                        if (0 <= orientIdx && orientIdx < 36)
-                        {
-                            orientHist[orientIdx]++;
-                            orientations.push_back(t);
-                        }
-                    }
-                }
-
-                float distAve = distSum / (float)cellNum;
-
-                int maxVal = orientHist[0];
-                double domOrient = 0.0;
-                for (int j = 1; j < (int)orientHist.size(); ++j)
-                {
-                    if (orientHist[j] > maxVal)
-                    {
-                        maxVal = orientHist[j];
-                        domOrient = (double)j * 10.0;
-                    }
-                }
-
-                std::vector<int> relOrientHist(17);
-                for (int j = 0; j < (int)orientations.size(); ++j)
-                {
-                    double dt = domOrient - orientations[j];
-                    while (dt > 180.0)
-                        dt -= 360.0;
-                    while (dt < -180.0)
-                        dt += 360.0;
-                    int relOrientIdx = (int)(fabs(dt) / 10.0);
-                    if (0 <= relOrientIdx && relOrientIdx < 17)
-                        relOrientHist[relOrientIdx]++;
-                }
-
-                SDFOrientationFeature feature(domOrient * M_PI / 180.0, (double)distAve, relOrientHist);
-                features[i] = feature;
-            }
-            return features;
-        }
-
-        visualization_msgs::msg::Marker makeSDFKeypointsMarker(std::vector<Keypoint> keypoints, std::string frame)
-        {
-            visualization_msgs::msg::Marker marker;
             marker.header.frame_id = frame;
             marker.ns = "gl_marker_namespace";
             marker.id = 0;
@@ -415,260 +196,76 @@ namespace als_ros2
                 marker.points[i] = p;
                 marker.colors[i] = c;
             }
-            return marker;
         }
 
-        nav_msgs::msg::OccupancyGrid buildLocalMap(void)
+        /**
+         * @brief Runs the processing stages from the local map to the publication of the pose candidates.
+         * @param keyScans The key scans.
+         * @param prevOdomPose The odometry pose of the newest key scan.
+         * @param stamp The time stamp of the published messages.
+         */
+        void processKeyScans(KeyScanRing &keyScans, Pose prevOdomPose, builtin_interfaces::msg::Time stamp)
         {
-            nav_msgs::msg::OccupancyGrid map;
-            map.header.frame_id = odomFrame_;
-
-            double rangeMax = keyScans_[0].range_max;
-            map.info.width = (int)(rangeMax * 3.0 / mapResolution_);
-            map.info.height = (int)(rangeMax * 3.0 / mapResolution_);
-            map.info.resolution = mapResolution_;
-            map.info.origin.position.x = keyPoses_[0].getX() - rangeMax * 1.5;
-            map.info.origin.position.y = keyPoses_[0].getY() - rangeMax * 1.5;
-            map.info.origin.orientation.w = 1.0;
-            map.data.resize(map.info.width * map.info.height, -1);
-
-            for (int i = 0; i < (int)keyScans_.size(); ++i)
+            std::lock_guard<std::mutex> lock(mapMutex_);
+            if (!gotMap_)
+                return;
+
+            bool gotPriorPose;
+            Pose priorPose;
             {
-                double yaw = baseLink2Laser_.getYaw();
-                double c = cos(yaw);
-                double s = sin(yaw);
-                double sensorX = baseLink2Laser_.getX() * c - baseLink2Laser_.getY() * s + keyPoses_[i].getX();
-                double sensorY = baseLink2Laser_.getX() * s + baseLink2Laser_.getY() * c + keyPoses_[i].getY();
-                double sensorYaw = yaw + keyPoses_[i].getYaw();
-                sensor_msgs::msg::LaserScan scan = keyScans_[i];
-                for (int j = 0; j < (int)scan.ranges.size(); ++j)
-                {
-                    double range = scan.ranges[j];
-                    if (range < scan.range_min || scan.range_max < range)
-                        continue;
-                    if (range < keypointsMinDistFromMap_)
-                        continue;
-
-                    double t = (double)j * scan.angle_increment + scan.angle_min + sensorYaw;
-                    double x = sensorX;
-                    double y = sensorY;
-                    double dx = mapResolution_ * cos(t);
-                    double dy = mapResolution_ * sin(t);
-                    for (double r = 0.0; r < range - mapResolution_; r += mapResolution_)
-                    {
-                        int u = (int)((x - map.info.origin.position.x) / map.info.resolution);
-                        int v = (int)((y - map.info.origin.position.y) / map.info.resolution);
-                        if (0 < u && u < (int)map.info.width && 0 < v && v < (int)map.info.height)
-                        {
-                            int n = v * map.info.width + u;
-                            map.data[n] = 0;
-                        }
-                        x += dx;
-                        y += dy;
-                    }
-                    x = range * cos(t) + sensorX;
-                    y = range * sin(t) + sensorY;
-                    int u = (int)((x - map.info.origin.position.x) / map.info.resolution);
-                    int v = (int)((y - map.info.origin.position.y) / map.info.resolution);
-                    if (0 < u && u < (int)map.info.width && 0 < v && v < (int)map.info.height)
-                    {
-                        int n = v * map.info.width + u;
-                        map.data[n] = 100;
-                    }
-                }
+                std::lock_guard<std::mutex> priorPoseLock(priorPoseMutex_);
+                gotPriorPose = gotPriorPose_;
+                priorPose = priorPose_;
             }
-            return map;
-        }
 
-        std::vector<int> findCorrespondingFeatures(std::vector<Keypoint> localSDFKeypoints, std::vector<SDFOrientationFeature> localFeatures)
-        {
-            std::vector<int> correspondingIndices((int)localSDFKeypoints.size());
-            for (int i = 0; i < (int)localSDFKeypoints.size(); ++i)
+            ALS_ROS2_PROFILE_START(clock);
+            if (useAdaptiveScheduling_)
+                setMaxCorrespondencesNum(keyScanScheduler_.getMaxCorrespondencesNum());
+            PoseEstimationInfo info = estimatePoses(keyScans, prevOdomPose, gotPriorPose, priorPose, localMap_, localSDFKeypoints_, poses_);
+            if (useAdaptiveScheduling_)
+                keyScanScheduler_.reportCycle(info.matchingTime, info.poseGenerationTime, info.usedCorrespondencesNum);
+            ALS_ROS2_PROFILE_START(publishClock);
+            setSDFKeypointsMarker(localSDFKeypoints_, odomFrame_, localSDFKeypointsMarker_);
+
+            localMap_.header.frame_id = odomFrame_;
+            poses_.header.frame_id = mapFrame_;
+            poses_.header.stamp = localMap_.header.stamp = localSDFKeypointsMarker_.header.stamp = stamp;
+            if (useIntraProcessComms_)
             {
-                char localKeypointType = localSDFKeypoints[i].getType();
-                double localAverageSDF = localFeatures[i].getAverageSDF();
-                std::vector<int> localRelOrientHist = localFeatures[i].getRelativeOrientationHist();
-                bool isFirst = true, isSecond = true;
-                int idx1 = 0, idx2 = 0, min1 = -1, min2 = -1;
-                for (int j = 0; j < (int)sdfKeypoints_.size(); ++j)
-                {
-                    if (localKeypointType != sdfKeypoints_[j].getType())
-                        continue;
-                    double dAverageSDF = localAverageSDF - sdfOrientationFeatures_[j].getAverageSDF();
-                    if (fabs(dAverageSDF) > averageSDFDeltaTH_)
-                        continue;
-
-                    int sum = 0;
-                    for (int k = 0; k < 17; ++k)
-                        sum += abs(localRelOrientHist[k] - sdfOrientationFeatures_[j].getRelativeOrientationHist(k));
-
-                    if (isFirst)
-                    {
-                        min1 = sum;
-                        idx1 = j;
-                        isFirst = false;
-                    }
-                    else if (isSecond)
-                    {
-                        if (min1 < sum)
-                        {
-                            min2 = sum;
-                            idx2 = j;
-                        }
-                        else
-                        {
-                            min2 = min1;
-                            idx2 = idx1;
-                            min1 = sum;
-                            idx1 = j;
-                        }
-                        isSecond = false;
-                    }
-                    else if (min1 > sum)
-                    {
-                        min2 = min1;
-                        idx2 = idx1;
-                        min1 = sum;
-                        idx1 = j;
-                    }
-                }
-
-                if (min1 >= 0 && min2 >= 0 && (float)min1 * 1.5f < (float)min2)
-                    correspondingIndices[i] = idx1;
-                else if (min1 >= 0 && min2 < 0)
-                    correspondingIndices[i] = idx1;
-                else
-                    correspondingIndices[i] = -1;
+                // intra-process subscribers take the buffers of unique_ptr messages without a copy, so they are handed over
+                posesPub_->publish(std::make_unique<geometry_msgs::msg::PoseArray>(std::move(poses_)));
+                localMapPub_->publish(std::make_unique<nav_msgs::msg::OccupancyGrid>(std::move(localMap_)));
+                localSDFKeypointsPub_->publish(std::make_unique<visualization_msgs::msg::Marker>(std::move(localSDFKeypointsMarker_)));
             }
-            return correspondingIndices;
-        }
-
-        double computeMatchingRate(Pose pose)
-        {
-            double yaw = baseLink2Laser_.getYaw();
-            double c = cos(yaw);
-            double s = sin(yaw);
-            double sensorX = baseLink2Laser_.getX() * c - baseLink2Laser_.getY() * s + pose.getX();
-            double sensorY = baseLink2Laser_.getX() * s + baseLink2Laser_.getY() * c + pose.getY();
-            double sensorYaw = yaw + pose.getYaw();
-            sensor_msgs::msg::LaserScan scan = keyScans_[(int)keyScans_.size() - 1];
-
-            int validScanNum = 0, matchingNum = 0;
-            for (int i = 0; i < (int)scan.ranges.size(); ++i)
+            else
             {
-                double r = scan.ranges[i];
-
-                if (r < scan.range_min || scan.range_max < r)
-                    continue;
-                if (r < keypointsMinDistFromMap_)
-                    continue;
-
-                validScanNum++;
-                double t = (double)i * scan.angle_increment + scan.angle_min + sensorYaw;
-                double x = r * cos(t) + sensorX;
-                double y = r * sin(t) + sensorY;
-                int u, v;
-                xy2uv(x, y, &u, &v);
-                if (1 <= u && u < mapWidth_ - 1 && 1 <= v && v < mapHeight_ - 1)
-                {
-                    int n0 = v * mapWidth_ + u;
-                    int n1 = n0 - mapWidth_;
-                    int n2 = n0 - 1;
-                    int n3 = n0 + 1;
-                    int n4 = n0 + mapWidth_;
-                    if (mapData_[n0] == 100 || mapData_[n1] == 100 || mapData_[n2] == 100 || mapData_[n3] == 100 || mapData_[n4] == 100)
-                        matchingNum++;
-                }
+                // the messages are serialized from the reused buffers
+                posesPub_->publish(poses_);
+                localMapPub_->publish(localMap_);
+                localSDFKeypointsPub_->publish(localSDFKeypointsMarker_);
             }
-            return (double)matchingNum / (double)validScanNum;
+            ALS_ROS2_PROFILE_LAP(publishClock, profiler_, PROFILE_SCAN_PUBLISH_MS);
+            ALS_ROS2_PROFILE_TOTAL(clock, profiler_, PROFILE_SCAN_TOTAL_MS);
         }
 
-        geometry_msgs::msg::PoseArray generatePoses(Pose currentOdomPose, std::vector<Keypoint> localSDFKeypoints,
-                                                    std::vector<SDFOrientationFeature> localSDFOrientationFeatures, std::vector<int> correspondingIndices)
+        void runPipeline(void)
         {
-            geometry_msgs::msg::PoseArray poses;
-            poses.header.frame_id = mapFrame_;
-            for (int i = 0; i < (int)correspondingIndices.size(); ++i)
+            KeyScanJob job;
+            int reportedDroppedNum = 0;
+            while (keyScanJobs_.pop(job))
             {
-                int idx = correspondingIndices[i];
-                if (idx < 0)
-                    continue;
-
-                double dx = localSDFKeypoints[i].getX() - currentOdomPose.getX();
-                double dy = localSDFKeypoints[i].getY() - currentOdomPose.getY();
-                double localDomOrient = localSDFOrientationFeatures[i].getDominantOrientation();
-                double dOrient = currentOdomPose.getYaw() - localDomOrient;
-                Keypoint targetKeypoint = sdfKeypoints_[idx];
-                double targetDomOrient = sdfOrientationFeatures_[idx].getDominantOrientation();
-
-                double dDomOrient = localDomOrient - targetDomOrient;
-                double c = cos(dDomOrient);
-                double s = sin(dDomOrient);
-                double sensorX = dx * c - dy * s + targetKeypoint.getX();
-                double sensorY = dx * s + dy * c + targetKeypoint.getY();
-                double sensorYaw = targetDomOrient + dOrient;
-
-                int u, v;
-                xy2uv(sensorX, sensorY, &u, &v);
-                if (u < 0 || mapWidth_ <= u || v < 0 || mapHeight_ <= v)
-                    continue;
-                int n = v * mapWidth_ + u;
-                if (mapData_[n] != 0)
-                    continue;
-
-                double byaw = baseLink2Laser_.getYaw();
-                double bc = cos(byaw);
-                double bs = sin(byaw);
-                double baseX = sensorX - baseLink2Laser_.getX() * bc + baseLink2Laser_.getY() * bs;
-                double baseY = sensorY - baseLink2Laser_.getX() * bs - baseLink2Laser_.getY() * bc;
-                double baseYaw = sensorYaw - byaw;
-
-                if (!addRandomSamples_)
-                {
-                    if (matchingRateTH_ > 0.0)
-                    {
-                        if (computeMatchingRate(Pose(baseX, baseY, baseYaw)) < matchingRateTH_)
-                            continue;
-                    }
-                    geometry_msgs::msg::Pose pose;
-                    pose.position.x = baseX;
-                    pose.position.y = baseY;
-                    tf2::Quaternion q;
-                    q.setRPY(0, 0, baseYaw);
-                    pose.orientation = tf2::toMsg(q);
-                    poses.poses.push_back(pose);
-                }
-                else
+                processKeyScans(job.keyScans, job.prevOdomPose, job.stamp);
+                int droppedNum = keyScanJobs_.getDroppedNum();
+                if (droppedNum != reportedDroppedNum)
                 {
-                    for (int j = 0; j < randomSamplesNum_; ++j)
-                    {
-                        double x = baseX + nrand(positionalRandomNoise_);
-                        double y = baseY + nrand(positionalRandomNoise_);
-                        double yaw;
-                        if (addOppositeSamples_ && j % 2 == 1)
-                            yaw = baseYaw + M_PI + nrand(angularRandomNoise_);
-                        else
-                            yaw = baseYaw + nrand(angularRandomNoise_);
-                        if (matchingRateTH_ > 0.0)
-                        {
-                            if (computeMatchingRate(Pose(x, y, yaw)) < matchingRateTH_)
-                                continue;
-                        }
-                        geometry_msgs::msg::Pose pose;
-                        pose.position.x = x;
-                        pose.position.y = y;
-                        tf2::Quaternion q;
-                        q.setRPY(0, 0, yaw);
-                        pose.orientation = tf2::toMsg(q);
-                        poses.poses.push_back(pose);
-                    }
+                    RCLCPP_DEBUG(this->get_logger(), "gl pose sampler dropped %d stale key scan snapshot(s).", droppedNum - reportedDroppedNum);
+                    reportedDroppedNum = droppedNum;
                 }
             }
-            return poses;
         }
 
     public:
-        GLPoseSampler() : Node("gl_pose_sampler")
+        explicit GLPoseSampler(const rclcpp::NodeOptions &options = rclcpp::NodeOptions()) : Node("gl_pose_sampler", options)
         {
 
             this->declare_parameter<std::string>("map_name", "/map");
@@ -725,6 +322,32 @@ namespace als_ros2
             this->declare_parameter<double>("average_sdf_delta_th", 1.0);
             this->get_parameter("average_sdf_delta_th", averageSDFDeltaTH_);
 
+            // directory of the global SDF keypoint cache files (empty: cache disabled)
+            this->declare_parameter<std::string>("sdf_feature_cache_dir", "");
+            this->get_parameter("sdf_feature_cache_dir", sdfFeatureCacheDir_);
+            sdfFeatureCache_.setCacheDir(sdfFeatureCacheDir_);
+
+            // compute the global distance field and keypoints in tiles of this many cells (0: whole map at once)
+            // to bound the memory usage for large maps; distances are clamped to sdf_max_distance in this mode
+            this->declare_parameter<int>("sdf_tile_size", 0);
+            this->get_parameter("sdf_tile_size", sdfTileSize_);
+
+            this->declare_parameter<double>("sdf_max_distance", 5.0);
+            this->get_parameter("sdf_max_distance", sdfMaxDistance_);
+
+            // on a map update of the same geometry, recompute the SDF keypoints only around the changed cells;
+            // the result of such an update is not written to the SDF keypoint cache
+            this->declare_parameter<bool>("use_incremental_map_update", false);
+            this->get_parameter("use_incremental_map_update", useIncrementalMapUpdate_);
+
+            // share the global map data with the other samplers of this process that use the same name, map, and
+            // parameters, e.g., the composable nodes of the robots of a site in one container (empty: not shared);
+            // a shared map is always rebuilt or attached as a whole, so use_incremental_map_update is ignored
+            this->declare_parameter<std::string>("shared_map_name", "");
+            this->get_parameter("shared_map_name", sharedMapName_);
+            if (!sharedMapName_.empty() && useIncrementalMapUpdate_)
+                RCLCPP_WARN(this->get_logger(), "use_incremental_map_update is ignored with shared_map_name");
+
             this->declare_parameter<bool>("add_random_samples", true);
             this->get_parameter("add_random_samples", addRandomSamples_);
 
@@ -740,29 +363,194 @@ namespace als_ros2
             this->declare_parameter<double>("angular_random_noise", 0.3);
             this->get_parameter("angular_random_noise", angularRandomNoise_);
 
+            // seed of the noise of the random samples
+            // negative: a different seed in every run
+            int randomSeed;
+            this->declare_parameter<int>("random_seed", -1);
+            this->get_parameter("random_seed", randomSeed);
+            if (randomSeed >= 0)
+                setRandomSeed((uint64_t)randomSeed);
+
             this->declare_parameter<double>("matching_rate_th", 0.1);
             this->get_parameter("matching_rate_th", matchingRateTH_);
 
+            // match coarse keypoints of a downsampled map first and run the full-resolution
+            // matching only against the global keypoints near the most voted regions
+            this->declare_parameter<bool>("use_coarse_to_fine_matching", false);
+            this->get_parameter("use_coarse_to_fine_matching", useCoarseToFineMatching_);
+
+            this->declare_parameter<int>("coarse_matching_scale", 4);
+            this->get_parameter("coarse_matching_scale", coarseMatchingScale_);
+            if (coarseMatchingScale_ < 2)
+                coarseMatchingScale_ = 2;
+
+            this->declare_parameter<int>("coarse_candidate_regions_num", 5);
+            this->get_parameter("coarse_candidate_regions_num", coarseCandidateRegionsNum_);
+
+            this->declare_parameter<double>("matching_region_size", 10.0);
+            this->get_parameter("matching_region_size", matchingRegionSize_);
+
+            // restrict the pose candidates to a radius around the poses published to prior_pose_name (0: disabled);
+            // poses in other frames than map_frame are transformed to it with the latest transform
+            this->declare_parameter<std::string>("prior_pose_name", "/gl_prior_pose");
+            this->get_parameter("prior_pose_name", priorPoseName_);
+
+            this->declare_parameter<double>("prior_pose_radius", 0.0);
+            this->get_parameter("prior_pose_radius", priorPoseRadius_);
+
             this->declare_parameter<bool>("flip_scan", true);
             this->get_parameter("flip_scan", flipScan_);
 
-            gotMap_ = false;
+            // score candidate poses with a Gaussian of the distance to the closest occupied cell
+            // instead of counting beams that hit an occupied cell or its 4-neighbours
+            this->declare_parameter<bool>("use_distance_field_matching_rate", false);
+            this->get_parameter("use_distance_field_matching_rate", useDistanceFieldMatchingRate_);
+
+            this->declare_parameter<double>("matching_distance_field_sigma", 0.05);
+            this->get_parameter("matching_distance_field_sigma", matchingDistanceFieldSigma_);
+
+            // update the local map from hit/free counts of the newest and the evicted key scans
+            // instead of ray casting all the key scans for every update
+            this->declare_parameter<bool>("use_incremental_local_map", false);
+            this->get_parameter("use_incremental_local_map", useIncrementalLocalMap_);
+
+            // process the key scans in a worker thread so that the callbacks only take snapshots of
+            // the key scans and odometry; stale snapshots are dropped when the worker falls behind
+            this->declare_parameter<bool>("use_async_pipeline", false);
+            this->get_parameter("use_async_pipeline", useAsyncPipeline_);
+
+            this->declare_parameter<int>("async_queue_size", 1);
+            this->get_parameter("async_queue_size", asyncQueueSize_);
+
+            // run the pose sampling only for some key scan updates: at a reduced rate while the reliability
+            // published to reliability_name (x of the vector, as published by MCL) is at least reliability_th,
+            // and within cycle_time_budget by capping the correspondences and skipping updates after an overrun
+            this->declare_parameter<bool>("use_adaptive_scheduling", false);
+            this->get_parameter("use_adaptive_scheduling", useAdaptiveScheduling_);
+
+            // time budget of a key scan update [ms] (0: unlimited)
+            double cycleTimeBudget;
+            this->declare_parameter<double>("cycle_time_budget", 0.0);
+            this->get_parameter("cycle_time_budget", cycleTimeBudget);
+
+            int maxSkippedCyclesNum;
+            this->declare_parameter<int>("max_skipped_cycles_num", 5);
+            this->get_parameter("max_skipped_cycles_num", maxSkippedCyclesNum);
+            keyScanScheduler_.setTimeBudget(cycleTimeBudget, maxSkippedCyclesNum);
+
+            this->declare_parameter<std::string>("reliability_name", "/reliability");
+            this->get_parameter("reliability_name", reliabilityName_);
+
+            double reliabilityTH;
+            this->declare_parameter<double>("reliability_th", 0.9);
+            this->get_parameter("reliability_th", reliabilityTH);
+
+            // every this many key scan updates run while the localization is reliable
+            int reliableCycleInterval;
+            this->declare_parameter<int>("reliable_cycle_interval", 10);
+            this->get_parameter("reliable_cycle_interval", reliableCycleInterval);
+
+            // a reliability older than this counts as unknown [s]
+            double reliabilityTimeout;
+            this->declare_parameter<double>("reliability_timeout", 2.0);
+            this->get_parameter("reliability_timeout", reliabilityTimeout);
+            keyScanScheduler_.setReliabilityGate(reliabilityTH, reliableCycleInterval, reliabilityTimeout);
+
+            // a message to sampling_trigger_name makes the next scan run the pose sampling
+            this->declare_parameter<std::string>("sampling_trigger_name", "/gl_sampling_trigger");
+            this->get_parameter("sampling_trigger_name", samplingTriggerName_);
+
+            // number of threads used to build the distance fields, keypoints, and features, at most OpenCV's number of threads
+            // 1: serial, 0: OpenCV's default number of threads
+            this->declare_parameter<int>("preprocessing_threads_num", 1);
+            this->get_parameter("preprocessing_threads_num", preprocessingThreadsNum_);
+            if (preprocessingThreadsNum_ <= 0)
+                preprocessingThreadsNum_ = cv::getNumThreads();
+
+            // number of threads used to generate and evaluate the pose candidates, at most OpenCV's number of threads
+            // 1: serial, 0: OpenCV's default number of threads
+            this->declare_parameter<int>("pose_generation_threads_num", 1);
+            this->get_parameter("pose_generation_threads_num", poseGenerationThreadsNum_);
+            if (poseGenerationThreadsNum_ <= 0)
+                poseGenerationThreadsNum_ = cv::getNumThreads();
+
+            // build the distance fields, the blur, and the keypoints of the local and global maps on an
+            // OpenCL device through cv::UMat; the CPU path is used if no device is available
+            bool useOpenCL;
+            this->declare_parameter<bool>("use_opencl", false);
+            this->get_parameter("use_opencl", useOpenCL);
+            if (useOpenCL && !setUseOpenCL(true))
+                RCLCPP_WARN(this->get_logger(), "No OpenCL device is available; the CPU path is used.");
+
             gotOdom_ = false;
+            gotPriorPose_ = false;
+            isFirstScan_ = true;
+            keyScans_.reset(keyScansNum_);
+            useIntraProcessComms_ = this->get_node_options().use_intra_process_comms();
+            keyScans_.setReversed(flipScan_);
+
+            // separate groups let a multi-threaded executor run odometry updates during scan processing
+            mapCallbackGroup_ = this->create_callback_group(rclcpp::CallbackGroupType::MutuallyExclusive);
+            scanCallbackGroup_ = this->create_callback_group(rclcpp::CallbackGroupType::MutuallyExclusive);
+            odomCallbackGroup_ = this->create_callback_group(rclcpp::CallbackGroupType::MutuallyExclusive);
+            rclcpp::SubscriptionOptions mapSubOptions, scanSubOptions, odomSubOptions;
+            mapSubOptions.callback_group = mapCallbackGroup_;
+            scanSubOptions.callback_group = scanCallbackGroup_;
+            odomSubOptions.callback_group = odomCallbackGroup_;
+            // rclcpp up to Humble rejects intra-process comms on transient local endpoints, and a map that is
+            // received once gains nothing from it
+            mapSubOptions.use_intra_process_comm = rclcpp::IntraProcessSetting::Disable;
 
             mapSub_ = this->create_subscription<nav_msgs::msg::OccupancyGrid>(
-                mapName_, rclcpp::QoS(rclcpp::KeepLast(10)).transient_local(), std::bind(&GLPoseSampler::mapCB, this, std::placeholders::_1));
+                mapName_, rclcpp::QoS(rclcpp::KeepLast(10)).transient_local(), std::bind(&GLPoseSampler::mapCB, this, std::placeholders::_1), mapSubOptions);
 
             scanSub_ = this->create_subscription<sensor_msgs::msg::LaserScan>(
-                scanName_, 1, std::bind(&GLPoseSampler::scanCB, this, std::placeholders::_1));
+                scanName_, 1, std::bind(&GLPoseSampler::scanCB, this, std::placeholders::_1), scanSubOptions);
 
             odomSub_ = this->create_subscription<nav_msgs::msg::Odometry>(
-                odomName_, 1, std::bind(&GLPoseSampler::odomCB, this, std::placeholders::_1));
+                odomName_, 1, std::bind(&GLPoseSampler::odomCB, this, std::placeholders::_1), odomSubOptions);
+
+            if (priorPoseRadius_ > 0.0)
+                priorPoseSub_ = this->create_subscription<geometry_msgs::msg::PoseStamped>(
+                    priorPoseName_, 1, std::bind(&GLPoseSampler::priorPoseCB, this, std::placeholders::_1), odomSubOptions);
+
+            if (useAdaptiveScheduling_)
+            {
+                reliabilitySub_ = this->create_subscription<geometry_msgs::msg::Vector3Stamped>(
+                    reliabilityName_, 1, std::bind(&GLPoseSampler::reliabilityCB, this, std::placeholders::_1), odomSubOptions);
+                samplingTriggerSub_ = this->create_subscription<std_msgs::msg::Empty>(
+                    samplingTriggerName_, 1, std::bind(&GLPoseSampler::samplingTriggerCB, this, std::placeholders::_1), odomSubOptions);
+            }
 
             posesPub_ = this->create_publisher<geometry_msgs::msg::PoseArray>(posesName_, 1);
             localMapPub_ = this->create_publisher<nav_msgs::msg::OccupancyGrid>(localMapName_, 1);
-            sdfKeypointsPub_ = this->create_publisher<visualization_msgs::msg::Marker>(sdfKeypointsName_, 1);
+            // the global keypoints change only with the map, so they are published once for late subscribers as well;
+            // like the map subscription, this transient local publisher does not use intra-process comms
+            rclcpp::PublisherOptions sdfKeypointsPubOptions;
+            sdfKeypointsPubOptions.use_intra_process_comm = rclcpp::IntraProcessSetting::Disable;
+            sdfKeypointsPub_ = this->create_publisher<visualization_msgs::msg::Marker>(sdfKeypointsName_, rclcpp::QoS(1).transient_local(),
+                                                                                       sdfKeypointsPubOptions);
             localSDFKeypointsPub_ = this->create_publisher<visualization_msgs::msg::Marker>(localSDFKeypointsName_, 1);
 
+#if defined(ALS_ROS2_ENABLE_PROFILING)
+            // latency percentiles of the processing stages over the last stats_window_size updates, published in the
+            // namespace of the node so that several samplers do not share one topic
+            this->declare_parameter<std::string>("stats_name", "gl_sampler_stats");
+            this->get_parameter("stats_name", statsName_);
+
+            int statsWindowSize;
+            this->declare_parameter<int>("stats_window_size", 200);
+            this->get_parameter("stats_window_size", statsWindowSize);
+
+            double statsPublishInterval;
+            this->declare_parameter<double>("stats_publish_interval", 1.0);
+            this->get_parameter("stats_publish_interval", statsPublishInterval);
+
+            resetProfiler(statsWindowSize);
+            statsPub_ = this->create_publisher<diagnostic_msgs::msg::DiagnosticArray>(statsName_, 1);
+            statsTimer_ = this->create_wall_timer(std::chrono::duration<double>(statsPublishInterval), std::bind(&GLPoseSampler::publishStats, this));
+#endif
+
             // TODO: add in yaml config file for parameters
 
             auto timer_interface = std::make_shared<tf2_ros::CreateTimerROS>(
@@ -827,45 +615,55 @@ namespace als_ros2
 
             rotMatBaseLink2Laser.getRPY(baseLink2LaserRoll, baseLink2LaserPitch, baseLink2LaserYaw);
 
-            baseLink2Laser_.setX(tfBaseLink2Laser.transform.translation.x);
-            baseLink2Laser_.setY(tfBaseLink2Laser.transform.translation.y);
-            baseLink2Laser_.setYaw(baseLink2LaserYaw);
+            setBaseLink2Laser(Pose(tfBaseLink2Laser.transform.translation.x, tfBaseLink2Laser.transform.translation.y, baseLink2LaserYaw));
+
+            if (useAsyncPipeline_)
+            {
+                keyScanJobs_.setCapacity(asyncQueueSize_);
+                pipelineThread_ = std::thread(&GLPoseSampler::runPipeline, this);
+            }
         }
 
-        void mapCB(const nav_msgs::msg::OccupancyGrid::SharedPtr msg)
+        ~GLPoseSampler(void)
         {
+            keyScanJobs_.close();
+            if (pipelineThread_.joinable())
+                pipelineThread_.join();
+        }
 
-            setMapInfo(*msg);
-            cv::Mat distMap = buildDistanceFieldMap(*msg);
-            cv::GaussianBlur(distMap, distMap, cv::Size(5, 5), 5);
-            sdfKeypoints_ = detectKeypoints(*msg, distMap);
-            sdfOrientationFeatures_ = calculateFeatures(distMap, sdfKeypoints_);
-            sdfKeypointsMarker_ = makeSDFKeypointsMarker(sdfKeypoints_, mapFrame_);
+        void mapCB(const nav_msgs::msg::OccupancyGrid::SharedPtr msg)
+        {
+            std::lock_guard<std::mutex> lock(mapMutex_);
+            MapUpdateInfo info = updateMap(msg);
+            if (info.isUnchanged)
+            {
+                RCLCPP_INFO(this->get_logger(), "The map did not change; the SDF keypoints are kept");
+                return;
+            }
+            if (info.changedRegionsNum >= 0)
+                RCLCPP_INFO(this->get_logger(), "Updated the SDF keypoints in %d changed map regions", info.changedRegionsNum);
+            if (info.isSharedMapAttached)
+                RCLCPP_INFO(this->get_logger(), "Attached to the shared map %s with %d SDF keypoints", sharedMapName_.c_str(),
+                            getSDFKeypointsNum());
+            if (info.isCacheLoaded)
+                RCLCPP_INFO(this->get_logger(), "Loaded %d SDF keypoints from %s", getSDFKeypointsNum(),
+                            getSDFFeatureCacheFilePath().c_str());
+            if (info.isCacheSaveFailed)
+                RCLCPP_WARN(this->get_logger(), "Cannot write the SDF keypoint cache file %s",
+                            getSDFFeatureCacheFilePath().c_str());
+            if (useCoarseToFineMatching_)
+                RCLCPP_INFO(this->get_logger(), "Detected %d coarse SDF keypoints in %d matching regions", getCoarseSDFKeypointsNum(),
+                            getMatchingRegionsNum());
+            setSDFKeypointsMarker(getSDFKeypoints(), mapFrame_, sdfKeypointsMarker_);
             sdfKeypointsPub_->publish(sdfKeypointsMarker_);
             // print out a statement to show that the callback is running
             RCLCPP_INFO(this->get_logger(), "Map callback is running...");
-
-            gotMap_ = true;
         }
 
-        void scanCB(const sensor_msgs::msg::LaserScan::SharedPtr msg)
+        void scanCB(const sensor_msgs::msg::LaserScan::ConstSharedPtr msg)
         {
             // print out a statement to show that the callback is running
             // RCLCPP_INFO(this->get_logger(), "Scan callback is running...");
-            static bool isFirst = true;
-            static Pose prevOdomPose;
-
-            if (flipScan_)
-            {
-                // invert ranges to account for flippled lidar
-                std::vector<float> ranges = msg->ranges;
-                for (int i = 0; i < (int)ranges.size(); ++i)
-                {
-                    ranges[i] = msg->ranges[(int)msg->ranges.size() - 1 - i];
-                }
-                msg->ranges = ranges;
-            }
-
             int validScanNum = 0;
             for (int i = 0; i < (int)msg->ranges.size(); ++i)
             {
@@ -880,53 +678,54 @@ namespace als_ros2
                 return;
             }
 
-            if (isFirst && gotOdom_)
+            Pose odomPose;
+            bool gotOdom;
+            {
+                std::lock_guard<std::mutex> lock(odomMutex_);
+                odomPose = odomPose_;
+                gotOdom = gotOdom_;
+            }
+
+            if (isFirstScan_ && gotOdom)
             {
-                keyScans_.push_back(*msg);
-                keyPoses_.push_back(odomPose_);
-                prevOdomPose.setPose(odomPose_);
-                isFirst = false;
+                keyScans_.push(msg, odomPose);
+                prevOdomPose_.setPose(odomPose);
+                isFirstScan_ = false;
                 return;
             }
 
             bool isKeyScanUpdated = false;
-            double dx = odomPose_.getX() - prevOdomPose.getX();
-            double dy = odomPose_.getY() - prevOdomPose.getY();
+            double dx = odomPose.getX() - prevOdomPose_.getX();
+            double dy = odomPose.getY() - prevOdomPose_.getY();
             double dl = sqrt(dx * dx + dy * dy);
-            double dyaw = odomPose_.getYaw() - prevOdomPose.getYaw();
+            double dyaw = odomPose.getYaw() - prevOdomPose_.getYaw();
             while (dyaw < -M_PI)
                 dyaw += 2.0 * M_PI;
             while (dyaw > M_PI)
                 dyaw -= 2.0 * M_PI;
             if (dl > keyScanIntervalDist_ || fabs(dyaw) > keyScanIntervalYaw_)
             {
-                keyScans_.insert(keyScans_.begin(), *msg);
-                keyPoses_.insert(keyPoses_.begin(), odomPose_);
-                if ((int)keyScans_.size() >= keyScansNum_)
-                {
-                    keyScans_.resize(keyScansNum_);
-                    keyPoses_.resize(keyScansNum_);
-                }
-                prevOdomPose.setPose(odomPose_);
+                keyScans_.push(msg, odomPose);
+                prevOdomPose_.setPose(odomPose);
                 isKeyScanUpdated = true;
             }
 
-            if (isKeyScanUpdated && (int)keyScans_.size() == keyScansNum_)
+            bool isRun = useAdaptiveScheduling_ ? keyScanScheduler_.shouldRun(isKeyScanUpdated, keyScans_.isFull(), this->now().seconds())
+                                                : isKeyScanUpdated && keyScans_.isFull();
+            if (isRun)
             {
-                nav_msgs::msg::OccupancyGrid localMap = buildLocalMap();
-                cv::Mat localDistMap = buildDistanceFieldMap(localMap);
-                cv::GaussianBlur(localDistMap, localDistMap, cv::Size(5, 5), 5);
-                std::vector<Keypoint> localSDFKeypoints = detectKeypoints(localMap, localDistMap);
-                std::vector<SDFOrientationFeature> localSDFOrientationFeatures = calculateFeatures(localDistMap, localSDFKeypoints);
-                std::vector<int> correspondingIndices = findCorrespondingFeatures(localSDFKeypoints, localSDFOrientationFeatures);
-                geometry_msgs::msg::PoseArray poses = generatePoses(prevOdomPose, localSDFKeypoints, localSDFOrientationFeatures, correspondingIndices);
-                visualization_msgs::msg::Marker localSDFKeypointsMarker = makeSDFKeypointsMarker(localSDFKeypoints, odomFrame_);
-
-                poses.header.stamp = localMap.header.stamp = sdfKeypointsMarker_.header.stamp = localSDFKeypointsMarker.header.stamp = msg->header.stamp;
-                posesPub_->publish(poses);
-                localMapPub_->publish(localMap);
-                sdfKeypointsPub_->publish(sdfKeypointsMarker_);
-                localSDFKeypointsPub_->publish(localSDFKeypointsMarker);
+                if (useAsyncPipeline_)
+                {
+                    KeyScanJob job;
+                    job.keyScans = keyScans_;
+                    job.prevOdomPose = prevOdomPose_;
+                    job.stamp = msg->header.stamp;
+                    keyScanJobs_.push(std::move(job));
+                }
+                else
+                {
+                    processKeyScans(keyScans_, prevOdomPose_, msg->header.stamp);
+                }
             }
         }
 
@@ -941,9 +740,50 @@ namespace als_ros2
             double roll, pitch, yaw;
             tf2::Matrix3x3 m(q);
             m.getRPY(roll, pitch, yaw);
+            std::lock_guard<std::mutex> lock(odomMutex_);
             odomPose_.setPose(msg->pose.pose.position.x, msg->pose.pose.position.y, yaw);
             gotOdom_ = true;
         }
+
+        void reliabilityCB(const geometry_msgs::msg::Vector3Stamped::SharedPtr msg)
+        {
+            keyScanScheduler_.setReliability(msg->vector.x, this->now().seconds());
+        }
+
+        void samplingTriggerCB(const std_msgs::msg::Empty::SharedPtr)
+        {
+            keyScanScheduler_.trigger();
+        }
+
+        void priorPoseCB(const geometry_msgs::msg::PoseStamped::SharedPtr msg)
+        {
+            // a prior pose in another frame is transformed to the map frame with the latest transform
+            geometry_msgs::msg::PoseStamped pose = *msg;
+            if (msg->header.frame_id != mapFrame_)
+            {
+                try
+                {
+                    geometry_msgs::msg::TransformStamped transform = tf_buffer_->lookupTransform(mapFrame_, msg->header.frame_id, tf2::TimePointZero);
+                    tf2::doTransform(*msg, pose, transform);
+                }
+                catch (tf2::TransformException &ex)
+                {
+                    RCLCPP_WARN(this->get_logger(), "The prior pose is ignored since it cannot be transformed from %s to %s: %s",
+                                msg->header.frame_id.c_str(), mapFrame_.c_str(), ex.what());
+                    return;
+                }
+            }
+            tf2::Quaternion q(pose.pose.orientation.x,
+                              pose.pose.orientation.y,
+                              pose.pose.orientation.z,
+                              pose.pose.orientation.w);
+            double roll, pitch, yaw;
+            tf2::Matrix3x3 m(q);
+            m.getRPY(roll, pitch, yaw);
+            std::lock_guard<std::mutex> lock(priorPoseMutex_);
+            priorPose_.setPose(pose.pose.position.x, pose.pose.position.y, yaw);
+            gotPriorPose_ = true;
+        }
     };
 
 } // namespace als_ros2
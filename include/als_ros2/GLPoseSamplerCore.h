@@ -0,0 +1,1468 @@
+/****************************************************************************
+ * als_ros: An Advanced Localization System for ROS use with 2D LiDAR
+ * Copyright (C) 2022 Naoki Akai
+ *
+ * Licensed under the Apache License, Version 2.0 (the “License”);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an “AS IS” BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * To implement this program, a following paper was referred.
+ * https://arxiv.org/pdf/1908.01863.pdf
+ *
+ * @author Naoki Akai
+ * modified by: Roald Ong
+ ****************************************************************************/
+
+#ifndef __GL_POSE_SAMPLER_CORE_H__
+#define __GL_POSE_SAMPLER_CORE_H__
+
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <opencv2/opencv.hpp>
+
+#include <nav_msgs/msg/occupancy_grid.hpp>
+#include <sensor_msgs/msg/laser_scan.hpp>
+#include <geometry_msgs/msg/pose_array.hpp>
+
+#include "als_ros2/Pose.h"
+#include "als_ros2/Transform2D.h"
+#include "als_ros2/Keypoint.h"
+#include "als_ros2/SDFFeatureSet.h"
+#include "als_ros2/SDFFeatureIndex.h"
+#include "als_ros2/SDFOrientationMap.h"
+#include "als_ros2/SDFKeypointDetector.h"
+#include "als_ros2/SDFOpenCLPipeline.h"
+#include "als_ros2/SDFMatchingRegions.h"
+#include "als_ros2/SDFFeatureCache.h"
+#include "als_ros2/GlobalMapStore.h"
+#include "als_ros2/RollingLocalMap.h"
+#include "als_ros2/RayCaster.h"
+#include "als_ros2/MatchingRateEvaluator.h"
+#include "als_ros2/KeyScanRing.h"
+#include "als_ros2/StageProfiler.h"
+#include "als_ros2/GaussianSampler.h"
+
+#include <tf2/LinearMath/Quaternion.h>
+#include <tf2/LinearMath/Matrix3x3.h>
+#include <tf2_geometry_msgs/tf2_geometry_msgs.hpp>
+
+namespace als_ros2
+{
+
+    /**
+     * @brief Global localization pose sampling without a ROS node.
+     *
+     * This holds the global map, its SDF keypoints and features, and every processing stage
+     * from the local map to the pose candidates, so that the stages can be run and timed on
+     * recorded data without rclcpp. GLPoseSampler derives from it and only adds parameters,
+     * topics, and the key scan selection. The class is not thread-safe; GLPoseSampler
+     * serializes the calls with its map mutex.
+     *
+     * The core is header-only like the rest of the package and is compiled into every target
+     * that includes it. Its layout and its SIMD paths depend on ALS_ROS2_ENABLE_PROFILING and
+     * the target architecture, which a compiled library would fix for all of its users, and
+     * the node and the benchmark configure it through its protected members.
+     */
+    class GLPoseSamplerCore
+    {
+    public:
+        struct MapUpdateInfo
+        {
+            bool isUnchanged;         // an incremental update found no changed cell
+            int changedRegionsNum;    // the number of recomputed regions of an incremental update (-1: full build)
+            bool isCacheLoaded;       // the keypoints were loaded from the cache
+            bool isCacheSaveFailed;   // the keypoints could not be written to the cache
+            bool isSharedMapAttached; // the global map data was built by another instance and taken from GlobalMapStore
+        };
+
+        struct PoseEstimationInfo
+        {
+            double matchingTime;        // the stages before the pose generation [ms]
+            double poseGenerationTime;  // the pose generation [ms]
+            int correspondencesNum;     // the local keypoints with a corresponding global keypoint
+            int usedCorrespondencesNum; // the correspondences that poses were generated from
+        };
+
+    protected:
+        Transform2D baseLink2Laser_;
+
+        int mapWidth_, mapHeight_;
+        double mapResolution_;
+        GridTransform mapTransform_;
+        const signed char *mapData_;
+        std::shared_ptr<GlobalMapData> globalMap_; // the map message is kept instead of a copy of the cells
+        std::string sharedMapName_;                // the GlobalMapStore entry (empty: not shared)
+        MatchingRateEvaluator matchingRateEvaluator_;
+        bool useDistanceFieldMatchingRate_;
+        double matchingDistanceFieldSigma_;
+        bool gotMap_;
+
+        bool useIncrementalLocalMap_;
+        RollingLocalMap rollingLocalMap_;
+        BeamTable beamTable_;
+        std::vector<double> beamEndXs_, beamEndYs_; // the end points of the beams of a key scan
+        int rollingLocalMapKeyScansCount_;
+        SDFFeatureCache sdfFeatureCache_;
+        bool useCoarseToFineMatching_;
+        int coarseMatchingScale_;
+        int coarseCandidateRegionsNum_;
+        double matchingRegionSize_;
+        double priorPoseRadius_;
+        SDFMatchingRegions sdfMatchingRegions_;
+        bool usePriorPose_; // set for every update
+        Pose activePriorPose_;
+
+        double gradientSquareTH_;
+        double keypointsMinDistFromMap_;
+        double sdfFeatureWindowSize_;
+        double averageSDFDeltaTH_;
+        int sdfTileSize_;
+        double sdfMaxDistance_;
+        bool useIncrementalMapUpdate_;
+        bool addRandomSamples_, addOppositeSamples_;
+        int randomSamplesNum_;
+        int preprocessingThreadsNum_;
+        bool useOpenCL_;
+        int poseGenerationThreadsNum_;
+        int maxCorrespondencesNum_; // set for every update (-1: unlimited)
+        double positionalRandomNoise_, angularRandomNoise_, matchingRateTH_;
+        GaussianSampler gaussianSampler_;
+
+        // output and scratch of a chunk of correspondences in generatePoses
+        struct PoseGenerationBuffer
+        {
+            std::vector<geometry_msgs::msg::Pose> poses;
+            std::vector<double> sampleXs, sampleYs, sampleYaws, sampleRates;
+            int candidatesNum, rejectedCandidatesNum;
+        };
+        std::vector<PoseGenerationBuffer> poseGenerationBuffers_;
+
+        // intermediate buffers of the processing stages; the stages of a key scan update reuse
+        // their own set so that the buffers keep their capacity from one update to the next
+        struct StageScratch
+        {
+            cv::Mat binMap, distMap;
+            std::vector<std::vector<Keypoint>> tileKeypoints;
+            SDFOrientationMap orientationMap;
+            std::vector<Keypoint> keypoints;
+            SDFFeatureSet features;
+            std::vector<int> candidateIndices, correspondingIndices;
+            SDFOpenCLPipeline openCLPipeline;
+        };
+        StageScratch scanScratch_, coarseScanScratch_;
+        nav_msgs::msg::OccupancyGrid coarseLocalMap_;
+
+#if defined(ALS_ROS2_ENABLE_PROFILING)
+        // series of profiler_; the *_MS series are latencies and the others are counts per update
+        enum ProfileSeries
+        {
+            PROFILE_SCAN_BUILD_LOCAL_MAP_MS,
+            PROFILE_SCAN_DISTANCE_FIELD_MS,
+            PROFILE_SCAN_GAUSSIAN_BLUR_MS,
+            PROFILE_SCAN_DETECT_KEYPOINTS_MS,
+            PROFILE_SCAN_CALCULATE_FEATURES_MS,
+            PROFILE_SCAN_FIND_CORRESPONDENCES_MS,
+            PROFILE_SCAN_GENERATE_POSES_MS,
+            PROFILE_SCAN_PUBLISH_MS,
+            PROFILE_SCAN_TOTAL_MS,
+            PROFILE_SCAN_LOCAL_KEYPOINTS,
+            PROFILE_SCAN_CORRESPONDENCES,
+            PROFILE_SCAN_CANDIDATES,
+            PROFILE_SCAN_REJECTED_CANDIDATES,
+            PROFILE_MAP_CACHE_LOAD_MS,
+            PROFILE_MAP_MATCHING_GRID_MS,
+            PROFILE_MAP_KEYPOINTS_MS,
+            PROFILE_MAP_MATCHING_STRUCTURES_MS,
+            PROFILE_MAP_TOTAL_MS,
+        };
+        StageProfiler profiler_;
+
+        void resetProfiler(int windowSize)
+        {
+            profiler_.reset({"scan/build_local_map [ms]", "scan/distance_field [ms]", "scan/gaussian_blur [ms]", "scan/detect_keypoints [ms]",
+                             "scan/calculate_features [ms]", "scan/find_correspondences [ms]", "scan/generate_poses [ms]", "scan/publish [ms]",
+                             "scan/total [ms]", "scan/local_keypoints", "scan/correspondences", "scan/candidates", "scan/rejected_candidates",
+                             "map/cache_load [ms]", "map/matching_grid [ms]", "map/keypoints [ms]", "map/matching_structures [ms]", "map/total [ms]"},
+                            windowSize);
+        }
+#endif
+
+    public:
+        // the defaults are the same as the defaults of the GLPoseSampler parameters
+        GLPoseSamplerCore(void) : mapWidth_(0), mapHeight_(0), mapResolution_(0.0), mapData_(NULL),
+                                  globalMap_(std::make_shared<GlobalMapData>()), useDistanceFieldMatchingRate_(false), matchingDistanceFieldSigma_(0.05),
+                                  gotMap_(false), useIncrementalLocalMap_(false), rollingLocalMapKeyScansCount_(0),
+                                  useCoarseToFineMatching_(false), coarseMatchingScale_(4), coarseCandidateRegionsNum_(5),
+                                  matchingRegionSize_(10.0), priorPoseRadius_(0.0), usePriorPose_(false),
+                                  gradientSquareTH_(10e-4), keypointsMinDistFromMap_(0.2), sdfFeatureWindowSize_(1.0),
+                                  averageSDFDeltaTH_(1.0), sdfTileSize_(0), sdfMaxDistance_(5.0), useIncrementalMapUpdate_(false),
+                                  addRandomSamples_(true), addOppositeSamples_(true), randomSamplesNum_(30), preprocessingThreadsNum_(1),
+                                  useOpenCL_(false), poseGenerationThreadsNum_(1), maxCorrespondencesNum_(-1),
+                                  positionalRandomNoise_(0.5), angularRandomNoise_(0.3), matchingRateTH_(0.1)
+        {
+            std::random_device device;
+            gaussianSampler_.seed(((uint64_t)device() << 32) | (uint64_t)device());
+#if defined(ALS_ROS2_ENABLE_PROFILING)
+            resetProfiler(200);
+#endif
+        }
+
+        inline bool gotMap(void) { return gotMap_; }
+        inline int getSDFKeypointsNum(void) { return (int)globalMap_->sdfKeypoints.size(); }
+        inline int getCoarseSDFKeypointsNum(void) { return (int)globalMap_->coarseSDFKeypoints.size(); }
+        inline int getMatchingRegionsNum(void) { return sdfMatchingRegions_.getRegionsNum(); }
+        inline std::string getSDFFeatureCacheFilePath(void) { return sdfFeatureCache_.getFilePath(); }
+        inline const std::vector<Keypoint> &getSDFKeypoints(void) const { return globalMap_->sdfKeypoints; }
+        inline void setBaseLink2Laser(Pose baseLink2Laser) { baseLink2Laser_.set(baseLink2Laser.getX(), baseLink2Laser.getY(), baseLink2Laser.getYaw()); }
+
+        /**
+         * @brief Seeds the noise of the random pose samples so that runs are reproducible.
+         * @param seed The seed.
+         */
+        inline void setRandomSeed(uint64_t seed) { gaussianSampler_.seed(seed); }
+
+        /**
+         * @brief Caps the correspondences that the poses of an update are generated from.
+         * @param maxCorrespondencesNum The maximum number of correspondences (-1: unlimited).
+         */
+        inline void setMaxCorrespondencesNum(int maxCorrespondencesNum) { maxCorrespondencesNum_ = maxCorrespondencesNum; }
+
+        /**
+         * @brief Selects the OpenCL pipeline for the distance fields, the blur, and the keypoint detection.
+         * @param useOpenCL If true, the OpenCL pipeline is used if an OpenCL device is available.
+         * @return True if the OpenCL pipeline is used.
+         */
+        bool setUseOpenCL(bool useOpenCL)
+        {
+            useOpenCL_ = useOpenCL && SDFOpenCLPipeline::isAvailable();
+            if (useOpenCL_)
+                cv::ocl::setUseOpenCL(true);
+            return useOpenCL_;
+        }
+
+        inline void xy2uv(double x, double y, int *u, int *v) { mapTransform_.xy2uv(x, y, u, v); }
+
+        inline void uv2xy(int u, int v, double *x, double *y) { mapTransform_.uv2xy(u, v, x, y); }
+
+        void setMapInfo(const nav_msgs::msg::OccupancyGrid &map)
+        {
+            mapWidth_ = map.info.width;
+            mapHeight_ = map.info.height;
+            mapResolution_ = map.info.resolution;
+            mapTransform_ = getGridTransform(map);
+        }
+
+        /*
+         * Builds the lookup grid of computeMatchingRate. In the default mode, a cell is 1 if the
+         * cell or one of its 4-neighbours is occupied. In the distance field mode, a cell holds
+         * exp(-d^2 / (2 sigma^2)) of the distance d to the closest occupied cell, quantized to
+         * [0, 255]. Border cells are 0 so that a beam needs only one lookup, and the grid is
+         * followed by 4 padding bytes for the 32-bit gathers of MatchingRateEvaluator.
+         */
+        void buildMatchingRateGrid(cv::Mat &distMap)
+        {
+            globalMap_->matchingRateGrid.assign(mapWidth_ * mapHeight_ + 4, 0);
+            if (!useDistanceFieldMatchingRate_)
+            {
+                globalMap_->matchingRateGridScale = 1;
+                fillCellMatchingRateGrid(1, mapWidth_ - 1, 1, mapHeight_ - 1);
+                return;
+            }
+
+            globalMap_->matchingRateGridScale = 255;
+            if (!distMap.empty())
+                fillDistanceFieldMatchingRateGrid(distMap, 0, 0, 1, mapWidth_ - 1, 1, mapHeight_ - 1);
+        }
+
+        void fillCellMatchingRateGrid(int uBegin, int uEnd, int vBegin, int vEnd)
+        {
+            for (int v = vBegin; v < vEnd; ++v)
+            {
+                for (int u = uBegin; u < uEnd; ++u)
+                {
+                    int n0 = v * mapWidth_ + u;
+                    bool isMatched = mapData_[n0] == 100 || mapData_[n0 - mapWidth_] == 100 || mapData_[n0 - 1] == 100 ||
+                                     mapData_[n0 + 1] == 100 || mapData_[n0 + mapWidth_] == 100;
+                    globalMap_->matchingRateGrid[n0] = isMatched ? 1 : 0;
+                }
+            }
+        }
+
+        /*
+         * Fills the cells [uBegin, uEnd) x [vBegin, vEnd) of the distance field lookup grid from a
+         * distance map whose cell (0, 0) is the map cell (uOffset, vOffset).
+         */
+        void fillDistanceFieldMatchingRateGrid(cv::Mat &distMap, int uOffset, int vOffset, int uBegin, int uEnd, int vBegin, int vEnd)
+        {
+            double k = -1.0 / (2.0 * matchingDistanceFieldSigma_ * matchingDistanceFieldSigma_);
+            for (int v = vBegin; v < vEnd; ++v)
+            {
+                const float *distRow = distMap.ptr<float>(v - vOffset);
+                for (int u = uBegin; u < uEnd; ++u)
+                {
+                    double d = distRow[u - uOffset];
+                    globalMap_->matchingRateGrid[v * mapWidth_ + u] = (uint8_t)(255.0 * exp(k * d * d) + 0.5);
+                }
+            }
+        }
+
+        /*
+         * Runs func(begin, end) over [0, num) split into chunks that are processed by the
+         * preprocessing threads. The chunks are contiguous and ordered, so callers that write
+         * per-chunk results and merge them by chunk index get the same order as a serial loop.
+         */
+        template <typename Func>
+        void runParallelChunks(int num, int chunksNum, Func func)
+        {
+            runParallelChunks(num, chunksNum, preprocessingThreadsNum_, func);
+        }
+
+        /*
+         * Same as above with at most threadsNum threads. OpenCV's pool runs one stripe per
+         * worker and the workers take the chunks in turn as they become idle, so more chunks
+         * than threads balance chunks of uneven cost. The number of threads of the pool itself
+         * is left alone, so it also bounds threadsNum.
+         */
+        template <typename Func>
+        void runParallelChunks(int num, int chunksNum, int threadsNum, Func func)
+        {
+            if (threadsNum <= 1 || num < chunksNum || chunksNum <= 1)
+            {
+                func(0, num, 0);
+                return;
+            }
+            int workersNum = std::min(threadsNum, chunksNum);
+            std::atomic<int> nextChunk(0);
+            cv::parallel_for_(cv::Range(0, workersNum), [&](const cv::Range &range)
+                              {
+                                  for (int w = range.start; w < range.end; ++w)
+                                  {
+                                      for (int c = nextChunk++; c < chunksNum; c = nextChunk++)
+                                          func((int)((long)num * c / chunksNum), (int)((long)num * (c + 1) / chunksNum), c);
+                                  }
+                              },
+                              (double)workersNum);
+        }
+
+        inline int getChunksNum(void)
+        {
+            return preprocessingThreadsNum_ <= 1 ? 1 : preprocessingThreadsNum_ * 4;
+        }
+
+        cv::Mat buildDistanceFieldMap(const nav_msgs::msg::OccupancyGrid &map)
+        {
+            StageScratch scratch;
+            cv::Mat distMap;
+            buildDistanceFieldMap(map, scratch, distMap);
+            return distMap;
+        }
+
+        /*
+         * Same as above into distMap. cv::Mat::create keeps the memory of a matrix of the same
+         * size, so buffers that are reused for maps of the same size are not reallocated.
+         */
+        void buildDistanceFieldMap(const nav_msgs::msg::OccupancyGrid &map, StageScratch &scratch, cv::Mat &distMap)
+        {
+            int width = (int)map.info.width;
+            cv::Mat &binMap = scratch.binMap;
+            binMap.create(map.info.height, map.info.width, CV_8UC1);
+            runParallelChunks((int)map.info.height, getChunksNum(), [&](int vBegin, int vEnd, int)
+                              {
+                                  for (int v = vBegin; v < vEnd; v++)
+                                  {
+                                      uchar *binRow = binMap.ptr<uchar>(v);
+                                      const signed char *dataRow = &map.data[v * width];
+                                      for (int u = 0; u < width; u++)
+                                          binRow[u] = (dataRow[u] == 100) ? 0 : 1;
+                                  }
+                              });
+
+            distMap.create(map.info.height, map.info.width, CV_32FC1);
+            cv::distanceTransform(binMap, distMap, cv::DIST_L2, 5);
+            float resolution = (float)map.info.resolution;
+            runParallelChunks((int)map.info.height, getChunksNum(), [&](int vBegin, int vEnd, int)
+                              {
+                                  for (int v = vBegin; v < vEnd; v++)
+                                  {
+                                      float *distRow = distMap.ptr<float>(v);
+                                      for (int u = 0; u < width; u++)
+                                          distRow[u] = distRow[u] * resolution;
+                                  }
+                              });
+        }
+
+        std::vector<Keypoint> detectKeypoints(const nav_msgs::msg::OccupancyGrid &map, cv::Mat &distMap, double gradientSquareTH)
+        {
+            StageScratch scratch;
+            std::vector<Keypoint> keypoints;
+            detectKeypoints(map, distMap, gradientSquareTH, scratch, keypoints);
+            return keypoints;
+        }
+
+        void detectKeypoints(const nav_msgs::msg::OccupancyGrid &map, cv::Mat &distMap, double gradientSquareTH,
+                             StageScratch &scratch, std::vector<Keypoint> &keypoints)
+        {
+            keypoints.clear();
+            // row tiles are detected independently and merged in tile order
+            int width = (int)map.info.width, height = (int)map.info.height;
+            if (width <= 2 || height <= 2)
+                return;
+            SDFKeypointDetector detector;
+            detector.setThresholds(keypointsMinDistFromMap_, gradientSquareTH);
+            const float *dist = distMap.ptr<float>(0);
+            size_t stride = distMap.step1();
+            int chunksNum = getChunksNum();
+            std::vector<std::vector<Keypoint>> &tileKeypoints = scratch.tileKeypoints;
+            if ((int)tileKeypoints.size() < chunksNum)
+                tileKeypoints.resize(chunksNum);
+            for (int c = 0; c < chunksNum; ++c)
+                tileKeypoints[c].clear();
+            runParallelChunks(height, chunksNum, [&](int begin, int end, int chunk)
+                              { detector.detectRows(dist, stride, map.data.data(), width, height, begin, end, tileKeypoints[chunk]); });
+
+            size_t keypointsNum = 0;
+            for (int c = 0; c < chunksNum; ++c)
+                keypointsNum += tileKeypoints[c].size();
+            keypoints.reserve(keypointsNum);
+            for (int c = 0; c < chunksNum; ++c)
+                keypoints.insert(keypoints.end(), tileKeypoints[c].begin(), tileKeypoints[c].end());
+            locateKeypoints(map, keypoints);
+        }
+
+        /*
+         * Sorts keypoints with cell indices into the order of detectKeypoints and sets their
+         * positions in the frame of the map.
+         */
+        void locateKeypoints(const nav_msgs::msg::OccupancyGrid &map, std::vector<Keypoint> &keypoints)
+        {
+            GridTransform mapTransform = getGridTransform(map);
+            // the keypoints are returned in column-major order as the matching depends on their order
+            std::sort(keypoints.begin(), keypoints.end(), [](Keypoint &a, Keypoint &b)
+                      { return a.getU() < b.getU() || (a.getU() == b.getU() && a.getV() < b.getV()); });
+            for (int i = 0; i < (int)keypoints.size(); ++i)
+            {
+                double x, y;
+                mapTransform.uv2xy(keypoints[i].getU(), keypoints[i].getV(), &x, &y);
+                keypoints[i].setX(x);
+                keypoints[i].setY(y);
+            }
+        }
+
+        /*
+         * Same as detectKeypoints on the distance field of the OpenCL pipeline of the scratch,
+         * which is downloaded to distMap for calculateFeatures. If the keypoint kernel cannot
+         * run, the keypoints are detected from distMap on the CPU.
+         */
+        void detectKeypointsOpenCL(const nav_msgs::msg::OccupancyGrid &map, double gradientSquareTH, StageScratch &scratch,
+                                   cv::Mat &distMap, std::vector<Keypoint> &keypoints)
+        {
+            scratch.openCLPipeline.download(distMap);
+            if (scratch.openCLPipeline.detectKeypoints(keypointsMinDistFromMap_, gradientSquareTH, keypoints))
+                locateKeypoints(map, keypoints);
+            else
+                detectKeypoints(map, distMap, gradientSquareTH, scratch, keypoints);
+        }
+
+        SDFFeatureSet calculateFeatures(cv::Mat &distMap, double resolution, std::vector<Keypoint> &keypoints)
+        {
+            StageScratch scratch;
+            SDFFeatureSet features;
+            calculateFeatures(distMap, resolution, keypoints, scratch, features);
+            return features;
+        }
+
+        /*
+         * Calculates the features of the keypoints. The gradient orientations and the summed-area
+         * table of the distance map are computed once, and every feature is counted from them.
+         * Every feature of the resized set is overwritten, so a reused set needs no clearing.
+         */
+        void calculateFeatures(cv::Mat &distMap, double resolution, std::vector<Keypoint> &keypoints,
+                               StageScratch &scratch, SDFFeatureSet &features)
+        {
+            features.resize((int)keypoints.size());
+            if (keypoints.empty())
+                return;
+
+            int r = (int)(sdfFeatureWindowSize_ / resolution);
+            const float *dist = distMap.ptr<float>(0);
+            size_t stride = distMap.step1();
+            SDFOrientationMap &orientationMap = scratch.orientationMap;
+            orientationMap.reset(distMap.cols, distMap.rows);
+            runParallelChunks(distMap.rows, getChunksNum(), [&](int vBegin, int vEnd, int)
+                              { orientationMap.buildRows(dist, stride, vBegin, vEnd); });
+            orientationMap.buildSums(dist, stride);
+            runParallelChunks((int)keypoints.size(), getChunksNum(), [&](int begin, int end, int)
+                              {
+                                  for (int i = begin; i < end; ++i)
+                                      orientationMap.computeFeature(keypoints[i].getU(), keypoints[i].getV(), r, features, i);
+                              });
+        }
+
+        // a rectangle of map cells [u0, u1) x [v0, v1)
+        struct CellRect
+        {
+            int u0, v0, u1, v1;
+        };
+
+        // cells by which a map edit can change the clamped distance field, the blurred field, and the features around it
+        inline int getSDFInfluenceRadius(double resolution)
+        {
+            return (int)ceil(sdfMaxDistance_ / resolution) + (int)(sdfFeatureWindowSize_ / resolution) + 3;
+        }
+
+        /*
+         * Detects the keypoints inside a rectangle of the map and calculates their features. The
+         * rectangle is padded by the SDF influence radius, so the clamped distance field inside it
+         * and the features of its keypoints are the same as for the whole map. In the distance
+         * field matching rate mode, the lookup grid inside the rectangle is filled as well. The
+         * keypoints have map cell indices and are in column-major order.
+         */
+        void computeSDFFeaturesInRect(const nav_msgs::msg::OccupancyGrid &map, GridTransform &mapTransform, CellRect rect, bool computeFeatures,
+                                      std::vector<Keypoint> &keypoints, SDFFeatureSet &features)
+        {
+            int width = (int)map.info.width, height = (int)map.info.height;
+            double resolution = map.info.resolution;
+            int margin = getSDFInfluenceRadius(resolution);
+            int pu0 = std::max(rect.u0 - margin, 0), pu1 = std::min(rect.u1 + margin, width);
+            int pv0 = std::max(rect.v0 - margin, 0), pv1 = std::min(rect.v1 + margin, height);
+
+            nav_msgs::msg::OccupancyGrid tileMap;
+            tileMap.info = map.info;
+            tileMap.info.width = pu1 - pu0;
+            tileMap.info.height = pv1 - pv0;
+            tileMap.data.resize((size_t)(pu1 - pu0) * (pv1 - pv0));
+            for (int v = pv0; v < pv1; ++v)
+                std::copy(&map.data[v * width + pu0], &map.data[v * width + pu1], &tileMap.data[(v - pv0) * (pu1 - pu0)]);
+
+            cv::Mat tileDistMap = buildDistanceFieldMap(tileMap);
+            cv::min(tileDistMap, (double)sdfMaxDistance_, tileDistMap);
+            if (useDistanceFieldMatchingRate_)
+                fillDistanceFieldMatchingRateGrid(tileDistMap, pu0, pv0, rect.u0, rect.u1, rect.v0, rect.v1);
+            keypoints.clear();
+            if (!computeFeatures)
+                return;
+
+            cv::GaussianBlur(tileDistMap, tileDistMap, cv::Size(5, 5), 5);
+            std::vector<Keypoint> tileKeypoints = detectKeypoints(tileMap, tileDistMap, gradientSquareTH_);
+            for (int i = 0; i < (int)tileKeypoints.size(); ++i)
+            {
+                int u = tileKeypoints[i].getU() + pu0, v = tileKeypoints[i].getV() + pv0;
+                if (rect.u0 <= u && u < rect.u1 && rect.v0 <= v && v < rect.v1)
+                    keypoints.push_back(tileKeypoints[i]);
+            }
+            features = calculateFeatures(tileDistMap, resolution, keypoints);
+            for (int i = 0; i < (int)keypoints.size(); ++i)
+            {
+                int u = keypoints[i].getU() + pu0, v = keypoints[i].getV() + pv0;
+                double x, y;
+                mapTransform.uv2xy(u, v, &x, &y);
+                keypoints[i] = Keypoint(u, v, x, y, keypoints[i].getType());
+            }
+        }
+
+        /*
+         * Merges groups of keypoints and features into the column-major order of detectKeypoints.
+         * The groups must not share cells.
+         */
+        void mergeKeypointsInCellOrder(std::vector<std::vector<Keypoint>> &keypointGroups, std::vector<SDFFeatureSet> &featureGroups,
+                                       std::vector<Keypoint> &keypoints, SDFFeatureSet &features)
+        {
+            std::vector<std::pair<int, int>> order; // (group, index)
+            for (int g = 0; g < (int)keypointGroups.size(); ++g)
+            {
+                for (int i = 0; i < (int)keypointGroups[g].size(); ++i)
+                    order.push_back(std::make_pair(g, i));
+            }
+            std::sort(order.begin(), order.end(), [&keypointGroups](const std::pair<int, int> &a, const std::pair<int, int> &b)
+                      {
+                          Keypoint &ka = keypointGroups[a.first][a.second], &kb = keypointGroups[b.first][b.second];
+                          return ka.getU() < kb.getU() || (ka.getU() == kb.getU() && ka.getV() < kb.getV()); });
+
+            keypoints.resize(order.size());
+            features.resize((int)order.size());
+            int hist[SDFFeatureSet::HIST_SIZE];
+            for (int i = 0; i < (int)order.size(); ++i)
+            {
+                int g = order[i].first, j = order[i].second;
+                SDFFeatureSet &f = featureGroups[g];
+                for (int k = 0; k < SDFFeatureSet::HIST_SIZE; ++k)
+                    hist[k] = f.getRelativeOrientationHist(j, k);
+                keypoints[i] = keypointGroups[g][j];
+                features.set(i, f.getDominantOrientation(j), f.getAverageSDF(j), hist);
+            }
+        }
+
+        inline double getMapYaw(const nav_msgs::msg::OccupancyGrid &map)
+        {
+            tf2::Quaternion q(map.info.origin.orientation.x,
+                              map.info.origin.orientation.y,
+                              map.info.origin.orientation.z,
+                              map.info.origin.orientation.w);
+            double roll, pitch, yaw;
+            tf2::Matrix3x3 m(q);
+            m.getRPY(roll, pitch, yaw);
+            return yaw;
+        }
+
+        inline GridTransform getGridTransform(const nav_msgs::msg::OccupancyGrid &map)
+        {
+            return GridTransform(map.info.origin.position.x, map.info.origin.position.y, getMapYaw(map), map.info.resolution);
+        }
+
+        /*
+         * Detects the keypoints of the map and calculates their features tile by tile, so that the
+         * distance fields of only one padded tile are resident at a time.
+         */
+        void buildTiledSDFFeatures(const nav_msgs::msg::OccupancyGrid &map, bool computeFeatures,
+                                   std::vector<Keypoint> &keypoints, SDFFeatureSet &features)
+        {
+            GridTransform mapTransform = getGridTransform(map);
+            int width = (int)map.info.width, height = (int)map.info.height;
+            std::vector<std::vector<Keypoint>> keypointGroups;
+            std::vector<SDFFeatureSet> featureGroups;
+            for (int tv = 1; tv < height - 1; tv += sdfTileSize_)
+            {
+                for (int tu = 1; tu < width - 1; tu += sdfTileSize_)
+                {
+                    CellRect rect = {tu, tv, std::min(tu + sdfTileSize_, width - 1), std::min(tv + sdfTileSize_, height - 1)};
+                    keypointGroups.push_back(std::vector<Keypoint>());
+                    featureGroups.push_back(SDFFeatureSet());
+                    computeSDFFeaturesInRect(map, mapTransform, rect, computeFeatures, keypointGroups.back(), featureGroups.back());
+                }
+            }
+            if (computeFeatures)
+                mergeKeypointsInCellOrder(keypointGroups, featureGroups, keypoints, features);
+        }
+
+        /*
+         * Finds the blocks of cells that differ between two maps of the same geometry, dilates
+         * them by the SDF influence radius, and merges overlapping rectangles. Returns false if
+         * the geometry differs or too much of the map changed for a partial update to pay off.
+         */
+        bool findDirtyRects(const nav_msgs::msg::OccupancyGrid &prevMap, const nav_msgs::msg::OccupancyGrid &map, std::vector<CellRect> &rects)
+        {
+            rects.clear();
+            if (prevMap.info.width != map.info.width || prevMap.info.height != map.info.height ||
+                prevMap.info.resolution != map.info.resolution ||
+                prevMap.info.origin.position.x != map.info.origin.position.x || prevMap.info.origin.position.y != map.info.origin.position.y ||
+                prevMap.info.origin.orientation.z != map.info.origin.orientation.z || prevMap.info.origin.orientation.w != map.info.origin.orientation.w ||
+                prevMap.data.size() != map.data.size())
+                return false;
+
+            const int BLOCK_SIZE = 32;
+            int width = (int)map.info.width, height = (int)map.info.height;
+            int margin = getSDFInfluenceRadius(map.info.resolution);
+            int blocksNumU = (width + BLOCK_SIZE - 1) / BLOCK_SIZE;
+            int blocksNumV = (height + BLOCK_SIZE - 1) / BLOCK_SIZE;
+            for (int bv = 0; bv < blocksNumV; ++bv)
+            {
+                for (int bu = 0; bu < blocksNumU; ++bu)
+                {
+                    int u0 = bu * BLOCK_SIZE, u1 = std::min(u0 + BLOCK_SIZE, width);
+                    int v0 = bv * BLOCK_SIZE, v1 = std::min(v0 + BLOCK_SIZE, height);
+                    bool isDirty = false;
+                    for (int v = v0; v < v1 && !isDirty; ++v)
+                        isDirty = memcmp(&prevMap.data[v * width + u0], &map.data[v * width + u0], u1 - u0) != 0;
+                    if (!isDirty)
+                        continue;
+                    CellRect rect = {std::max(u0 - margin, 1), std::max(v0 - margin, 1),
+                                     std::min(u1 + margin, width - 1), std::min(v1 + margin, height - 1)};
+                    rects.push_back(rect);
+                }
+            }
+
+            // merge until no two rectangles overlap
+            bool isMerged = true;
+            while (isMerged)
+            {
+                isMerged = false;
+                for (int i = 0; i < (int)rects.size() && !isMerged; ++i)
+                {
+                    for (int j = i + 1; j < (int)rects.size(); ++j)
+                    {
+                        CellRect &a = rects[i], &b = rects[j];
+                        if (a.u1 <= b.u0 || b.u1 <= a.u0 || a.v1 <= b.v0 || b.v1 <= a.v0)
+                            continue;
+                        a.u0 = std::min(a.u0, b.u0), a.v0 = std::min(a.v0, b.v0);
+                        a.u1 = std::max(a.u1, b.u1), a.v1 = std::max(a.v1, b.v1);
+                        rects.erase(rects.begin() + j);
+                        isMerged = true;
+                        break;
+                    }
+                }
+            }
+
+            long dirtyArea = 0;
+            for (int i = 0; i < (int)rects.size(); ++i)
+                dirtyArea += (long)(rects[i].u1 - rects[i].u0) * (rects[i].v1 - rects[i].v0);
+            return dirtyArea * 2 < (long)width * height;
+        }
+
+        /*
+         * Recomputes the matching rate lookup grid, the keypoints, and the features inside the
+         * dirty rectangles and keeps the others.
+         */
+        void updateSDFFeaturesInRects(const nav_msgs::msg::OccupancyGrid &map, std::vector<CellRect> &rects)
+        {
+            GridTransform mapTransform = getGridTransform(map);
+            std::vector<std::vector<Keypoint>> keypointGroups(1);
+            std::vector<SDFFeatureSet> featureGroups(1);
+            std::vector<int> keptIndices;
+            for (int i = 0; i < (int)globalMap_->sdfKeypoints.size(); ++i)
+            {
+                int u = globalMap_->sdfKeypoints[i].getU(), v = globalMap_->sdfKeypoints[i].getV();
+                bool isDirty = false;
+                for (int j = 0; j < (int)rects.size() && !isDirty; ++j)
+                    isDirty = rects[j].u0 <= u && u < rects[j].u1 && rects[j].v0 <= v && v < rects[j].v1;
+                if (!isDirty)
+                    keptIndices.push_back(i);
+            }
+            keypointGroups[0].resize(keptIndices.size());
+            featureGroups[0].resize((int)keptIndices.size());
+            int hist[SDFFeatureSet::HIST_SIZE];
+            for (int i = 0; i < (int)keptIndices.size(); ++i)
+            {
+                int j = keptIndices[i];
+                for (int k = 0; k < SDFFeatureSet::HIST_SIZE; ++k)
+                    hist[k] = globalMap_->sdfOrientationFeatures.getRelativeOrientationHist(j, k);
+                keypointGroups[0][i] = globalMap_->sdfKeypoints[j];
+                featureGroups[0].set(i, globalMap_->sdfOrientationFeatures.getDominantOrientation(j), globalMap_->sdfOrientationFeatures.getAverageSDF(j), hist);
+            }
+
+            for (int i = 0; i < (int)rects.size(); ++i)
+            {
+                keypointGroups.push_back(std::vector<Keypoint>());
+                featureGroups.push_back(SDFFeatureSet());
+                computeSDFFeaturesInRect(map, mapTransform, rects[i], true, keypointGroups.back(), featureGroups.back());
+                if (!useDistanceFieldMatchingRate_)
+                {
+                    // an edited cell changes the lookup of itself and its 4-neighbours
+                    CellRect r = rects[i];
+                    fillCellMatchingRateGrid(std::max(r.u0 - 1, 1), std::min(r.u1 + 1, mapWidth_ - 1),
+                                             std::max(r.v0 - 1, 1), std::min(r.v1 + 1, mapHeight_ - 1));
+                }
+            }
+            mergeKeypointsInCellOrder(keypointGroups, featureGroups, globalMap_->sdfKeypoints, globalMap_->sdfOrientationFeatures);
+        }
+
+        void setSDFFeatureCacheKey(const nav_msgs::msg::OccupancyGrid &map)
+        {
+            sdfFeatureCache_.resetKey();
+            sdfFeatureCache_.addToKey(map.info.width);
+            sdfFeatureCache_.addToKey(map.info.height);
+            sdfFeatureCache_.addToKey(map.info.resolution);
+            sdfFeatureCache_.addToKey(map.info.origin.position.x);
+            sdfFeatureCache_.addToKey(map.info.origin.position.y);
+            sdfFeatureCache_.addToKey(map.info.origin.orientation.x);
+            sdfFeatureCache_.addToKey(map.info.origin.orientation.y);
+            sdfFeatureCache_.addToKey(map.info.origin.orientation.z);
+            sdfFeatureCache_.addToKey(map.info.origin.orientation.w);
+            sdfFeatureCache_.addToKey(gradientSquareTH_);
+            sdfFeatureCache_.addToKey(keypointsMinDistFromMap_);
+            sdfFeatureCache_.addToKey(sdfFeatureWindowSize_);
+            // the OpenCL kernels may round the distance field differently, which can change the keypoints
+            sdfFeatureCache_.addToKey(useOpenCL_);
+            sdfFeatureCache_.addToKey(map.data.data(), map.data.size());
+            if (sdfTileSize_ > 0)
+                sdfFeatureCache_.addToKey(sdfMaxDistance_);
+        }
+
+        void buildIncrementalLocalMap(KeyScanRing &keyScans, nav_msgs::msg::OccupancyGrid &map)
+        {
+            double rangeMax = keyScans.getScan(0).range_max;
+            int newScansNum = keyScans.getPushedNum() - rollingLocalMapKeyScansCount_;
+            int size = (int)(rangeMax * 3.0 / mapResolution_);
+            if (!rollingLocalMap_.isInitialized() || rollingLocalMap_.getSize() != size ||
+                rollingLocalMap_.getResolution() != mapResolution_ || newScansNum > keyScans.getSize())
+            {
+                rollingLocalMap_.reset(size, mapResolution_);
+                newScansNum = keyScans.getSize();
+            }
+
+            double laserOffsetX, laserOffsetY;
+            baseLink2Laser_.rotate(baseLink2Laser_.getX(), baseLink2Laser_.getY(), &laserOffsetX, &laserOffsetY);
+            for (int i = newScansNum - 1; i >= 0; --i)
+            {
+                rollingLocalMap_.moveTo(keyScans.getPose(i).getX() - rangeMax * 1.5, keyScans.getPose(i).getY() - rangeMax * 1.5);
+                double sensorX = laserOffsetX + keyScans.getPose(i).getX();
+                double sensorY = laserOffsetY + keyScans.getPose(i).getY();
+                double sensorYaw = baseLink2Laser_.getYaw() + keyScans.getPose(i).getYaw();
+                const sensor_msgs::msg::LaserScan &scan = keyScans.getScan(i);
+                rollingLocalMap_.addScan(scan.ranges, scan.angle_min, scan.angle_increment, scan.range_min, scan.range_max,
+                                         keypointsMinDistFromMap_, sensorX, sensorY, sensorYaw, keyScans.isReversed());
+            }
+            while (rollingLocalMap_.getScansNum() > keyScans.getSize())
+                rollingLocalMap_.removeOldestScan();
+            rollingLocalMapKeyScansCount_ = keyScans.getPushedNum();
+
+            map.info.width = rollingLocalMap_.getSize();
+            map.info.height = rollingLocalMap_.getSize();
+            map.info.resolution = mapResolution_;
+            map.info.origin.position.x = rollingLocalMap_.getOriginX();
+            map.info.origin.position.y = rollingLocalMap_.getOriginY();
+            map.info.origin.orientation.w = 1.0;
+            rollingLocalMap_.getData(map.data);
+        }
+
+        nav_msgs::msg::OccupancyGrid buildLocalMap(KeyScanRing &keyScans)
+        {
+            nav_msgs::msg::OccupancyGrid map;
+            buildLocalMap(keyScans, map);
+            return map;
+        }
+
+        /*
+         * Same as above into map. The cells are assigned in place, so a map that is reused for
+         * every key scan update keeps its cell buffer.
+         */
+        void buildLocalMap(KeyScanRing &keyScans, nav_msgs::msg::OccupancyGrid &map)
+        {
+            if (useIncrementalLocalMap_)
+            {
+                buildIncrementalLocalMap(keyScans, map);
+                return;
+            }
+
+            double rangeMax = keyScans.getScan(0).range_max;
+            map.info.width = (int)(rangeMax * 3.0 / mapResolution_);
+            map.info.height = (int)(rangeMax * 3.0 / mapResolution_);
+            map.info.resolution = mapResolution_;
+            map.info.origin.position.x = keyScans.getPose(0).getX() - rangeMax * 1.5;
+            map.info.origin.position.y = keyScans.getPose(0).getY() - rangeMax * 1.5;
+            map.info.origin.orientation.w = 1.0;
+            map.data.assign(map.info.width * map.info.height, -1);
+
+            int width = (int)map.info.width, height = (int)map.info.height;
+            double originX = map.info.origin.position.x, originY = map.info.origin.position.y;
+            double invResolution = 1.0 / map.info.resolution;
+            double laserOffsetX, laserOffsetY;
+            baseLink2Laser_.rotate(baseLink2Laser_.getX(), baseLink2Laser_.getY(), &laserOffsetX, &laserOffsetY);
+            for (int i = 0; i < keyScans.getSize(); ++i)
+            {
+                Transform2D sensorPose(laserOffsetX + keyScans.getPose(i).getX(), laserOffsetY + keyScans.getPose(i).getY(),
+                                       baseLink2Laser_.getYaw() + keyScans.getPose(i).getYaw());
+                int u0 = RayCaster::toCell(sensorPose.getX(), originX, invResolution);
+                int v0 = RayCaster::toCell(sensorPose.getY(), originY, invResolution);
+                const sensor_msgs::msg::LaserScan &scan = keyScans.getScan(i);
+                int beamsNum = (int)scan.ranges.size();
+                bool isReversed = keyScans.isReversed();
+                beamTable_.update(scan.angle_min, scan.angle_increment, beamsNum);
+                beamEndXs_.resize(beamsNum);
+                beamEndYs_.resize(beamsNum);
+                int endsNum = 0;
+                for (int j = 0; j < beamsNum; ++j)
+                {
+                    double range = scan.ranges[isReversed ? beamsNum - 1 - j : j];
+                    if (range < scan.range_min || scan.range_max < range)
+                        continue;
+                    if (range < keypointsMinDistFromMap_)
+                        continue;
+                    beamEndXs_[endsNum] = range * beamTable_.getCos(j);
+                    beamEndYs_[endsNum] = range * beamTable_.getSin(j);
+                    endsNum++;
+                }
+                sensorPose.transformPoints(endsNum, beamEndXs_.data(), beamEndYs_.data(), beamEndXs_.data(), beamEndYs_.data());
+                for (int j = 0; j < endsNum; ++j)
+                {
+                    int u1 = RayCaster::toCell(beamEndXs_[j], originX, invResolution);
+                    int v1 = RayCaster::toCell(beamEndYs_[j], originY, invResolution);
+                    RayCaster::castRay(map.data.data(), width, height, u0, v0, u1, v1);
+                }
+            }
+        }
+
+        std::vector<int> findCorrespondingFeatures(std::vector<Keypoint> &localSDFKeypoints, SDFFeatureSet &localFeatures)
+        {
+            std::vector<int> correspondingIndices;
+            findCorrespondingFeatures(localSDFKeypoints, localFeatures, correspondingIndices);
+            return correspondingIndices;
+        }
+
+        void findCorrespondingFeatures(std::vector<Keypoint> &localSDFKeypoints, SDFFeatureSet &localFeatures, std::vector<int> &correspondingIndices)
+        {
+            correspondingIndices.resize(localSDFKeypoints.size());
+            for (int i = 0; i < (int)localSDFKeypoints.size(); ++i)
+            {
+                char localKeypointType = localSDFKeypoints[i].getType();
+                double localAverageSDF = localFeatures.getAverageSDF(i);
+                const uint16_t *localRelOrientHist = localFeatures.getRelativeOrientationHist(i);
+                correspondingIndices[i] = globalMap_->sdfFeatureIndex.findCorrespondingFeature(localKeypointType, localAverageSDF, localRelOrientHist, averageSDFDeltaTH_);
+            }
+        }
+
+        void setMatchingRateScan(const sensor_msgs::msg::LaserScan &scan, bool isReversed)
+        {
+            matchingRateEvaluator_.setScan(scan.ranges, scan.angle_min, scan.angle_increment, scan.range_min, scan.range_max,
+                                           keypointsMinDistFromMap_, baseLink2Laser_, isReversed);
+        }
+
+        double computeMatchingRate(Pose pose)
+        {
+            return matchingRateEvaluator_.computeMatchingRate(pose.getX(), pose.getY(), pose.getYaw());
+        }
+
+        /*
+         * Computes the sensor pose in the map frame that aligns a local keypoint with a global
+         * keypoint, given the odometry pose that the local map was built around.
+         */
+        inline void computeCorrespondingPose(Pose &currentOdomPose, Keypoint &localKeypoint, double localDomOrient,
+                                             Keypoint &targetKeypoint, double targetDomOrient, double *sensorX, double *sensorY, double *sensorYaw)
+        {
+            double dx = localKeypoint.getX() - currentOdomPose.getX();
+            double dy = localKeypoint.getY() - currentOdomPose.getY();
+            double dOrient = currentOdomPose.getYaw() - localDomOrient;
+            double dDomOrient = localDomOrient - targetDomOrient;
+            double c = cos(dDomOrient);
+            double s = sin(dDomOrient);
+            *sensorX = dx * c - dy * s + targetKeypoint.getX();
+            *sensorY = dx * s + dy * c + targetKeypoint.getY();
+            *sensorYaw = targetDomOrient + dOrient;
+        }
+
+        // the gradient of a distance field grows with the cell size, so the threshold is scaled to the coarse cells
+        inline double getCoarseGradientSquareTH(void)
+        {
+            return gradientSquareTH_ * (double)(coarseMatchingScale_ * coarseMatchingScale_);
+        }
+
+        /*
+         * Downsamples an occupancy grid by an integer factor. A cell is occupied if any of its
+         * source cells is occupied, free if any of them is free, and unknown otherwise.
+         */
+        nav_msgs::msg::OccupancyGrid downsampleMap(const nav_msgs::msg::OccupancyGrid &map, int scale)
+        {
+            nav_msgs::msg::OccupancyGrid coarseMap;
+            downsampleMap(map, scale, coarseMap);
+            return coarseMap;
+        }
+
+        void downsampleMap(const nav_msgs::msg::OccupancyGrid &map, int scale, nav_msgs::msg::OccupancyGrid &coarseMap)
+        {
+            coarseMap.header = map.header;
+            coarseMap.info = map.info;
+            int width = (int)map.info.width, height = (int)map.info.height;
+            int coarseWidth = (width + scale - 1) / scale, coarseHeight = (height + scale - 1) / scale;
+            coarseMap.info.width = coarseWidth;
+            coarseMap.info.height = coarseHeight;
+            coarseMap.info.resolution = map.info.resolution * (float)scale;
+            coarseMap.data.assign(coarseWidth * coarseHeight, -1);
+            for (int v = 0; v < height; ++v)
+            {
+                const signed char *row = &map.data[v * width];
+                signed char *coarseRow = &coarseMap.data[(v / scale) * coarseWidth];
+                for (int u = 0; u < width; ++u)
+                {
+                    signed char &c = coarseRow[u / scale];
+                    if (row[u] == 100)
+                        c = 100;
+                    else if (row[u] == 0 && c != 100)
+                        c = 0;
+                }
+            }
+        }
+
+        /*
+         * Selects the global keypoints that the full-resolution matching is run against. The
+         * coarse local keypoints are matched against the coarse global keypoints first, and every
+         * coarse correspondence votes for the region containing the sensor position it implies.
+         * The most voted regions are expanded by the extent of the local keypoints, since a
+         * global keypoint can only imply a position within that distance, and the result is
+         * restricted to the prior pose radius if a prior pose was received.
+         */
+        void selectCandidateKeypoints(const nav_msgs::msg::OccupancyGrid &localMap, std::vector<Keypoint> &localSDFKeypoints, Pose &currentOdomPose,
+                                      std::vector<int> &candidateIndices)
+        {
+            candidateIndices.clear();
+            if (sdfMatchingRegions_.getRegionsNum() == 0)
+                return;
+
+            double maxOffset = 0.0;
+            for (int i = 0; i < (int)localSDFKeypoints.size(); ++i)
+                maxOffset = std::max(maxOffset, hypot(localSDFKeypoints[i].getX() - currentOdomPose.getX(),
+                                                      localSDFKeypoints[i].getY() - currentOdomPose.getY()));
+
+            if (useCoarseToFineMatching_)
+            {
+                StageScratch &scratch = coarseScanScratch_;
+                nav_msgs::msg::OccupancyGrid &coarseLocalMap = coarseLocalMap_;
+                cv::Mat &coarseLocalDistMap = scratch.distMap;
+                std::vector<Keypoint> &coarseLocalKeypoints = scratch.keypoints;
+                SDFFeatureSet &coarseLocalFeatures = scratch.features;
+                downsampleMap(localMap, coarseMatchingScale_, coarseLocalMap);
+                buildDistanceFieldMap(coarseLocalMap, scratch, coarseLocalDistMap);
+                cv::GaussianBlur(coarseLocalDistMap, coarseLocalDistMap, cv::Size(5, 5), 5);
+                detectKeypoints(coarseLocalMap, coarseLocalDistMap, getCoarseGradientSquareTH(), scratch, coarseLocalKeypoints);
+                calculateFeatures(coarseLocalDistMap, coarseLocalMap.info.resolution, coarseLocalKeypoints, scratch, coarseLocalFeatures);
+
+                sdfMatchingRegions_.clearVotes();
+                for (int i = 0; i < (int)coarseLocalKeypoints.size(); ++i)
+                {
+                    int idx = globalMap_->coarseSDFFeatureIndex.findCorrespondingFeature(coarseLocalKeypoints[i].getType(), coarseLocalFeatures.getAverageSDF(i),
+                                                                            coarseLocalFeatures.getRelativeOrientationHist(i), averageSDFDeltaTH_);
+                    if (idx < 0)
+                        continue;
+                    double sensorX, sensorY, sensorYaw;
+                    computeCorrespondingPose(currentOdomPose, coarseLocalKeypoints[i], coarseLocalFeatures.getDominantOrientation(i),
+                                             globalMap_->coarseSDFKeypoints[idx], globalMap_->coarseSDFOrientationFeatures.getDominantOrientation(idx),
+                                             &sensorX, &sensorY, &sensorYaw);
+                    sdfMatchingRegions_.vote(sensorX, sensorY);
+                }
+
+                sdfMatchingRegions_.selectNone();
+                double radius = maxOffset + sdfMatchingRegions_.getRegionSize() * M_SQRT1_2;
+                std::vector<int> regionIDs = sdfMatchingRegions_.getMostVotedRegions(coarseCandidateRegionsNum_);
+                for (int i = 0; i < (int)regionIDs.size(); ++i)
+                {
+                    double x, y;
+                    sdfMatchingRegions_.getRegionCenter(regionIDs[i], &x, &y);
+                    sdfMatchingRegions_.selectCircle(x, y, radius);
+                }
+            }
+            else
+            {
+                sdfMatchingRegions_.selectAll();
+            }
+
+            if (usePriorPose_)
+            {
+                double laserOffset = hypot(baseLink2Laser_.getX(), baseLink2Laser_.getY());
+                sdfMatchingRegions_.restrictToCircle(activePriorPose_.getX(), activePriorPose_.getY(), priorPoseRadius_ + maxOffset + laserOffset);
+            }
+
+            sdfMatchingRegions_.getSelectedKeypointIndices(candidateIndices);
+        }
+
+        /*
+         * Same as findCorrespondingFeatures, but scans only the given global keypoints in
+         * ascending index order.
+         */
+        void findCorrespondingFeaturesInSubset(std::vector<Keypoint> &localSDFKeypoints, SDFFeatureSet &localFeatures,
+                                               std::vector<int> &candidateIndices, std::vector<int> &correspondingIndices)
+        {
+            correspondingIndices.resize(localSDFKeypoints.size());
+            for (int i = 0; i < (int)localSDFKeypoints.size(); ++i)
+            {
+                char localKeypointType = localSDFKeypoints[i].getType();
+                double localAverageSDF = localFeatures.getAverageSDF(i);
+                const uint16_t *localRelOrientHist = localFeatures.getRelativeOrientationHist(i);
+                correspondingIndices[i] = globalMap_->sdfFeatureIndex.findCorrespondingFeatureInSubset(localKeypointType, localAverageSDF, localRelOrientHist,
+                                                                                                       averageSDFDeltaTH_, candidateIndices);
+            }
+        }
+
+        /*
+         * Keeps maxNum of the correspondences, evenly spread over the local keypoints, and marks
+         * the others as none. Returns the number of kept correspondences.
+         */
+        int limitCorrespondences(std::vector<int> &correspondingIndices, int maxNum)
+        {
+            int num = (int)(correspondingIndices.size() - std::count(correspondingIndices.begin(), correspondingIndices.end(), -1));
+            if (maxNum < 0 || num <= maxNum)
+                return num;
+            // the k-th correspondence is kept if it starts a new one of maxNum equal parts
+            long k = 0;
+            for (int i = 0; i < (int)correspondingIndices.size(); ++i)
+            {
+                if (correspondingIndices[i] < 0)
+                    continue;
+                if ((k * maxNum) / num == ((k + 1) * maxNum) / num)
+                    correspondingIndices[i] = -1;
+                k++;
+            }
+            return maxNum;
+        }
+
+        /*
+         * Appends the candidate poses of correspondence i to buf. The noise of the random samples
+         * is drawn from the stream i of seed, so the poses do not depend on which thread
+         * processes the correspondence.
+         */
+        void appendCorrespondingPoses(int i, Pose &currentOdomPose, std::vector<Keypoint> &localSDFKeypoints,
+                                      SDFFeatureSet &localSDFOrientationFeatures, int idx, uint64_t seed, PoseGenerationBuffer &buf)
+        {
+            double sensorX, sensorY, sensorYaw;
+            computeCorrespondingPose(currentOdomPose, localSDFKeypoints[i], localSDFOrientationFeatures.getDominantOrientation(i),
+                                     globalMap_->sdfKeypoints[idx], globalMap_->sdfOrientationFeatures.getDominantOrientation(idx), &sensorX, &sensorY, &sensorYaw);
+
+            int u, v;
+            xy2uv(sensorX, sensorY, &u, &v);
+            if (u < 0 || mapWidth_ <= u || v < 0 || mapHeight_ <= v)
+                return;
+            int n = v * mapWidth_ + u;
+            if (mapData_[n] != 0)
+                return;
+
+            double laserOffsetX, laserOffsetY;
+            baseLink2Laser_.rotate(baseLink2Laser_.getX(), baseLink2Laser_.getY(), &laserOffsetX, &laserOffsetY);
+            double baseX = sensorX - laserOffsetX;
+            double baseY = sensorY - laserOffsetY;
+            double baseYaw = sensorYaw - baseLink2Laser_.getYaw();
+            if (usePriorPose_ && hypot(baseX - activePriorPose_.getX(), baseY - activePriorPose_.getY()) > priorPoseRadius_)
+                return;
+
+            if (!addRandomSamples_)
+            {
+                buf.candidatesNum++;
+                if (matchingRateTH_ > 0.0)
+                {
+                    if (computeMatchingRate(Pose(baseX, baseY, baseYaw)) < matchingRateTH_)
+                    {
+                        buf.rejectedCandidatesNum++;
+                        return;
+                    }
+                }
+                geometry_msgs::msg::Pose pose;
+                pose.position.x = baseX;
+                pose.position.y = baseY;
+                tf2::Quaternion q;
+                q.setRPY(0, 0, baseYaw);
+                pose.orientation = tf2::toMsg(q);
+                buf.poses.push_back(pose);
+                return;
+            }
+
+            double *sampleXs = buf.sampleXs.data(), *sampleYs = buf.sampleYs.data(), *sampleYaws = buf.sampleYaws.data();
+            GaussianSampler sampler(seed, (uint64_t)i);
+            sampler.fillPoseNoise(randomSamplesNum_, positionalRandomNoise_, angularRandomNoise_, sampleXs, sampleYs, sampleYaws);
+            for (int j = 0; j < randomSamplesNum_; ++j)
+            {
+                sampleXs[j] += baseX;
+                sampleYs[j] += baseY;
+                if (addOppositeSamples_ && j % 2 == 1)
+                    sampleYaws[j] += baseYaw + M_PI;
+                else
+                    sampleYaws[j] += baseYaw;
+            }
+            if (matchingRateTH_ > 0.0)
+                matchingRateEvaluator_.computeMatchingRates(randomSamplesNum_, sampleXs, sampleYs, sampleYaws, matchingRateTH_,
+                                                            buf.sampleRates.data());
+            buf.candidatesNum += randomSamplesNum_;
+            for (int j = 0; j < randomSamplesNum_; ++j)
+            {
+                if (matchingRateTH_ > 0.0 && buf.sampleRates[j] < matchingRateTH_)
+                {
+                    buf.rejectedCandidatesNum++;
+                    continue;
+                }
+                geometry_msgs::msg::Pose pose;
+                pose.position.x = sampleXs[j];
+                pose.position.y = sampleYs[j];
+                tf2::Quaternion q;
+                q.setRPY(0, 0, sampleYaws[j]);
+                pose.orientation = tf2::toMsg(q);
+                buf.poses.push_back(pose);
+            }
+        }
+
+        /**
+         * @brief Generates the candidate poses of the corresponding keypoints.
+         *
+         * With pose_generation_threads_num > 1, chunks of correspondences are processed in
+         * parallel into their own buffers, which are concatenated in correspondence order, so
+         * the output is the same as with serial execution.
+         *
+         * @param currentOdomPose The odometry pose of the local map.
+         * @param localSDFKeypoints The local keypoints.
+         * @param localSDFOrientationFeatures The features of the local keypoints.
+         * @param correspondingIndices The index of the global keypoint of every local keypoint (-1: none).
+         * @param poses The candidate poses. The previous poses are replaced, and the capacity of the array is kept.
+         */
+        void generatePoses(Pose currentOdomPose, std::vector<Keypoint> &localSDFKeypoints, SDFFeatureSet &localSDFOrientationFeatures,
+                           const std::vector<int> &correspondingIndices, geometry_msgs::msg::PoseArray &poses)
+        {
+            int num = (int)correspondingIndices.size();
+            int chunksNum = poseGenerationThreadsNum_ <= 1 ? 1 : std::max(1, std::min(num, poseGenerationThreadsNum_ * 8));
+            if ((int)poseGenerationBuffers_.size() < chunksNum)
+                poseGenerationBuffers_.resize(chunksNum);
+            for (int c = 0; c < chunksNum; ++c)
+            {
+                PoseGenerationBuffer &buf = poseGenerationBuffers_[c];
+                buf.poses.clear();
+                buf.sampleXs.resize(randomSamplesNum_);
+                buf.sampleYs.resize(randomSamplesNum_);
+                buf.sampleYaws.resize(randomSamplesNum_);
+                buf.sampleRates.resize(randomSamplesNum_);
+                buf.candidatesNum = buf.rejectedCandidatesNum = 0;
+            }
+
+            uint64_t seed = gaussianSampler_.next();
+            runParallelChunks(num, chunksNum, poseGenerationThreadsNum_, [&](int begin, int end, int chunk)
+                              {
+                                  PoseGenerationBuffer &buf = poseGenerationBuffers_[chunk];
+                                  for (int i = begin; i < end; ++i)
+                                  {
+                                      if (correspondingIndices[i] >= 0)
+                                          appendCorrespondingPoses(i, currentOdomPose, localSDFKeypoints, localSDFOrientationFeatures,
+                                                                   correspondingIndices[i], seed, buf);
+                                  } });
+
+            poses.poses.clear();
+            size_t posesNum = 0;
+            int candidatesNum = 0, rejectedCandidatesNum = 0;
+            for (int c = 0; c < chunksNum; ++c)
+                posesNum += poseGenerationBuffers_[c].poses.size();
+            poses.poses.reserve(posesNum);
+            for (int c = 0; c < chunksNum; ++c)
+            {
+                PoseGenerationBuffer &buf = poseGenerationBuffers_[c];
+                poses.poses.insert(poses.poses.end(), buf.poses.begin(), buf.poses.end());
+                candidatesNum += buf.candidatesNum;
+                rejectedCandidatesNum += buf.rejectedCandidatesNum;
+            }
+            ALS_ROS2_PROFILE_COUNT(profiler_, PROFILE_SCAN_CANDIDATES, candidatesNum);
+            ALS_ROS2_PROFILE_COUNT(profiler_, PROFILE_SCAN_REJECTED_CANDIDATES, rejectedCandidatesNum);
+        }
+
+        geometry_msgs::msg::PoseArray generatePoses(Pose currentOdomPose, std::vector<Keypoint> &localSDFKeypoints,
+                                                    SDFFeatureSet &localSDFOrientationFeatures, const std::vector<int> &correspondingIndices)
+        {
+            geometry_msgs::msg::PoseArray poses;
+            generatePoses(currentOdomPose, localSDFKeypoints, localSDFOrientationFeatures, correspondingIndices, poses);
+            return poses;
+        }
+
+        /**
+         * @brief Sets the global map and builds its matching rate grid, SDF keypoints, and features.
+         *
+         * With use_incremental_map_update, a map of the same geometry as the current one is
+         * only recomputed around the changed cells. Such an update is not written to the
+         * feature cache.
+         *
+         * @param msg The global map. It is kept, so its cells must not change afterwards.
+         * @return What the update did.
+         */
+        MapUpdateInfo updateMap(const nav_msgs::msg::OccupancyGrid::ConstSharedPtr &msg)
+        {
+            MapUpdateInfo info = {false, -1, false, false, false};
+            ALS_ROS2_PROFILE_START(clock);
+            bool isShared = !sharedMapName_.empty();
+            std::vector<CellRect> dirtyRects;
+            // a shared entry must not be modified, so a shared map is always attached or built anew
+            bool isIncremental = useIncrementalMapUpdate_ && !isShared && gotMap_ && findDirtyRects(*globalMap_->map, *msg, dirtyRects);
+            setMapInfo(*msg);
+            if (isIncremental)
+            {
+                globalMap_->map = msg;
+                mapData_ = msg->data.data();
+                info.changedRegionsNum = (int)dirtyRects.size();
+                if (dirtyRects.empty())
+                {
+                    info.isUnchanged = true;
+                    return info;
+                }
+                updateSDFFeaturesInRects(*msg, dirtyRects);
+                ALS_ROS2_PROFILE_LAP(clock, profiler_, PROFILE_MAP_KEYPOINTS_MS);
+                // the patched keypoints come from the clamped field inside the rects and from the previous build
+                // elsewhere, so they are not saved under the key of a full build
+                buildSDFMatchingStructures(*msg);
+                buildMatchingRegions();
+                ALS_ROS2_PROFILE_LAP(clock, profiler_, PROFILE_MAP_MATCHING_STRUCTURES_MS);
+                ALS_ROS2_PROFILE_TOTAL(clock, profiler_, PROFILE_MAP_TOTAL_MS);
+                return info;
+            }
+
+            if (isShared)
+            {
+                // the key extends the cache key, which the build also uses to load and save the cache file
+                setSDFFeatureCacheKey(*msg);
+                bool isBuilt = false;
+                globalMap_ = GlobalMapStore::getInstance().acquire(sharedMapName_, getSharedMapKey(), [this, &msg, &info](void)
+                                                                   { return buildGlobalMap(msg, info); },
+                                                                   &isBuilt);
+                info.isSharedMapAttached = !isBuilt;
+            }
+            else
+            {
+                if (sdfFeatureCache_.isEnabled())
+                    setSDFFeatureCacheKey(*msg);
+                buildGlobalMap(msg, info);
+            }
+            mapData_ = globalMap_->map->data.data();
+            matchingRateEvaluator_.setMap(globalMap_->matchingRateGrid.data(), mapWidth_, mapHeight_, globalMap_->matchingRateGridScale, mapTransform_);
+            buildMatchingRegions();
+            ALS_ROS2_PROFILE_TOTAL(clock, profiler_, PROFILE_MAP_TOTAL_MS);
+            gotMap_ = true;
+            return info;
+        }
+
+        /*
+         * Builds the global map data of a map into a new GlobalMapData, which becomes the current
+         * one. The key of the feature cache must be set for the map if the cache is enabled.
+         */
+        std::shared_ptr<GlobalMapData> buildGlobalMap(const nav_msgs::msg::OccupancyGrid::ConstSharedPtr &msg, MapUpdateInfo &info)
+        {
+            ALS_ROS2_PROFILE_START(clock);
+            globalMap_ = std::make_shared<GlobalMapData>();
+            globalMap_->map = msg;
+            mapData_ = msg->data.data();
+            if (sdfFeatureCache_.isEnabled())
+                info.isCacheLoaded = sdfFeatureCache_.load(globalMap_->sdfKeypoints, globalMap_->sdfOrientationFeatures);
+            ALS_ROS2_PROFILE_LAP(clock, profiler_, PROFILE_MAP_CACHE_LOAD_MS);
+            bool isTiled = sdfTileSize_ > 0;
+            cv::Mat distMap;
+            StageScratch scratch; // not kept, so that the buffers of the global map are released after the update
+            if (!isTiled && (!info.isCacheLoaded || useDistanceFieldMatchingRate_))
+            {
+                if (useOpenCL_)
+                {
+                    scratch.openCLPipeline.buildDistanceField(msg->data.data(), mapWidth_, mapHeight_, mapResolution_);
+                    scratch.openCLPipeline.download(distMap);
+                }
+                else
+                {
+                    buildDistanceFieldMap(*msg, scratch, distMap);
+                }
+            }
+            buildMatchingRateGrid(distMap);
+            if (isTiled && (!info.isCacheLoaded || useDistanceFieldMatchingRate_))
+                buildTiledSDFFeatures(*msg, !info.isCacheLoaded, globalMap_->sdfKeypoints, globalMap_->sdfOrientationFeatures);
+            // in the tiled mode, the keypoints are detected together with the distance field
+            ALS_ROS2_PROFILE_LAP(clock, profiler_, PROFILE_MAP_MATCHING_GRID_MS);
+            if (!isTiled && !info.isCacheLoaded)
+            {
+                if (useOpenCL_)
+                {
+                    scratch.openCLPipeline.blur();
+                    detectKeypointsOpenCL(*msg, gradientSquareTH_, scratch, distMap, globalMap_->sdfKeypoints);
+                }
+                else
+                {
+                    cv::GaussianBlur(distMap, distMap, cv::Size(5, 5), 5);
+                    detectKeypoints(*msg, distMap, gradientSquareTH_, scratch, globalMap_->sdfKeypoints);
+                }
+                calculateFeatures(distMap, mapResolution_, globalMap_->sdfKeypoints, scratch, globalMap_->sdfOrientationFeatures);
+            }
+            if (!info.isCacheLoaded && sdfFeatureCache_.isEnabled())
+                info.isCacheSaveFailed = !sdfFeatureCache_.save(globalMap_->sdfKeypoints, globalMap_->sdfOrientationFeatures);
+            ALS_ROS2_PROFILE_LAP(clock, profiler_, PROFILE_MAP_KEYPOINTS_MS);
+            buildSDFMatchingStructures(*msg);
+            ALS_ROS2_PROFILE_LAP(clock, profiler_, PROFILE_MAP_MATCHING_STRUCTURES_MS);
+            return globalMap_;
+        }
+
+        /**
+         * @brief Runs the processing stages from the local map to the pose candidates.
+         * @param keyScans The key scans; index 0 is the newest.
+         * @param prevOdomPose The odometry pose of the newest key scan.
+         * @param gotPriorPose If true and prior_pose_radius is positive, the candidates are restricted to the radius around priorPose.
+         * @param priorPose The prior pose.
+         * @param localMap The local map that is built from the key scans.
+         * @param localSDFKeypoints The keypoints of the local map.
+         * @param poses The pose candidates in the map frame.
+         * @return The cost and the correspondences of the update.
+         *
+         * The outputs and the intermediate buffers of the stages are overwritten in place, so a
+         * caller that passes the same outputs for every update allocates nothing once their
+         * capacity has grown to the largest update.
+         */
+        PoseEstimationInfo estimatePoses(KeyScanRing &keyScans, Pose prevOdomPose, bool gotPriorPose, Pose priorPose,
+                                         nav_msgs::msg::OccupancyGrid &localMap, std::vector<Keypoint> &localSDFKeypoints,
+                                         geometry_msgs::msg::PoseArray &poses)
+        {
+            PoseEstimationInfo info;
+            std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+            ALS_ROS2_PROFILE_START(clock);
+            StageScratch &scratch = scanScratch_;
+            buildLocalMap(keyScans, localMap);
+            ALS_ROS2_PROFILE_LAP(clock, profiler_, PROFILE_SCAN_BUILD_LOCAL_MAP_MS);
+            cv::Mat &localDistMap = scratch.distMap;
+            if (useOpenCL_)
+                scratch.openCLPipeline.buildDistanceField(localMap.data.data(), (int)localMap.info.width, (int)localMap.info.height,
+                                                          localMap.info.resolution);
+            else
+                buildDistanceFieldMap(localMap, scratch, localDistMap);
+            ALS_ROS2_PROFILE_LAP(clock, profiler_, PROFILE_SCAN_DISTANCE_FIELD_MS);
+            if (useOpenCL_)
+                scratch.openCLPipeline.blur();
+            else
+                cv::GaussianBlur(localDistMap, localDistMap, cv::Size(5, 5), 5);
+            ALS_ROS2_PROFILE_LAP(clock, profiler_, PROFILE_SCAN_GAUSSIAN_BLUR_MS);
+            if (useOpenCL_)
+                detectKeypointsOpenCL(localMap, gradientSquareTH_, scratch, localDistMap, localSDFKeypoints);
+            else
+                detectKeypoints(localMap, localDistMap, gradientSquareTH_, scratch, localSDFKeypoints);
+            ALS_ROS2_PROFILE_LAP(clock, profiler_, PROFILE_SCAN_DETECT_KEYPOINTS_MS);
+            SDFFeatureSet &localSDFOrientationFeatures = scratch.features;
+            calculateFeatures(localDistMap, mapResolution_, localSDFKeypoints, scratch, localSDFOrientationFeatures);
+            ALS_ROS2_PROFILE_LAP(clock, profiler_, PROFILE_SCAN_CALCULATE_FEATURES_MS);
+            ALS_ROS2_PROFILE_COUNT(profiler_, PROFILE_SCAN_LOCAL_KEYPOINTS, localSDFKeypoints.size());
+            usePriorPose_ = priorPoseRadius_ > 0.0 && gotPriorPose;
+            activePriorPose_ = priorPose;
+            std::vector<int> &correspondingIndices = scratch.correspondingIndices;
+            if (useCoarseToFineMatching_ || usePriorPose_)
+            {
+                selectCandidateKeypoints(localMap, localSDFKeypoints, prevOdomPose, scratch.candidateIndices);
+                findCorrespondingFeaturesInSubset(localSDFKeypoints, localSDFOrientationFeatures, scratch.candidateIndices, correspondingIndices);
+            }
+            else
+            {
+                findCorrespondingFeatures(localSDFKeypoints, localSDFOrientationFeatures, correspondingIndices);
+            }
+            ALS_ROS2_PROFILE_LAP(clock, profiler_, PROFILE_SCAN_FIND_CORRESPONDENCES_MS);
+            info.correspondencesNum = (int)(correspondingIndices.size() - std::count(correspondingIndices.begin(), correspondingIndices.end(), -1));
+            ALS_ROS2_PROFILE_COUNT(profiler_, PROFILE_SCAN_CORRESPONDENCES, info.correspondencesNum);
+            info.usedCorrespondencesNum = limitCorrespondences(correspondingIndices, maxCorrespondencesNum_);
+            setMatchingRateScan(keyScans.getScan(keyScans.getSize() - 1), keyScans.isReversed());
+            std::chrono::steady_clock::time_point matchedTime = std::chrono::steady_clock::now();
+            generatePoses(prevOdomPose, localSDFKeypoints, localSDFOrientationFeatures, correspondingIndices, poses);
+            ALS_ROS2_PROFILE_LAP(clock, profiler_, PROFILE_SCAN_GENERATE_POSES_MS);
+            info.matchingTime = std::chrono::duration<double, std::milli>(matchedTime - startTime).count();
+            info.poseGenerationTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - matchedTime).count();
+            return info;
+        }
+
+        /*
+         * Builds the global map data that is derived from the global SDF keypoints: the feature
+         * index and the coarse keypoints.
+         */
+        void buildSDFMatchingStructures(const nav_msgs::msg::OccupancyGrid &map)
+        {
+            globalMap_->sdfFeatureIndex.build(globalMap_->sdfKeypoints, globalMap_->sdfOrientationFeatures);
+            if (useCoarseToFineMatching_)
+            {
+                nav_msgs::msg::OccupancyGrid coarseMap = downsampleMap(map, coarseMatchingScale_);
+                cv::Mat coarseDistMap = buildDistanceFieldMap(coarseMap);
+                cv::GaussianBlur(coarseDistMap, coarseDistMap, cv::Size(5, 5), 5);
+                globalMap_->coarseSDFKeypoints = detectKeypoints(coarseMap, coarseDistMap, getCoarseGradientSquareTH());
+                globalMap_->coarseSDFOrientationFeatures = calculateFeatures(coarseDistMap, coarseMap.info.resolution, globalMap_->coarseSDFKeypoints);
+                globalMap_->coarseSDFFeatureIndex.build(globalMap_->coarseSDFKeypoints, globalMap_->coarseSDFOrientationFeatures);
+            }
+        }
+
+        /*
+         * Builds the matching regions of the global SDF keypoints. They hold the votes of an
+         * update, so every instance has its own even if the keypoints are shared.
+         */
+        void buildMatchingRegions(void)
+        {
+            if (useCoarseToFineMatching_ || priorPoseRadius_ > 0.0)
+                sdfMatchingRegions_.build(globalMap_->sdfKeypoints, matchingRegionSize_);
+        }
+
+        /*
+         * Extends the cache key, which setSDFFeatureCacheKey must have set for the map, by the
+         * parameters that only the shared global map data depends on.
+         */
+        uint64_t getSharedMapKey(void)
+        {
+            uint64_t key = sdfFeatureCache_.getKey();
+            key = GlobalMapStore::addToKey(key, useDistanceFieldMatchingRate_);
+            key = GlobalMapStore::addToKey(key, matchingDistanceFieldSigma_);
+            key = GlobalMapStore::addToKey(key, useCoarseToFineMatching_);
+            key = GlobalMapStore::addToKey(key, coarseMatchingScale_);
+            return key;
+        }
+    }; // class GLPoseSamplerCore
+
+} // namespace als_ros2
+
+#endif // __GL_POSE_SAMPLER_CORE_H__
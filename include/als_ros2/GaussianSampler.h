@@ -0,0 +1,166 @@
+/****************************************************************************
+ * als_ros: An Advanced Localization System for ROS use with 2D LiDAR
+ * Copyright (C) 2022 Naoki Akai
+ *
+ * Licensed under the Apache License, Version 2.0 (the “License”);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an “AS IS” BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @author Naoki Akai
+ * modified by: Roald Ong
+ ****************************************************************************/
+
+#ifndef __GAUSSIAN_SAMPLER_H__
+#define __GAUSSIAN_SAMPLER_H__
+
+#include <cmath>
+#include <cstdint>
+
+namespace als_ros2
+{
+
+    /**
+     * @brief Seedable normal random number generator.
+     *
+     * Uniform numbers are drawn from xoshiro256** and converted with the polar Box-Muller
+     * method, which produces two normal numbers per accepted pair without calling cos and sin.
+     * A sampler has no shared state, so every thread uses its own sampler; samplers with the
+     * same seed and different streams produce independent sequences.
+     */
+    class GaussianSampler
+    {
+    private:
+        uint64_t state_[4];
+        double spare_;
+        bool hasSpare_;
+
+        static inline uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+        static inline uint64_t splitMix64(uint64_t &x)
+        {
+            uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            return z ^ (z >> 31);
+        }
+
+    public:
+        GaussianSampler(void) { seed(0); }
+        GaussianSampler(uint64_t seedVal, uint64_t stream) { seed(seedVal, stream); }
+
+        /**
+         * @brief Resets the sequence.
+         * @param seedVal The seed.
+         * @param stream The stream of the seed.
+         */
+        void seed(uint64_t seedVal, uint64_t stream = 0)
+        {
+            uint64_t x = seedVal ^ splitMix64(stream);
+            for (int i = 0; i < 4; ++i)
+                state_[i] = splitMix64(x);
+            hasSpare_ = false;
+        }
+
+        inline uint64_t next(void)
+        {
+            uint64_t result = rotl(state_[1] * 5, 7) * 9;
+            uint64_t t = state_[1] << 17;
+            state_[2] ^= state_[0];
+            state_[3] ^= state_[1];
+            state_[1] ^= state_[2];
+            state_[0] ^= state_[3];
+            state_[2] ^= t;
+            state_[3] = rotl(state_[3], 45);
+            return result;
+        }
+
+        /**
+         * @brief Draws a uniform number in [0, 1).
+         * @return The number.
+         */
+        inline double uniform(void) { return (double)(next() >> 11) * (1.0 / 9007199254740992.0); }
+
+        /**
+         * @brief Draws two independent standard normal numbers.
+         * @param g0 The first number.
+         * @param g1 The second number.
+         */
+        inline void gaussianPair(double *g0, double *g1)
+        {
+            double u, v, s;
+            do
+            {
+                u = 2.0 * uniform() - 1.0;
+                v = 2.0 * uniform() - 1.0;
+                s = u * u + v * v;
+            } while (s >= 1.0 || s == 0.0);
+            double f = sqrt(-2.0 * log(s) / s);
+            *g0 = u * f;
+            *g1 = v * f;
+        }
+
+        /**
+         * @brief Draws a normal number.
+         * @param sigma The standard deviation.
+         * @return The number.
+         */
+        inline double gaussian(double sigma)
+        {
+            if (hasSpare_)
+            {
+                hasSpare_ = false;
+                return sigma * spare_;
+            }
+            double g;
+            gaussianPair(&g, &spare_);
+            hasSpare_ = true;
+            return sigma * g;
+        }
+
+        /**
+         * @brief Fills an array with normal numbers.
+         * @param num The number of elements.
+         * @param sigma The standard deviation.
+         * @param vals The numbers.
+         */
+        void fill(int num, double sigma, double *vals)
+        {
+            int i = 0;
+            for (; i + 1 < num; i += 2)
+            {
+                gaussianPair(&vals[i], &vals[i + 1]);
+                vals[i] *= sigma;
+                vals[i + 1] *= sigma;
+            }
+            if (i < num)
+                vals[i] = gaussian(sigma);
+        }
+
+        /**
+         * @brief Fills the position and yaw noise of a block of pose samples.
+         * @param num The number of samples.
+         * @param positionalSigma The standard deviation of the position noise [m].
+         * @param angularSigma The standard deviation of the yaw noise [rad].
+         * @param dxs The x noise of the samples.
+         * @param dys The y noise of the samples.
+         * @param dyaws The yaw noise of the samples.
+         */
+        void fillPoseNoise(int num, double positionalSigma, double angularSigma, double *dxs, double *dys, double *dyaws)
+        {
+            fill(num, positionalSigma, dxs);
+            fill(num, positionalSigma, dys);
+            fill(num, angularSigma, dyaws);
+        }
+    }; // class GaussianSampler
+
+} // namespace als_ros2
+
+#endif // __GAUSSIAN_SAMPLER_H__
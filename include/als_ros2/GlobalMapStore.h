@@ -0,0 +1,172 @@
+/****************************************************************************
+ * als_ros: An Advanced Localization System for ROS use with 2D LiDAR
+ * Copyright (C) 2022 Naoki Akai
+ *
+ * Licensed under the Apache License, Version 2.0 (the “License”);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an “AS IS” BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @author Naoki Akai
+ * modified by: Roald Ong
+ ****************************************************************************/
+
+#ifndef __GLOBAL_MAP_STORE_H__
+#define __GLOBAL_MAP_STORE_H__
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include <nav_msgs/msg/occupancy_grid.hpp>
+#include "als_ros2/Keypoint.h"
+#include "als_ros2/SDFFeatureSet.h"
+#include "als_ros2/SDFFeatureIndex.h"
+
+namespace als_ros2
+{
+
+    /**
+     * @brief Everything that GLPoseSamplerCore derives from a global map and its parameters.
+     *
+     * The occupancy grid, the matching rate lookup grid, and the SDF keypoints, features, and
+     * feature indices of the full and the coarse resolution do not depend on the robot, so one
+     * instance can serve every sampler that localizes on the same map with the same parameters.
+     * An instance that is shared through GlobalMapStore is not modified after it was built.
+     */
+    struct GlobalMapData
+    {
+        nav_msgs::msg::OccupancyGrid::ConstSharedPtr map;
+        std::vector<uint8_t> matchingRateGrid;
+        int matchingRateGridScale;
+        std::vector<Keypoint> sdfKeypoints;
+        SDFFeatureSet sdfOrientationFeatures;
+        SDFFeatureIndex sdfFeatureIndex;
+        std::vector<Keypoint> coarseSDFKeypoints;
+        SDFFeatureSet coarseSDFOrientationFeatures;
+        SDFFeatureIndex coarseSDFFeatureIndex;
+
+        GlobalMapData(void) : matchingRateGridScale(1) {}
+    }; // struct GlobalMapData
+
+    /**
+     * @brief Process-wide store of the global map data shared by several sampler instances.
+     *
+     * Entries are identified by a name and a key that hashes the map and the parameters the data
+     * depends on. The first instance that requests an entry builds it while the other instances
+     * that request the same entry wait, so the data of a map is built once and held once no
+     * matter how many composable nodes in the process use it. A site with several floors has
+     * one entry per floor map in use. The store only holds weak references, so an entry is
+     * released when the last instance that uses it switches to another map or is destroyed.
+     */
+    class GlobalMapStore
+    {
+    private:
+        struct Slot
+        {
+            std::mutex buildMutex;
+            std::weak_ptr<GlobalMapData> data;
+        };
+
+        std::mutex mutex_;
+        std::map<std::pair<std::string, uint64_t>, std::shared_ptr<Slot>> slots_;
+
+        GlobalMapStore(void) {}
+
+    public:
+        GlobalMapStore(const GlobalMapStore &) = delete;
+        GlobalMapStore &operator=(const GlobalMapStore &) = delete;
+
+        static GlobalMapStore &getInstance(void)
+        {
+            static GlobalMapStore store;
+            return store;
+        }
+
+        /**
+         * @brief Adds a value to a key with the FNV-1a step of SDFFeatureCache.
+         * @param key The key.
+         * @param val The value to add.
+         * @return The new key.
+         */
+        template <typename T>
+        static inline uint64_t addToKey(uint64_t key, const T &val)
+        {
+            const unsigned char *bytes = (const unsigned char *)&val;
+            for (size_t i = 0; i < sizeof(T); ++i)
+            {
+                key ^= (uint64_t)bytes[i];
+                key *= 1099511628211ULL;
+            }
+            return key;
+        }
+
+        /**
+         * @brief Gets an entry and builds it if no instance holds it.
+         * @param name The name of the entry.
+         * @param key The key of the map and the parameters.
+         * @param build Called as build() to create the data if the entry does not exist.
+         * @param isBuilt True if build was called.
+         * @return The data of the entry.
+         */
+        template <typename Builder>
+        std::shared_ptr<GlobalMapData> acquire(const std::string &name, uint64_t key, Builder build, bool *isBuilt)
+        {
+            std::shared_ptr<Slot> slot;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                for (auto it = slots_.begin(); it != slots_.end();)
+                {
+                    // the slot of an entry that is being built is still referenced by its builder
+                    if (it->second->data.expired() && it->second.use_count() == 1)
+                        it = slots_.erase(it);
+                    else
+                        ++it;
+                }
+                std::shared_ptr<Slot> &s = slots_[std::make_pair(name, key)];
+                if (!s)
+                    s = std::make_shared<Slot>();
+                slot = s;
+            }
+
+            std::lock_guard<std::mutex> buildLock(slot->buildMutex);
+            std::shared_ptr<GlobalMapData> data = slot->data.lock();
+            *isBuilt = !data;
+            if (!data)
+            {
+                data = build();
+                slot->data = data;
+            }
+            return data;
+        }
+
+        /**
+         * @brief Gets the number of entries that are held by at least one instance.
+         * @return The number of entries.
+         */
+        int getEntriesNum(void)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            int num = 0;
+            for (auto &slot : slots_)
+            {
+                if (!slot.second->data.expired())
+                    num++;
+            }
+            return num;
+        }
+    }; // class GlobalMapStore
+
+} // namespace als_ros2
+
+#endif // __GLOBAL_MAP_STORE_H__
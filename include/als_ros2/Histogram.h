@@ -21,39 +21,58 @@
 #ifndef __HISTOGRAM_H__
 #define __HISTOGRAM_H__
 
-#include <iostream>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
 #include <vector>
 #include <algorithm>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
 namespace als_ros2
 {
 
     /**
      * @class Histogram
      * @brief A class representing a histogram of values.
+     *
+     * The bin probabilities are kept in a dense table that starts at a cache line and is
+     * enclosed by two entries of -1.0 for the values below and above the histogram range, so a
+     * lookup is a clamped index computation and one load without branches.
      */
     class Histogram
     {
     private:
+        struct alignas(64) TableBlock
+        {
+            double vals[8];
+        };
+
         double binWidth_;                 /**< The width of each bin in the histogram. */
+        double invBinWidth_;              /**< The inverse of the bin width. */
         double minValue_;                 /**< The minimum value in the histogram. */
         double maxValue_;                 /**< The maximum value in the histogram. */
         int histogramSize_;               /**< The number of bins in the histogram. */
         int valueNum_;                    /**< The total number of values in the histogram. */
         std::vector<int> histogram_;      /**< The histogram data. */
-        std::vector<double> probability_; /**< The probability of each bin in the histogram. */
+        std::vector<TableBlock> table_;   /**< The -1.0 sentinel, the probability of each bin, and the -1.0 sentinel. */
+
+        inline double *getTable(void) { return table_.empty() ? NULL : table_[0].vals; }
 
         /**
-         * @brief Converts a value to its corresponding bin index in the histogram.
+         * @brief Converts a value to its index in the probability table.
          * @param val The value to convert.
-         * @return The bin index.
+         * @return The bin index plus one, 0 below the range (or NaN), and histogramSize + 1 above the range.
          */
-        inline int val2bin(double val)
+        inline int val2index(double val)
         {
-            int bin = (int)((val - minValue_) / binWidth_);
-            if (bin < 0 || histogramSize_ <= bin)
-                bin = -1;
-            return bin;
+            bool isAboveMin = val >= minValue_; // false for NaN
+            double clamped = isAboveMin ? std::min(val, maxValue_) : minValue_;
+            int idx = std::min((int)((clamped - minValue_) * invBinWidth_), histogramSize_ - 1) + 1;
+            idx = isAboveMin ? idx : 0;
+            return (val > maxValue_) ? histogramSize_ + 1 : idx;
         }
 
         /**
@@ -70,48 +89,55 @@ namespace als_ros2
          * @brief Builds the histogram from a vector of values.
          * @param values The input values.
          */
-        void buildHistogram(std::vector<double> values)
+        void buildHistogram(const std::vector<double> &values)
         {
+            invBinWidth_ = 1.0 / binWidth_;
             histogramSize_ = (int)((maxValue_ - minValue_) / binWidth_) + 1;
 
-            histogram_.resize(histogramSize_, 0);
+            histogram_.assign(histogramSize_, 0);
             valueNum_ = 0;
             for (int i = 0; i < (int)values.size(); ++i)
             {
-                int bin = val2bin(values[i]);
-                if (bin >= 0)
+                double val = values[i];
+                if (val >= minValue_ && val <= maxValue_)
                 {
-                    histogram_[bin]++;
+                    histogram_[val2index(val) - 1]++;
                     valueNum_++;
                 }
             }
 
-            probability_.resize(histogramSize_, 0.0);
-            for (int i = 0; i < (int)histogram_.size(); ++i)
-                probability_[i] = (double)histogram_[i] / (double)valueNum_;
+            table_.assign((histogramSize_ + 2 + 7) / 8, TableBlock());
+            double *table = getTable();
+            table[0] = table[histogramSize_ + 1] = -1.0;
+            for (int i = 0; i < histogramSize_; ++i)
+                table[i + 1] = (valueNum_ > 0) ? (double)histogram_[i] / (double)valueNum_ : 0.0;
         }
 
     public:
         /**
          * @brief Default constructor.
          */
-        Histogram(void) {}
+        Histogram(void) : binWidth_(1.0), invBinWidth_(1.0), minValue_(0.0), maxValue_(0.0), histogramSize_(0), valueNum_(0) {}
 
         /**
          * @brief Constructor that builds the histogram from a vector of values and a bin width.
-         * @param values The input values.
+         * @param values The input values. Pass them with std::move to avoid a copy.
          * @param binWidth The width of each bin in the histogram.
          */
-        Histogram(std::vector<double> values, double binWidth) : binWidth_(binWidth)
+        Histogram(std::vector<double> values, double binWidth) : binWidth_(binWidth), minValue_(0.0), maxValue_(0.0)
         {
-            minValue_ = *std::min_element(values.begin(), values.end());
-            maxValue_ = *std::max_element(values.begin(), values.end());
+            if (!values.empty())
+            {
+                auto minMax = std::minmax_element(values.begin(), values.end());
+                minValue_ = *minMax.first;
+                maxValue_ = *minMax.second;
+            }
             buildHistogram(values);
         }
 
         /**
          * @brief Constructor that builds the histogram from a vector of values, a bin width, a minimum value, and a maximum value.
-         * @param values The input values.
+         * @param values The input values. Pass them with std::move to avoid a copy.
          * @param binWidth The width of each bin in the histogram.
          * @param minValue The minimum value in the histogram.
          * @param maxValue The maximum value in the histogram.
@@ -130,20 +156,56 @@ namespace als_ros2
          */
         inline double getProbability(double value)
         {
-            if (value >= maxValue_)
-                value -= binWidth_;
-            int bin = val2bin(value);
-            if (bin >= 0)
-                return probability_[bin];
-            else
+            if (table_.empty())
                 return -1.0;
+            return getTable()[val2index(value)];
+        }
+
+        /**
+         * @brief Gets the probabilities of an array of values.
+         * @param values The values.
+         * @param num The number of values.
+         * @param probabilities The probability of each value, or -1.0 for the values outside the histogram range.
+         */
+        void getProbabilities(const double *values, size_t num, double *probabilities)
+        {
+            if (table_.empty())
+            {
+                std::fill(probabilities, probabilities + num, -1.0);
+                return;
+            }
+            const double *table = getTable();
+            size_t i = 0;
+#if defined(__AVX2__)
+            __m256d vmin = _mm256_set1_pd(minValue_), vmax = _mm256_set1_pd(maxValue_);
+            __m256d vinv = _mm256_set1_pd(invBinWidth_);
+            __m256d vone = _mm256_set1_pd(1.0), vzero = _mm256_setzero_pd();
+            __m256d vlast = _mm256_set1_pd((double)(histogramSize_ - 1)), vabove = _mm256_set1_pd((double)(histogramSize_ + 1));
+            for (; i + 4 <= num; i += 4)
+            {
+                __m256d v = _mm256_loadu_pd(&values[i]);
+                __m256d t = _mm256_mul_pd(_mm256_sub_pd(_mm256_min_pd(_mm256_max_pd(v, vmin), vmax), vmin), vinv);
+                // truncated before the 1 is added like in val2index, since t + 1.0 rounds up when t is just below an integer
+                __m256d idx = _mm256_add_pd(_mm256_min_pd(_mm256_round_pd(t, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC), vlast), vone);
+                idx = _mm256_blendv_pd(idx, vzero, _mm256_cmp_pd(v, vmin, _CMP_NGE_UQ));
+                idx = _mm256_blendv_pd(idx, vabove, _mm256_cmp_pd(v, vmax, _CMP_GT_OQ));
+                __m256d vals = _mm256_mask_i32gather_pd(vzero, table, _mm256_cvttpd_epi32(idx), _mm256_cmp_pd(vzero, vzero, _CMP_EQ_OQ), 8);
+                _mm256_storeu_pd(&probabilities[i], vals);
+            }
+#endif
+            for (; i < num; ++i)
+                probabilities[i] = table[val2index(values[i])];
         }
 
         /**
          * @brief Smoothes the histogram by averaging each bin with its neighboring bins.
+         *
+         * The smoothed bins are normalized and replace the probabilities; the counts are kept.
          */
         void smoothHistogram(void)
         {
+            if (histogram_.empty())
+                return;
             std::vector<double> vals((int)histogram_.size());
             double sum = 0.0;
             for (int i = 0; i < (int)histogram_.size(); ++i)
@@ -158,8 +220,9 @@ namespace als_ros2
                 vals[i] = val;
                 sum += val;
             }
+            double *table = getTable();
             for (int i = 0; i < (int)histogram_.size(); ++i)
-                histogram_[i] = vals[i] / sum;
+                table[i + 1] = (sum > 0.0) ? vals[i] / sum : 0.0;
         }
 
         /**
@@ -167,9 +230,10 @@ namespace als_ros2
          */
         void printHistogram(void)
         {
+            const double *table = getTable();
             for (int i = 0; i < (int)histogram_.size(); ++i)
                 printf("bin = %d: val = %lf, histogram[%d] = %d, probability[%d] = %lf\n",
-                       i, bin2val(i), i, histogram_[i], i, probability_[i]);
+                       i, bin2val(i), i, histogram_[i], i, table[i + 1]);
         }
     }; // class Histogram
 
@@ -0,0 +1,99 @@
+/****************************************************************************
+ * als_ros: An Advanced Localization System for ROS use with 2D LiDAR
+ * Copyright (C) 2022 Naoki Akai
+ *
+ * Licensed under the Apache License, Version 2.0 (the “License”);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an “AS IS” BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @author Naoki Akai
+ * modified by: Roald Ong
+ ****************************************************************************/
+
+#ifndef __KEY_SCAN_RING_H__
+#define __KEY_SCAN_RING_H__
+
+#include <vector>
+#include <sensor_msgs/msg/laser_scan.hpp>
+#include "als_ros2/Pose.h"
+
+namespace als_ros2
+{
+
+    /**
+     * @brief Fixed-capacity ring of key scans and their odometry poses.
+     *
+     * The scans are shared with the subscription instead of being copied, and pushing a scan
+     * overwrites the oldest one when the ring is full. Index 0 is the newest scan. When the
+     * ring is reversed, beam j of a scan is read from ranges[n - 1 - j] so that a flipped
+     * lidar is handled without copying the ranges.
+     */
+    class KeyScanRing
+    {
+    private:
+        std::vector<sensor_msgs::msg::LaserScan::ConstSharedPtr> scans_;
+        std::vector<Pose> poses_;
+        int head_, size_;
+        int pushedNum_;
+        bool isReversed_;
+
+        inline int toSlot(int i) { return (head_ + i) % (int)scans_.size(); }
+
+    public:
+        KeyScanRing(void) : head_(0), size_(0), pushedNum_(0), isReversed_(false) {}
+
+        /**
+         * @brief Allocates the ring and forgets all scans.
+         * @param capacity The maximum number of key scans.
+         */
+        void reset(int capacity)
+        {
+            if (capacity < 1)
+                capacity = 1;
+            scans_.assign(capacity, nullptr);
+            poses_.assign(capacity, Pose());
+            head_ = size_ = pushedNum_ = 0;
+        }
+
+        inline void setReversed(bool isReversed) { isReversed_ = isReversed; }
+        inline bool isReversed(void) { return isReversed_; }
+        inline int getSize(void) { return size_; }
+        inline int getCapacity(void) { return (int)scans_.size(); }
+        inline bool isFull(void) { return size_ == (int)scans_.size(); }
+
+        /**
+         * @brief Gets the number of scans pushed since the last reset, including evicted ones.
+         * @return The number of pushed scans.
+         */
+        inline int getPushedNum(void) { return pushedNum_; }
+
+        /**
+         * @brief Pushes a scan as the newest one, evicting the oldest one if the ring is full.
+         * @param scan The scan.
+         * @param pose The odometry pose of the scan.
+         */
+        void push(const sensor_msgs::msg::LaserScan::ConstSharedPtr &scan, const Pose &pose)
+        {
+            head_ = (head_ + (int)scans_.size() - 1) % (int)scans_.size();
+            scans_[head_] = scan;
+            poses_[head_] = pose;
+            if (size_ < (int)scans_.size())
+                size_++;
+            pushedNum_++;
+        }
+
+        inline const sensor_msgs::msg::LaserScan &getScan(int i) { return *scans_[toSlot(i)]; }
+        inline Pose &getPose(int i) { return poses_[toSlot(i)]; }
+    }; // class KeyScanRing
+
+} // namespace als_ros2
+
+#endif // __KEY_SCAN_RING_H__
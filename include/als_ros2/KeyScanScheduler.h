@@ -0,0 +1,206 @@
+/****************************************************************************
+ * als_ros: An Advanced Localization System for ROS use with 2D LiDAR
+ * Copyright (C) 2022 Naoki Akai
+ *
+ * Licensed under the Apache License, Version 2.0 (the “License”);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an “AS IS” BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @author Naoki Akai
+ * modified by: Roald Ong
+ ****************************************************************************/
+
+#ifndef __KEY_SCAN_SCHEDULER_H__
+#define __KEY_SCAN_SCHEDULER_H__
+
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+
+namespace als_ros2
+{
+
+    /**
+     * @brief Decides which key scan updates run the pose sampling and how many correspondences they may use.
+     *
+     * Two inputs reduce the rate of the pose sampling. While the localization reliability is at
+     * least the reliability threshold, only every reliable cycle interval-th update runs, and a
+     * reliability older than the timeout counts as unknown, that is, as suspect. With a time
+     * budget, the cost of the stages before the pose generation and the cost per correspondence
+     * are tracked, the correspondences are capped to what fits into the budget, and an update
+     * that overran the budget anyway is followed by skipped updates until the average is back
+     * within it. A trigger makes the next scan run regardless of both. The methods can be
+     * called from different threads.
+     */
+    class KeyScanScheduler
+    {
+    private:
+        static constexpr double SMOOTHING_RATE = 0.3;
+
+        std::mutex mutex_;
+        double timeBudget_; // [ms] (<= 0: unlimited)
+        int maxSkippedCyclesNum_;
+        double reliabilityTH_;
+        int reliableCycleInterval_;
+        double reliabilityTimeout_; // [s]
+
+        double reliability_, reliabilityTime_;
+        bool gotReliability_;
+        bool isTriggered_;
+        int skippedCyclesNum_; // the updates that are still skipped after an overrun
+        int reliableCyclesCount_;
+        double fixedTime_, correspondenceTime_; // smoothed costs [ms]
+        bool gotCycleTime_;
+
+        inline bool isReliable(double time)
+        {
+            return reliableCycleInterval_ > 1 && gotReliability_ && time - reliabilityTime_ <= reliabilityTimeout_ &&
+                   reliability_ >= reliabilityTH_;
+        }
+
+    public:
+        KeyScanScheduler(void) : timeBudget_(0.0), maxSkippedCyclesNum_(0), reliabilityTH_(0.9), reliableCycleInterval_(1),
+                                 reliabilityTimeout_(2.0), reliability_(0.0), reliabilityTime_(0.0), gotReliability_(false),
+                                 isTriggered_(false), skippedCyclesNum_(0), reliableCyclesCount_(0), fixedTime_(0.0),
+                                 correspondenceTime_(0.0), gotCycleTime_(false) {}
+
+        /**
+         * @brief Sets the time budget of an update.
+         * @param timeBudget The time budget [ms] (<= 0: unlimited).
+         * @param maxSkippedCyclesNum The maximum number of updates that are skipped after an overrun.
+         */
+        void setTimeBudget(double timeBudget, int maxSkippedCyclesNum)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            timeBudget_ = timeBudget;
+            maxSkippedCyclesNum_ = std::max(maxSkippedCyclesNum, 0);
+        }
+
+        /**
+         * @brief Sets the rate reduction while the localization is reliable.
+         * @param reliabilityTH The reliability from which the localization counts as reliable.
+         * @param reliableCycleInterval Every this many updates run while reliable (<= 1: all).
+         * @param reliabilityTimeout The age from which a reliability is ignored [s].
+         */
+        void setReliabilityGate(double reliabilityTH, int reliableCycleInterval, double reliabilityTimeout)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            reliabilityTH_ = reliabilityTH;
+            reliableCycleInterval_ = reliableCycleInterval;
+            reliabilityTimeout_ = reliabilityTimeout;
+        }
+
+        /**
+         * @brief Sets the latest localization reliability.
+         * @param reliability The reliability in [0, 1].
+         * @param time The time of the reliability [s].
+         */
+        void setReliability(double reliability, double time)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            reliability_ = reliability;
+            reliabilityTime_ = time;
+            gotReliability_ = true;
+        }
+
+        /**
+         * @brief Makes the next scan that can run the pose sampling run it even without a new key scan.
+         */
+        void trigger(void)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            isTriggered_ = true;
+        }
+
+        /**
+         * @brief Decides whether a scan runs the pose sampling.
+         *
+         * Until the key scans are complete, no scan runs, and a trigger stays pending for the
+         * first scan that can run.
+         *
+         * @param isKeyScanUpdated True if the scan was added as a key scan.
+         * @param isKeyScansFull True if the key scans are complete.
+         * @param time The time of the scan [s].
+         * @return True if the pose sampling runs.
+         */
+        bool shouldRun(bool isKeyScanUpdated, bool isKeyScansFull, double time)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!isKeyScansFull)
+                return false;
+            if (isTriggered_)
+            {
+                isTriggered_ = false;
+                skippedCyclesNum_ = reliableCyclesCount_ = 0;
+                return true;
+            }
+            if (!isKeyScanUpdated)
+                return false;
+            if (skippedCyclesNum_ > 0)
+            {
+                skippedCyclesNum_--;
+                return false;
+            }
+            if (!isReliable(time))
+            {
+                reliableCyclesCount_ = 0;
+                return true;
+            }
+            // the first reliable update runs, so a sampling is never delayed by a full interval after a recovery
+            bool isRun = reliableCyclesCount_ == 0;
+            reliableCyclesCount_ = (reliableCyclesCount_ + 1) % reliableCycleInterval_;
+            return isRun;
+        }
+
+        /**
+         * @brief Gets the number of correspondences that fit into the time budget.
+         * @return The number of correspondences (-1: unlimited).
+         */
+        int getMaxCorrespondencesNum(void)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (timeBudget_ <= 0.0 || !gotCycleTime_ || correspondenceTime_ <= 0.0)
+                return -1;
+            double restTime = timeBudget_ - fixedTime_;
+            return std::max(1, (int)(restTime / correspondenceTime_));
+        }
+
+        /**
+         * @brief Reports the cost of an update that ran.
+         * @param fixedTime The time of the stages before the pose generation [ms].
+         * @param poseGenerationTime The time of the pose generation [ms].
+         * @param correspondencesNum The number of correspondences that the poses were generated from.
+         */
+        void reportCycle(double fixedTime, double poseGenerationTime, int correspondencesNum)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!gotCycleTime_)
+            {
+                fixedTime_ = fixedTime;
+                correspondenceTime_ = (correspondencesNum > 0) ? poseGenerationTime / (double)correspondencesNum : 0.0;
+                gotCycleTime_ = true;
+            }
+            else
+            {
+                fixedTime_ += SMOOTHING_RATE * (fixedTime - fixedTime_);
+                if (correspondencesNum > 0)
+                    correspondenceTime_ += SMOOTHING_RATE * (poseGenerationTime / (double)correspondencesNum - correspondenceTime_);
+            }
+
+            double time = fixedTime + poseGenerationTime;
+            if (timeBudget_ > 0.0 && time > timeBudget_)
+                skippedCyclesNum_ = std::min((int)ceil(time / timeBudget_) - 1, maxSkippedCyclesNum_);
+        }
+    }; // class KeyScanScheduler
+
+} // namespace als_ros2
+
+#endif // __KEY_SCAN_SCHEDULER_H__
@@ -0,0 +1,70 @@
+/****************************************************************************
+ * als_ros: An Advanced Localization System for ROS use with 2D LiDAR
+ * Copyright (C) 2022 Naoki Akai
+ *
+ * Licensed under the Apache License, Version 2.0 (the “License”);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an “AS IS” BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @author Naoki Akai
+ * modified by: Roald Ong
+ ****************************************************************************/
+
+#ifndef __KEYPOINT_H__
+#define __KEYPOINT_H__
+
+namespace als_ros2
+{
+
+    /**
+     * @brief Represents a keypoint with its coordinates and type.
+     *
+     * The Keypoint class stores the coordinates (u, v) and the corresponding
+     * world coordinates (x, y) of a keypoint. It also stores the type of the
+     * keypoint, which can be -2 (invalid), -1 (local minima), 0 (saddle), or
+     * 1 (local maxima).
+     */
+    class Keypoint
+    {
+    private:
+        int u_, v_;
+        double x_, y_;
+        char type_;
+        // type values -2, -1, 0, or 1.
+        // -2: invalid, -1: local minima, 0: saddle, 1: local maxima
+
+    public:
+        Keypoint(void) : u_(0), v_(0), x_(0.0), y_(0.0), type_(-2) {}
+
+        Keypoint(int u, int v) : u_(u), v_(v), x_(0.0), y_(0.0), type_(-2) {}
+
+        Keypoint(double x, double y) : u_(0), v_(0), x_(x), y_(y), type_(-2) {}
+
+        Keypoint(int u, int v, double x, double y) : u_(u), v_(v), x_(x), y_(y), type_(-2) {}
+
+        Keypoint(int u, int v, double x, double y, char type) : u_(u), v_(v), x_(x), y_(y), type_(type) {}
+
+        inline int getU(void) const { return u_; }
+        inline int getV(void) const { return v_; }
+        inline double getX(void) const { return x_; }
+        inline double getY(void) const { return y_; }
+        inline char getType(void) const { return type_; }
+
+        inline void setU(int u) { u_ = u; }
+        inline void setV(int v) { v_ = v; }
+        inline void setX(double x) { x_ = x; }
+        inline void setY(double y) { y_ = y; }
+        inline void setType(char type) { type_ = type; }
+    }; // class Keypoint
+
+} // namespace als_ros2
+
+#endif // __KEYPOINT_H__
@@ -0,0 +1,117 @@
+/****************************************************************************
+ * als_ros: An Advanced Localization System for ROS use with 2D LiDAR
+ * Copyright (C) 2022 Naoki Akai
+ *
+ * Licensed under the Apache License, Version 2.0 (the “License”);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an “AS IS” BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @author Naoki Akai
+ * modified by: Roald Ong
+ ****************************************************************************/
+
+#ifndef __LATEST_WINS_QUEUE_H__
+#define __LATEST_WINS_QUEUE_H__
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+namespace als_ros2
+{
+
+    /**
+     * @brief Bounded blocking queue that drops its oldest item when a new item does not fit.
+     *
+     * Producers never block, so a slow consumer only makes the queue skip stale items.
+     */
+    template <typename T>
+    class LatestWinsQueue
+    {
+    private:
+        std::deque<T> items_;
+        int capacity_;
+        bool isClosed_;
+        int droppedNum_;
+        std::mutex mutex_;
+        std::condition_variable cv_;
+
+    public:
+        LatestWinsQueue(void) : capacity_(1), isClosed_(false), droppedNum_(0) {}
+
+        inline void setCapacity(int capacity)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            capacity_ = (capacity < 1) ? 1 : capacity;
+        }
+
+        inline int getDroppedNum(void)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return droppedNum_;
+        }
+
+        /**
+         * @brief Pushes an item, dropping the oldest items while the queue is full.
+         * @param item The item to push.
+         * @return False if the queue was closed, true otherwise.
+         */
+        bool push(T item)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (isClosed_)
+                    return false;
+                while ((int)items_.size() >= capacity_)
+                {
+                    items_.pop_front();
+                    droppedNum_++;
+                }
+                items_.push_back(std::move(item));
+            }
+            cv_.notify_one();
+            return true;
+        }
+
+        /**
+         * @brief Waits for the oldest item and removes it from the queue.
+         * @param item The popped item.
+         * @return False if the queue was closed, true otherwise.
+         */
+        bool pop(T &item)
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this]
+                     { return isClosed_ || !items_.empty(); });
+            if (isClosed_)
+                return false;
+            item = std::move(items_.front());
+            items_.pop_front();
+            return true;
+        }
+
+        /**
+         * @brief Wakes up all waiting consumers and rejects further items.
+         */
+        void close(void)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                isClosed_ = true;
+                items_.clear();
+            }
+            cv_.notify_all();
+        }
+    }; // class LatestWinsQueue
+
+} // namespace als_ros2
+
+#endif // __LATEST_WINS_QUEUE_H__
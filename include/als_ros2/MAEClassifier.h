@@ -26,7 +26,12 @@
 #include <vector>
 #include <list>
 #include <numeric>
+#include <algorithm>
+#include <filesystem>
+#include <system_error>
 #include "Histogram.h"
+#include "MAEDecisionTable.h"
+#include "MaskedMean.h"
 
 namespace als_ros2
 {
@@ -54,26 +59,31 @@ namespace als_ros2
         Histogram positiveMAEHistogram_, negativeMAEHistogram_;
         Histogram truePositiveMAEHistogram_, trueNegativeMAEHistogram_;
         Histogram falsePositiveMAEHistogram_, falseNegativeMAEHistogram_;
+        MAEDecisionTable decisionTable_;
 
-        template <template <class T, class Allocator = std::allocator<T>> class Container>
-        double getMean(Container<double> &x)
+        // running MAE moments of the streamed training scans (Welford's method)
+        struct MAEMoments
         {
-            return std::accumulate(x.begin(), x.end(), 0.0) / x.size();
-        }
+            long num;
+            double mean, m2;
 
-        template <template <class T, class Allocator = std::allocator<T>> class Container>
-        double getVar(Container<double> &x)
-        {
-            double size = x.size();
-            double mean = getMean(x);
-            return (std::inner_product(x.begin(), x.end(), x.begin(), 0.0) - mean * mean * size) / (size - 1.0);
-        }
+            MAEMoments(void) : num(0), mean(0.0), m2(0.0) {}
 
-        template <template <class T, class Allocator = std::allocator<T>> class Container>
-        double getStd(Container<double> &x)
-        {
-            return std::sqrt(getVar(x));
-        }
+            inline void add(double mae)
+            {
+                num++;
+                double delta = mae - mean;
+                mean += delta / (double)num;
+                m2 += delta * (mae - mean);
+            }
+
+            inline double getStd(void) { return num > 1 ? std::sqrt(m2 / (double)(num - 1)) : 0.0; }
+        };
+
+        static constexpr double TRAIN_MAE_BIN_WIDTH = 0.0001; // resolution of the learned threshold [m]
+        std::vector<int> trainMAEHistograms_[2];              // success, failure
+        MAEMoments trainMAEMoments_[2];
+        std::vector<double> testSuccessMAEs_, testFailureMAEs_;
 
         std::vector<double> readMAEs(std::string filePath)
         {
@@ -91,6 +101,17 @@ namespace als_ros2
             return maes;
         }
 
+        // success and failure likelihoods of an MAE from the histograms, clamped to their lower bound
+        inline void getHistogramLikelihoods(double mae, double *pSuccess, double *pFailure)
+        {
+            *pSuccess = dTruePositive_ * positiveMAEHistogram_.getProbability(mae) + dFalsePositive_ * positiveMAEHistogram_.getProbability(mae);
+            *pFailure = dTrueNegative_ * negativeMAEHistogram_.getProbability(mae) + dFalsePositive_ * negativeMAEHistogram_.getProbability(mae);
+            if (*pSuccess < 10.0e-9)
+                *pSuccess = 10.0e-9;
+            if (*pFailure < 10.0e-9)
+                *pFailure = 10.0e-9;
+        }
+
     public:
         MAEClassifier(void) : maxResidualError_(1.0),
                               maeHistogramBinWidth_(0.01) {}
@@ -101,74 +122,158 @@ namespace als_ros2
 
         inline double getFailureThreshold(void) { return failureThreshold_; }
 
-        double getMAE(std::vector<double> residualErrors)
+        /**
+         * @brief Computes the mean of the residual errors in [0, maxResidualError].
+         * @param residualErrors The residual errors [m].
+         * @param num The number of residual errors.
+         * @return The MAE, or 0 if no residual error is in the range.
+         */
+        template <typename T>
+        inline double getMAE(const T *residualErrors, size_t num)
         {
-            double sum = 0.0;
-            int num = 0;
-            for (size_t i = 0; i < residualErrors.size(); i++)
-            {
-                if (0.0 <= residualErrors[i] && residualErrors[i] <= maxResidualError_)
-                {
-                    sum += residualErrors[i];
-                    num++;
-                }
-            }
-            if (num == 0)
+            double sum;
+            int count;
+            MaskedMean::sum(residualErrors, num, maxResidualError_, &sum, &count);
+            if (count == 0)
                 return 0.0;
             else
-                return sum / (double)num;
+                return sum / (double)count;
+        }
+
+        template <typename T>
+        inline double getMAE(const std::vector<T> &residualErrors) { return getMAE(residualErrors.data(), residualErrors.size()); }
+
+        /**
+         * @brief Computes the MAEs of residual error arrays that are stored contiguously.
+         * @param residualErrors The residual errors of all arrays [m].
+         * @param offsets Array i is [offsets[i], offsets[i + 1]) of residualErrors.
+         * @param num The number of arrays.
+         * @param maes The MAEs of the arrays.
+         */
+        template <typename T>
+        void getMAEs(const T *residualErrors, const size_t *offsets, int num, double *maes)
+        {
+            for (int i = 0; i < num; ++i)
+                maes[i] = getMAE(residualErrors + offsets[i], offsets[i + 1] - offsets[i]);
+        }
+
+        /**
+         * @brief Forgets the streamed training and test MAEs. The histograms cover [0, maxResidualError].
+         */
+        void resetTraining(void)
+        {
+            trainMAEHistograms_[0].assign((int)(maxResidualError_ / TRAIN_MAE_BIN_WIDTH) + 1, 0);
+            trainMAEHistograms_[1].assign((int)(maxResidualError_ / TRAIN_MAE_BIN_WIDTH) + 1, 0);
+            trainMAEMoments_[0] = trainMAEMoments_[1] = MAEMoments();
+            testSuccessMAEs_.clear();
+            testFailureMAEs_.clear();
         }
 
-        void learnThreshold(std::vector<std::vector<double>> trainSuccessResidualErrors, std::vector<std::vector<double>> trainFailureResidualErrors)
+        /**
+         * @brief Adds the residual errors of one training scan.
+         *
+         * Only the MAE of the scan is kept, in the running moments and a fixed-bin histogram of
+         * its class, so the residual errors can be discarded afterwards.
+         *
+         * @param residualErrors The residual errors of the scan [m].
+         * @param isSuccess True if the scan was taken at a successfully localized pose.
+         */
+        template <typename T>
+        inline void addTrainResidualErrors(const std::vector<T> &residualErrors, bool isSuccess) { addTrainMAE(getMAE(residualErrors), isSuccess); }
+
+        /**
+         * @brief Adds the MAE of one training scan, e.g. one computed by getMAEs.
+         * @param mae The MAE of the scan [m].
+         * @param isSuccess True if the scan was taken at a successfully localized pose.
+         */
+        void addTrainMAE(double mae, bool isSuccess)
         {
-            std::vector<double> successMAEs((int)trainSuccessResidualErrors.size());
-            std::vector<double> failureMAEs((int)trainFailureResidualErrors.size());
-            for (int i = 0; i < (int)trainSuccessResidualErrors.size(); ++i)
-                successMAEs[i] = getMAE(trainSuccessResidualErrors[i]);
-            for (int i = 0; i < (int)trainFailureResidualErrors.size(); ++i)
-                failureMAEs[i] = getMAE(trainFailureResidualErrors[i]);
-
-            successMAEMean_ = getMean(successMAEs);
-            successMAEStd_ = getStd(successMAEs);
-            failureMAEMean_ = getMean(failureMAEs);
-            failureMAEStd_ = getStd(failureMAEs);
+            if (trainMAEHistograms_[0].empty())
+                resetTraining();
+            int c = isSuccess ? 0 : 1;
+            std::vector<int> &hist = trainMAEHistograms_[c];
+            int bin = std::min(std::max((int)(mae / TRAIN_MAE_BIN_WIDTH), 0), (int)hist.size() - 1);
+            hist[bin]++;
+            trainMAEMoments_[c].add(mae);
+        }
 
+        /**
+         * @brief Selects the failure threshold that maximizes the accuracy on the streamed training MAEs.
+         *
+         * The thresholds between the mean success and failure MAEs are swept in one pass over
+         * the cumulative histograms, at the resolution of the training histogram bins.
+         */
+        void learnThreshold(void)
+        {
+            if (trainMAEHistograms_[0].empty())
+                resetTraining();
+            MAEMoments &success = trainMAEMoments_[0], &failure = trainMAEMoments_[1];
+            successMAEMean_ = success.mean;
+            successMAEStd_ = success.getStd();
+            failureMAEMean_ = failure.mean;
+            failureMAEStd_ = failure.getStd();
+
+            std::vector<int> &successHist = trainMAEHistograms_[0], &failureHist = trainMAEHistograms_[1];
+            long totalNum = success.num + failure.num;
+            long successBelowNum = 0, failureBelowNum = 0;
             bool isFirst = true;
-            double maxAcc;
-            int totalNum = (int)trainSuccessResidualErrors.size() + (int)trainFailureResidualErrors.size();
-            for (double th = successMAEMean_; th <= failureMAEMean_; th += 0.005)
+            double maxAcc = 0.0;
+            for (int i = 0; i < (int)successHist.size(); ++i)
             {
-                int correctNum = 0;
-                for (int i = 0; i < (int)trainSuccessResidualErrors.size(); ++i)
-                {
-                    if (successMAEs[i] <= th)
-                        correctNum++;
-                }
-                for (int i = 0; i < (int)trainFailureResidualErrors.size(); ++i)
-                {
-                    if (failureMAEs[i] > th)
-                        correctNum++;
-                }
-                double acc = (double)correctNum / (double)totalNum;
-                printf("maeTH = %lf [m], accuracy = %lf [%%]\n", th, acc * 100.0);
-                if (isFirst)
+                successBelowNum += successHist[i];
+                failureBelowNum += failureHist[i];
+                double th = (double)(i + 1) * TRAIN_MAE_BIN_WIDTH;
+                if (th < successMAEMean_ || failureMAEMean_ < th)
+                    continue;
+                double acc = (double)(successBelowNum + failure.num - failureBelowNum) / (double)totalNum;
+                if (isFirst || maxAcc < acc)
                 {
                     failureThreshold_ = th;
                     maxAcc = acc;
                     isFirst = false;
                 }
-                else if (maxAcc < acc)
-                {
-                    failureThreshold_ = th;
-                    maxAcc = acc;
-                }
             }
+            printf("maeTH = %lf [m], accuracy = %lf [%%]\n", failureThreshold_, maxAcc * 100.0);
+        }
+
+        void learnThreshold(const std::vector<std::vector<double>> &trainSuccessResidualErrors, const std::vector<std::vector<double>> &trainFailureResidualErrors)
+        {
+            resetTraining();
+            for (size_t i = 0; i < trainSuccessResidualErrors.size(); ++i)
+                addTrainResidualErrors(trainSuccessResidualErrors[i], true);
+            for (size_t i = 0; i < trainFailureResidualErrors.size(); ++i)
+                addTrainResidualErrors(trainFailureResidualErrors[i], false);
+            learnThreshold();
         }
 
-        void writeClassifierParams(std::vector<std::vector<double>> testSuccessResidualErrors, std::vector<std::vector<double>> testFailureResidualErrors)
+        /**
+         * @brief Adds the residual errors of one test scan, which is classified with the learned threshold.
+         * @param residualErrors The residual errors of the scan [m].
+         * @param isSuccess True if the scan was taken at a successfully localized pose.
+         */
+        template <typename T>
+        inline void addTestResidualErrors(const std::vector<T> &residualErrors, bool isSuccess) { addTestMAE(getMAE(residualErrors), isSuccess); }
+
+        inline void addTestMAE(double mae, bool isSuccess)
         {
-            std::string mkdirCmd = "mkdir -p " + classifiersDir_;
-            int retVal = system(mkdirCmd.c_str());
+            if (isSuccess)
+                testSuccessMAEs_.push_back(mae);
+            else
+                testFailureMAEs_.push_back(mae);
+        }
+
+        /**
+         * @brief Writes the MAE files of the streamed test scans and classifier.yaml.
+         */
+        void writeClassifierParams(void)
+        {
+            std::error_code ec;
+            std::filesystem::create_directories(classifiersDir_, ec);
+            if (ec)
+            {
+                fprintf(stderr, "cannot create %s: %s\n", classifiersDir_.c_str(), ec.message().c_str());
+                exit(1);
+            }
 
             std::string positiveMAEsFileName = classifiersDir_ + "positive_maes.txt";
             std::string negativeMAEsFileName = classifiersDir_ + "negative_maes.txt";
@@ -184,9 +289,9 @@ namespace als_ros2
             FILE *fpFalseNegative = fopen(falseNegativeMAEsFileName.c_str(), "w");
 
             truePositiveNum_ = falseNegativeNum_ = falsePositiveNum_ = trueNegativeNum_ = 0;
-            for (size_t i = 0; i < testSuccessResidualErrors.size(); i++)
+            for (size_t i = 0; i < testSuccessMAEs_.size(); i++)
             {
-                double mae = getMAE(testSuccessResidualErrors[i]);
+                double mae = testSuccessMAEs_[i];
                 fprintf(fpPositive, "%lf\n", mae);
                 if (mae <= failureThreshold_)
                 {
@@ -199,9 +304,9 @@ namespace als_ros2
                     fprintf(fpFalseNegative, "%lf\n", mae);
                 }
             }
-            for (size_t i = 0; i < testFailureResidualErrors.size(); i++)
+            for (size_t i = 0; i < testFailureMAEs_.size(); i++)
             {
-                double mae = getMAE(testFailureResidualErrors[i]);
+                double mae = testFailureMAEs_[i];
                 fprintf(fpNegative, "%lf\n", mae);
                 if (mae <= failureThreshold_)
                 {
@@ -249,6 +354,17 @@ namespace als_ros2
             printf("yaml file for the MAE classifier was saved at %s\n", yamlFile.c_str());
         }
 
+        void writeClassifierParams(const std::vector<std::vector<double>> &testSuccessResidualErrors, const std::vector<std::vector<double>> &testFailureResidualErrors)
+        {
+            testSuccessMAEs_.clear();
+            testFailureMAEs_.clear();
+            for (size_t i = 0; i < testSuccessResidualErrors.size(); ++i)
+                addTestResidualErrors(testSuccessResidualErrors[i], true);
+            for (size_t i = 0; i < testFailureResidualErrors.size(); ++i)
+                addTestResidualErrors(testFailureResidualErrors[i], false);
+            writeClassifierParams();
+        }
+
         void readClassifierParams(void)
         {
             std::string yamlFile = classifiersDir_ + "classifier.yaml";
@@ -288,15 +404,51 @@ namespace als_ros2
             dFalseNegative_ = (double)falseNegativeNum / (double)(trueNegativeNum + falsePositiveNum);
         }
 
+        /**
+         * @brief Samples the decision likelihoods of the histograms read by readClassifierParams on a grid.
+         * @param maeStep The MAE step of the grid over [0, maxResidualError] [m].
+         */
+        void buildDecisionTable(double maeStep)
+        {
+            int nodesNum = std::max(2, (int)std::ceil(maxResidualError_ / maeStep) + 1);
+            decisionTable_.reset(0.0, maeStep, nodesNum, maxResidualError_, failureThreshold_);
+            for (int i = 0; i < nodesNum; ++i)
+            {
+                double pSuccess, pFailure;
+                getHistogramLikelihoods(decisionTable_.getNodeMAE(i), &pSuccess, &pFailure);
+                decisionTable_.setNode(i, pSuccess, pFailure);
+            }
+        }
+
+        /**
+         * @brief Writes the decision table to classifier.bin in the classifier directory.
+         * @return True if the file was written, false otherwise.
+         */
+        inline bool writeDecisionTable(void) { return decisionTable_.save(classifiersDir_ + "classifier.bin"); }
+
+        /**
+         * @brief Loads classifier.bin from the classifier directory instead of the text files.
+         *
+         * Once loaded, calculateDecisionModel interpolates the table instead of reading the histograms.
+         *
+         * @return True if a valid model was loaded, false otherwise.
+         */
+        bool readDecisionTable(void)
+        {
+            if (!decisionTable_.load(classifiersDir_ + "classifier.bin"))
+                return false;
+            maxResidualError_ = decisionTable_.getMaxResidualError();
+            failureThreshold_ = decisionTable_.getFailureThreshold();
+            return true;
+        }
+
         double calculateDecisionModel(double mae, double *reliability)
         {
             double pSuccess, pFailure;
-            pSuccess = dTruePositive_ * positiveMAEHistogram_.getProbability(mae) + dFalsePositive_ * positiveMAEHistogram_.getProbability(mae);
-            pFailure = dTrueNegative_ * negativeMAEHistogram_.getProbability(mae) + dFalsePositive_ * negativeMAEHistogram_.getProbability(mae);
-            if (pSuccess < 10.0e-9)
-                pSuccess = 10.0e-9;
-            if (pFailure < 10.0e-9)
-                pFailure = 10.0e-9;
+            if (decisionTable_.isLoaded())
+                decisionTable_.getLikelihoods(mae, &pSuccess, &pFailure);
+            else
+                getHistogramLikelihoods(mae, &pSuccess, &pFailure);
             double rel = pSuccess * *reliability;
             double relInv = pFailure * (1.0 - *reliability);
             double p = rel + relInv;
@@ -0,0 +1,238 @@
+/****************************************************************************
+ * als_ros: An Advanced Localization System for ROS use with 2D LiDAR
+ * Copyright (C) 2022 Naoki Akai
+ *
+ * Licensed under the Apache License, Version 2.0 (the “License”);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an “AS IS” BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @author Naoki Akai
+ * modified by: Roald Ong
+ ****************************************************************************/
+
+#ifndef __MAE_DECISION_TABLE_H__
+#define __MAE_DECISION_TABLE_H__
+
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace als_ros2
+{
+
+    /**
+     * @brief Binary model of the MAE classifier sampled on a fixed MAE grid.
+     *
+     * For every grid node, the table holds the success and failure likelihoods that
+     * MAEClassifier::calculateDecisionModel computes from the MAE histograms, already clamped to
+     * their lower bound, so a decision is one interpolated read of a node pair. A model file is
+     * a fixed header followed by the interleaved likelihood pairs in the byte order of the
+     * writing machine, which the header records so that a file of the other byte order is
+     * rejected instead of misread. A loaded file stays memory-mapped, and the likelihoods are
+     * read from the mapping in place. A table is not copyable, since it may own a mapping.
+     */
+    class MAEDecisionTable
+    {
+    private:
+        static const uint32_t VERSION = 2;
+        static const uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+        struct Header
+        {
+            char magic[8];
+            uint32_t byteOrderMark; // reads as 0x04030201 on a machine of the other byte order
+            uint32_t version;
+            uint32_t nodesNum;
+            uint32_t padding;
+            double maeMin, maeStep;
+            double maxResidualError;
+            double failureThreshold;
+        };
+
+        uint32_t nodesNum_;
+        double maeMin_, maeStep_, invMAEStep_;
+        double maxResidualError_, failureThreshold_;
+        std::vector<double> builtLikelihoods_; // the likelihoods of a table that was reset and filled
+        void *mapping_;                        // the mapped model file of a loaded table (NULL: none)
+        size_t mappingSize_;
+        const double *likelihoods_;            // (pSuccess, pFailure) of every node, in builtLikelihoods_ or in the mapping
+
+        /*
+         * Unmaps the model file of a loaded table.
+         */
+        void unmap(void)
+        {
+            if (mapping_ != NULL)
+                munmap(mapping_, mappingSize_);
+            mapping_ = NULL;
+            mappingSize_ = 0;
+        }
+
+        /*
+         * Sets the grid and the parameters of the classifier without touching the likelihoods.
+         */
+        void setGrid(double maeMin, double maeStep, int nodesNum, double maxResidualError, double failureThreshold)
+        {
+            nodesNum_ = (uint32_t)nodesNum;
+            maeMin_ = maeMin;
+            maeStep_ = maeStep;
+            invMAEStep_ = 1.0 / maeStep;
+            maxResidualError_ = maxResidualError;
+            failureThreshold_ = failureThreshold;
+        }
+
+    public:
+        MAEDecisionTable(void) : nodesNum_(0), maeMin_(0.0), maeStep_(0.0), invMAEStep_(0.0), maxResidualError_(0.0), failureThreshold_(0.0),
+                                 mapping_(NULL), mappingSize_(0), likelihoods_(NULL) {}
+
+        MAEDecisionTable(const MAEDecisionTable &) = delete;
+        MAEDecisionTable &operator=(const MAEDecisionTable &) = delete;
+
+        ~MAEDecisionTable(void) { unmap(); }
+
+        inline bool isLoaded(void) { return nodesNum_ >= 2; }
+        inline double getMaxResidualError(void) { return maxResidualError_; }
+        inline double getFailureThreshold(void) { return failureThreshold_; }
+
+        /**
+         * @brief Allocates the grid.
+         * @param maeMin The MAE of the first node [m].
+         * @param maeStep The MAE step between nodes [m].
+         * @param nodesNum The number of nodes, at least 2.
+         * @param maxResidualError The maximum residual error of the classifier [m].
+         * @param failureThreshold The failure threshold of the classifier [m].
+         */
+        void reset(double maeMin, double maeStep, int nodesNum, double maxResidualError, double failureThreshold)
+        {
+            unmap();
+            setGrid(maeMin, maeStep, nodesNum, maxResidualError, failureThreshold);
+            builtLikelihoods_.assign(2 * (size_t)nodesNum, 0.0);
+            likelihoods_ = builtLikelihoods_.data();
+        }
+
+        inline int getNodesNum(void) { return (int)nodesNum_; }
+        inline double getNodeMAE(int i) { return maeMin_ + maeStep_ * (double)i; }
+
+        /**
+         * @brief Sets the likelihoods of a node of a table that was reset.
+         */
+        inline void setNode(int i, double pSuccess, double pFailure)
+        {
+            builtLikelihoods_[2 * i] = pSuccess;
+            builtLikelihoods_[2 * i + 1] = pFailure;
+        }
+
+        /**
+         * @brief Interpolates the likelihoods of an MAE. MAEs outside the grid are clamped to it.
+         *
+         * A NaN MAE, e.g. of a scan without a valid residual error, is treated as the largest MAE
+         * of the grid.
+         *
+         * @param mae The MAE [m].
+         * @param pSuccess The likelihood of a localization success.
+         * @param pFailure The likelihood of a localization failure.
+         */
+        inline void getLikelihoods(double mae, double *pSuccess, double *pFailure)
+        {
+            double t = (mae - maeMin_) * invMAEStep_;
+            double tMax = (double)(nodesNum_ - 1);
+            if (std::isnan(t))
+                t = tMax;
+            t = t < 0.0 ? 0.0 : (t > tMax ? tMax : t);
+            int i = (int)t;
+            if (i > (int)nodesNum_ - 2)
+                i = (int)nodesNum_ - 2;
+            double w = t - (double)i;
+            const double *p = &likelihoods_[2 * i];
+            *pSuccess = p[0] + (p[2] - p[0]) * w;
+            *pFailure = p[1] + (p[3] - p[1]) * w;
+        }
+
+        /**
+         * @brief Loads a model file by mapping it. The mapping is kept until the table is reset, loaded again, or destroyed.
+         * @param filePath The path of the model file.
+         * @return True if a valid model was loaded, false otherwise, in which case the table is unchanged.
+         */
+        bool load(const std::string &filePath)
+        {
+            int fd = open(filePath.c_str(), O_RDONLY);
+            if (fd < 0)
+                return false;
+            struct stat st;
+            if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(Header))
+            {
+                close(fd);
+                return false;
+            }
+            size_t fileSize = (size_t)st.st_size;
+            void *addr = mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd);
+            if (addr == MAP_FAILED)
+                return false;
+
+            // the mapping is page aligned, so the header and the likelihoods after it are aligned for double
+            const Header *header = (const Header *)addr;
+            bool isValid = memcmp(header->magic, "ALSMAEC", 8) == 0 && header->byteOrderMark == BYTE_ORDER_MARK &&
+                           header->version == VERSION && header->nodesNum >= 2 && header->maeStep > 0.0 &&
+                           fileSize == sizeof(Header) + (size_t)header->nodesNum * 2 * sizeof(double);
+            if (!isValid)
+            {
+                munmap(addr, fileSize);
+                return false;
+            }
+            unmap();
+            std::vector<double>().swap(builtLikelihoods_);
+            setGrid(header->maeMin, header->maeStep, (int)header->nodesNum, header->maxResidualError, header->failureThreshold);
+            mapping_ = addr;
+            mappingSize_ = fileSize;
+            likelihoods_ = (const double *)((const char *)addr + sizeof(Header));
+            return true;
+        }
+
+        /**
+         * @brief Saves the table to a model file.
+         * @param filePath The path of the model file.
+         * @return True if the file was written, false otherwise.
+         */
+        bool save(const std::string &filePath)
+        {
+            if (!isLoaded())
+                return false;
+            FILE *fp = fopen(filePath.c_str(), "wb");
+            if (fp == NULL)
+                return false;
+
+            Header header;
+            memset(&header, 0, sizeof(Header));
+            memcpy(header.magic, "ALSMAEC", 8);
+            header.byteOrderMark = BYTE_ORDER_MARK;
+            header.version = VERSION;
+            header.nodesNum = nodesNum_;
+            header.maeMin = maeMin_;
+            header.maeStep = maeStep_;
+            header.maxResidualError = maxResidualError_;
+            header.failureThreshold = failureThreshold_;
+            bool isWritten = fwrite(&header, sizeof(Header), 1, fp) == 1;
+            isWritten = isWritten && fwrite(likelihoods_, sizeof(double), 2 * (size_t)nodesNum_, fp) == 2 * (size_t)nodesNum_;
+            return (fclose(fp) == 0) && isWritten;
+        }
+    }; // class MAEDecisionTable
+
+} // namespace als_ros2
+
+#endif // __MAE_DECISION_TABLE_H__
@@ -0,0 +1,165 @@
+/****************************************************************************
+ * als_ros: An Advanced Localization System for ROS use with 2D LiDAR
+ * Copyright (C) 2022 Naoki Akai
+ *
+ * Licensed under the Apache License, Version 2.0 (the “License”);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an “AS IS” BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @author Naoki Akai
+ * modified by: Roald Ong
+ ****************************************************************************/
+
+#ifndef __MASKED_MEAN_H__
+#define __MASKED_MEAN_H__
+
+#include <cstddef>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace als_ros2
+{
+
+    /**
+     * @brief Sum and count of the values of an array that lie in [0, maxVal].
+     *
+     * The values are accumulated in double precision, four (AVX2) or two (NEON) at a time with
+     * two accumulators each, so float input gives the same result as its conversion to double
+     * up to the summation order. NaNs fail both comparisons and are not counted.
+     */
+    class MaskedMean
+    {
+    private:
+#if defined(__AVX2__)
+        static inline __m256d mask(__m256d x, __m256d vzero, __m256d vmax)
+        {
+            return _mm256_and_pd(_mm256_cmp_pd(x, vzero, _CMP_GE_OQ), _mm256_cmp_pd(x, vmax, _CMP_LE_OQ));
+        }
+
+        static inline void accumulate(__m256d x, __m256d vzero, __m256d vmax, __m256d vone, __m256d &sum, __m256d &count)
+        {
+            __m256d m = mask(x, vzero, vmax);
+            sum = _mm256_add_pd(sum, _mm256_and_pd(x, m));
+            count = _mm256_add_pd(count, _mm256_and_pd(vone, m));
+        }
+
+        static inline double reduce(__m256d v)
+        {
+            __m128d v2 = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+            return _mm_cvtsd_f64(_mm_add_sd(v2, _mm_unpackhi_pd(v2, v2)));
+        }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+        static inline void accumulate(float64x2_t x, float64x2_t vzero, float64x2_t vmax, float64x2_t vone, float64x2_t &sum, float64x2_t &count)
+        {
+            uint64x2_t m = vandq_u64(vcgeq_f64(x, vzero), vcleq_f64(x, vmax));
+            sum = vaddq_f64(sum, vreinterpretq_f64_u64(vandq_u64(vreinterpretq_u64_f64(x), m)));
+            count = vaddq_f64(count, vreinterpretq_f64_u64(vandq_u64(vreinterpretq_u64_f64(vone), m)));
+        }
+#endif
+
+        template <typename T>
+        static inline void accumulateTail(const T *vals, size_t begin, size_t num, double maxVal, double &sum, double &count)
+        {
+            for (size_t i = begin; i < num; ++i)
+            {
+                double x = (double)vals[i];
+                if (0.0 <= x && x <= maxVal)
+                {
+                    sum += x;
+                    count += 1.0;
+                }
+            }
+        }
+
+    public:
+        /**
+         * @brief Sums the values in [0, maxVal].
+         * @param vals The values.
+         * @param num The number of values.
+         * @param maxVal The upper bound of the summed values.
+         * @param total The sum of the values in the range.
+         * @param count The number of values in the range.
+         */
+        static void sum(const double *vals, size_t num, double maxVal, double *total, int *count)
+        {
+            size_t i = 0;
+            double s = 0.0, c = 0.0;
+#if defined(__AVX2__)
+            __m256d vzero = _mm256_setzero_pd(), vmax = _mm256_set1_pd(maxVal), vone = _mm256_set1_pd(1.0);
+            __m256d sum0 = _mm256_setzero_pd(), sum1 = _mm256_setzero_pd();
+            __m256d count0 = _mm256_setzero_pd(), count1 = _mm256_setzero_pd();
+            for (; i + 8 <= num; i += 8)
+            {
+                accumulate(_mm256_loadu_pd(&vals[i]), vzero, vmax, vone, sum0, count0);
+                accumulate(_mm256_loadu_pd(&vals[i + 4]), vzero, vmax, vone, sum1, count1);
+            }
+            s = reduce(_mm256_add_pd(sum0, sum1));
+            c = reduce(_mm256_add_pd(count0, count1));
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+            float64x2_t vzero = vdupq_n_f64(0.0), vmax = vdupq_n_f64(maxVal), vone = vdupq_n_f64(1.0);
+            float64x2_t sum0 = vzero, sum1 = vzero, count0 = vzero, count1 = vzero;
+            for (; i + 4 <= num; i += 4)
+            {
+                accumulate(vld1q_f64(&vals[i]), vzero, vmax, vone, sum0, count0);
+                accumulate(vld1q_f64(&vals[i + 2]), vzero, vmax, vone, sum1, count1);
+            }
+            s = vaddvq_f64(vaddq_f64(sum0, sum1));
+            c = vaddvq_f64(vaddq_f64(count0, count1));
+#endif
+            accumulateTail(vals, i, num, maxVal, s, c);
+            *total = s;
+            *count = (int)c;
+        }
+
+        /**
+         * @brief Same as above for float values.
+         */
+        static void sum(const float *vals, size_t num, double maxVal, double *total, int *count)
+        {
+            size_t i = 0;
+            double s = 0.0, c = 0.0;
+#if defined(__AVX2__)
+            __m256d vzero = _mm256_setzero_pd(), vmax = _mm256_set1_pd(maxVal), vone = _mm256_set1_pd(1.0);
+            __m256d sum0 = _mm256_setzero_pd(), sum1 = _mm256_setzero_pd();
+            __m256d count0 = _mm256_setzero_pd(), count1 = _mm256_setzero_pd();
+            for (; i + 8 <= num; i += 8)
+            {
+                __m256 x = _mm256_loadu_ps(&vals[i]);
+                accumulate(_mm256_cvtps_pd(_mm256_castps256_ps128(x)), vzero, vmax, vone, sum0, count0);
+                accumulate(_mm256_cvtps_pd(_mm256_extractf128_ps(x, 1)), vzero, vmax, vone, sum1, count1);
+            }
+            s = reduce(_mm256_add_pd(sum0, sum1));
+            c = reduce(_mm256_add_pd(count0, count1));
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+            float64x2_t vzero = vdupq_n_f64(0.0), vmax = vdupq_n_f64(maxVal), vone = vdupq_n_f64(1.0);
+            float64x2_t sum0 = vzero, sum1 = vzero, count0 = vzero, count1 = vzero;
+            for (; i + 4 <= num; i += 4)
+            {
+                float32x4_t x = vld1q_f32(&vals[i]);
+                accumulate(vcvt_f64_f32(vget_low_f32(x)), vzero, vmax, vone, sum0, count0);
+                accumulate(vcvt_high_f64_f32(x), vzero, vmax, vone, sum1, count1);
+            }
+            s = vaddvq_f64(vaddq_f64(sum0, sum1));
+            c = vaddvq_f64(vaddq_f64(count0, count1));
+#endif
+            accumulateTail(vals, i, num, maxVal, s, c);
+            *total = s;
+            *count = (int)c;
+        }
+    }; // class MaskedMean
+
+} // namespace als_ros2
+
+#endif // __MASKED_MEAN_H__
@@ -0,0 +1,255 @@
+/****************************************************************************
+ * als_ros: An Advanced Localization System for ROS use with 2D LiDAR
+ * Copyright (C) 2022 Naoki Akai
+ *
+ * Licensed under the Apache License, Version 2.0 (the “License”);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an “AS IS” BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @author Naoki Akai
+ * modified by: Roald Ong
+ ****************************************************************************/
+
+#ifndef __MATCHING_RATE_EVALUATOR_H__
+#define __MATCHING_RATE_EVALUATOR_H__
+
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <limits>
+#include <vector>
+#include "als_ros2/RayCaster.h"
+#include "als_ros2/Transform2D.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace als_ros2
+{
+
+    /**
+     * @brief Computes the matching rate of candidate poses against the matching rate lookup grid.
+     *
+     * The valid beams of a scan are stored once as a structure of arrays of end points, rotated
+     * by the laser yaw, in float precision. For every candidate, the pose and the map transform
+     * are folded into one 2D affine transform to grid coordinates, and the beams are transformed
+     * and looked up eight (AVX2) or four (NEON) at a time. A candidate is rejected early once it
+     * can no longer reach the threshold even if all remaining beams match.
+     */
+    class MatchingRateEvaluator
+    {
+    private:
+        static const int BLOCK_SIZE = 8;
+        static const int REJECTION_CHECK_INTERVAL = 64; // beams between early rejection checks
+
+        const uint8_t *grid_;
+        int width_, height_;
+        int maxValue_; // value of a fully matched beam
+        GridTransform mapTransform_;
+
+        std::vector<float> px_, py_; // padded to a multiple of BLOCK_SIZE with NaN
+        int beamsNum_;
+        double offsetX_, offsetY_;
+        BeamTable beamTable_;
+
+        inline void computeTransform(double x, double y, double yaw, float *a, float *b, float *u0, float *v0)
+        {
+            Transform2D &origin = mapTransform_.getOrigin();
+            double invResolution = mapTransform_.getInvResolution();
+            double c = cos(yaw), s = sin(yaw);
+            double gu, gv;
+            mapTransform_.xy2grid(x + offsetX_, y + offsetY_, &gu, &gv);
+            *a = (float)((c * origin.getCos() + s * origin.getSin()) * invResolution);
+            *b = (float)((s * origin.getCos() - c * origin.getSin()) * invResolution);
+            *u0 = (float)gu;
+            *v0 = (float)gv;
+        }
+
+        // returns the sum of the grid values of the beams in [begin, end)
+        inline int sumBlocks(int begin, int end, float a, float b, float u0, float v0)
+        {
+            int sum = 0;
+#if defined(__AVX2__)
+            __m256 va = _mm256_set1_ps(a), vb = _mm256_set1_ps(b);
+            __m256 vu0 = _mm256_set1_ps(u0), vv0 = _mm256_set1_ps(v0);
+            __m256i vw = _mm256_set1_epi32(width_), vh = _mm256_set1_epi32(height_);
+            __m256i vminus1 = _mm256_set1_epi32(-1), vmask8 = _mm256_set1_epi32(0xFF);
+            __m256i acc = _mm256_setzero_si256();
+            for (int j = begin; j < end; j += 8)
+            {
+                __m256 px = _mm256_loadu_ps(&px_[j]), py = _mm256_loadu_ps(&py_[j]);
+                __m256 fu = _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(va, px), _mm256_mul_ps(vb, py)), vu0);
+                __m256 fv = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(vb, px), _mm256_mul_ps(va, py)), vv0);
+                __m256i iu = _mm256_cvttps_epi32(fu), iv = _mm256_cvttps_epi32(fv);
+                __m256i valid = _mm256_and_si256(_mm256_and_si256(_mm256_cmpgt_epi32(iu, vminus1), _mm256_cmpgt_epi32(vw, iu)),
+                                                 _mm256_and_si256(_mm256_cmpgt_epi32(iv, vminus1), _mm256_cmpgt_epi32(vh, iv)));
+                __m256i idx = _mm256_add_epi32(_mm256_mullo_epi32(iv, vw), iu);
+                __m256i vals = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), (const int *)grid_, idx, valid, 1);
+                acc = _mm256_add_epi32(acc, _mm256_and_si256(vals, vmask8));
+            }
+            __m128i acc4 = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+            acc4 = _mm_add_epi32(acc4, _mm_shuffle_epi32(acc4, _MM_SHUFFLE(1, 0, 3, 2)));
+            acc4 = _mm_add_epi32(acc4, _mm_shuffle_epi32(acc4, _MM_SHUFFLE(2, 3, 0, 1)));
+            sum = _mm_cvtsi128_si32(acc4);
+#elif defined(__ARM_NEON)
+            float32x4_t va = vdupq_n_f32(a), vb = vdupq_n_f32(b);
+            float32x4_t vu0 = vdupq_n_f32(u0), vv0 = vdupq_n_f32(v0);
+            int32_t iu[4], iv[4];
+            for (int j = begin; j < end; j += 4)
+            {
+                float32x4_t px = vld1q_f32(&px_[j]), py = vld1q_f32(&py_[j]);
+                float32x4_t fu = vaddq_f32(vsubq_f32(vmulq_f32(va, px), vmulq_f32(vb, py)), vu0);
+                float32x4_t fv = vaddq_f32(vaddq_f32(vmulq_f32(vb, px), vmulq_f32(va, py)), vv0);
+                vst1q_s32(iu, vcvtq_s32_f32(fu));
+                vst1q_s32(iv, vcvtq_s32_f32(fv));
+                for (int k = 0; k < 4; ++k)
+                {
+                    if (j + k < beamsNum_ && 0 <= iu[k] && iu[k] < width_ && 0 <= iv[k] && iv[k] < height_)
+                        sum += grid_[iv[k] * width_ + iu[k]];
+                }
+            }
+#else
+            for (int j = begin; j < end && j < beamsNum_; ++j)
+            {
+                float fu = a * px_[j] - b * py_[j] + u0;
+                float fv = b * px_[j] + a * py_[j] + v0;
+                if (-1.0f < fu && fu < (float)width_ && -1.0f < fv && fv < (float)height_)
+                    sum += grid_[(int)fv * width_ + (int)fu];
+            }
+#endif
+            return sum;
+        }
+
+    public:
+        MatchingRateEvaluator(void) : grid_(NULL), width_(0), height_(0), maxValue_(1), beamsNum_(0), offsetX_(0.0), offsetY_(0.0) {}
+
+        /**
+         * @brief Sets the matching rate lookup grid.
+         * @param grid The row-major grid, followed by at least 4 padding bytes.
+         * @param width The number of columns of the grid.
+         * @param height The number of rows of the grid.
+         * @param maxValue The grid value of a fully matched beam.
+         * @param mapTransform The origin and the cell size of the grid.
+         */
+        void setMap(const uint8_t *grid, int width, int height, int maxValue, GridTransform mapTransform)
+        {
+            grid_ = grid;
+            width_ = width, height_ = height;
+            maxValue_ = maxValue;
+            mapTransform_ = mapTransform;
+        }
+
+        /**
+         * @brief Sets the scan that is evaluated for the candidate poses.
+         * @param ranges The ranges of the scan.
+         * @param angleMin The angle of the first beam [rad].
+         * @param angleIncrement The angle increment between beams [rad].
+         * @param rangeMin The minimum valid range [m].
+         * @param rangeMax The maximum valid range [m].
+         * @param minDist Beams that are shorter than this are ignored [m].
+         * @param baseLink2Laser The pose of the laser in the base link frame.
+         * @param isReversed If true, beam j is read from ranges[n - 1 - j].
+         */
+        void setScan(const std::vector<float> &ranges, double angleMin, double angleIncrement, double rangeMin, double rangeMax,
+                     double minDist, Transform2D baseLink2Laser, bool isReversed)
+        {
+            double c = baseLink2Laser.getCos(), s = baseLink2Laser.getSin();
+            baseLink2Laser.rotate(baseLink2Laser.getX(), baseLink2Laser.getY(), &offsetX_, &offsetY_);
+
+            int num = (int)ranges.size();
+            beamTable_.update(angleMin, angleIncrement, num);
+            px_.resize(num + BLOCK_SIZE);
+            py_.resize(num + BLOCK_SIZE);
+            beamsNum_ = 0;
+            for (int j = 0; j < num; ++j)
+            {
+                double r = ranges[isReversed ? num - 1 - j : j];
+                if (r < rangeMin || rangeMax < r)
+                    continue;
+                if (r < minDist)
+                    continue;
+                double bc = beamTable_.getCos(j), bs = beamTable_.getSin(j);
+                px_[beamsNum_] = (float)(r * (bc * c - bs * s));
+                py_[beamsNum_] = (float)(r * (bs * c + bc * s));
+                beamsNum_++;
+            }
+            int paddedNum = (beamsNum_ + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+            px_.resize(paddedNum);
+            py_.resize(paddedNum);
+            for (int j = beamsNum_; j < paddedNum; ++j)
+                px_[j] = py_[j] = std::numeric_limits<float>::quiet_NaN();
+        }
+
+        inline int getValidBeamsNum(void) { return beamsNum_; }
+
+        /**
+         * @brief Computes the matching rate of a pose.
+         * @param x The x coordinate of the base link [m].
+         * @param y The y coordinate of the base link [m].
+         * @param yaw The yaw angle of the base link [rad].
+         * @return The matching rate.
+         */
+        double computeMatchingRate(double x, double y, double yaw)
+        {
+            float a, b, u0, v0;
+            computeTransform(x, y, yaw, &a, &b, &u0, &v0);
+            int sum = sumBlocks(0, (int)px_.size(), a, b, u0, v0);
+            return (double)sum / ((double)maxValue_ * (double)beamsNum_);
+        }
+
+        /**
+         * @brief Computes the matching rates of candidate poses.
+         *
+         * When a candidate cannot reach the threshold, its evaluation is stopped and an upper bound
+         * of its matching rate, which is smaller than the threshold, is returned instead.
+         *
+         * @param num The number of candidates.
+         * @param xs The x coordinates of the candidates [m].
+         * @param ys The y coordinates of the candidates [m].
+         * @param yaws The yaw angles of the candidates [rad].
+         * @param threshold The matching rate threshold.
+         * @param rates The matching rates of the candidates.
+         */
+        void computeMatchingRates(int num, const double *xs, const double *ys, const double *yaws, double threshold, double *rates)
+        {
+            int paddedNum = (int)px_.size();
+            double denominator = (double)maxValue_ * (double)beamsNum_;
+            for (int i = 0; i < num; ++i)
+            {
+                float a, b, u0, v0;
+                computeTransform(xs[i], ys[i], yaws[i], &a, &b, &u0, &v0);
+                int sum = 0;
+                bool isRejected = false;
+                for (int begin = 0; begin < paddedNum; begin += REJECTION_CHECK_INTERVAL)
+                {
+                    int end = std::min(begin + REJECTION_CHECK_INTERVAL, paddedNum);
+                    sum += sumBlocks(begin, end, a, b, u0, v0);
+                    int remainingNum = std::max(beamsNum_ - end, 0);
+                    double upperBound = (double)(sum + remainingNum * maxValue_) / denominator;
+                    if (upperBound < threshold)
+                    {
+                        rates[i] = upperBound;
+                        isRejected = true;
+                        break;
+                    }
+                }
+                if (!isRejected)
+                    rates[i] = (double)sum / denominator;
+            }
+        }
+    }; // class MatchingRateEvaluator
+
+} // namespace als_ros2
+
+#endif // __MATCHING_RATE_EVALUATOR_H__
@@ -45,7 +45,7 @@ namespace als_ros2
          *
          * Initializes the pose to (0, 0, 0) and the weight to 0.
          */
-        Particle() : pose_(0.0, 0.0, 0.0), w_(0.0){};
+        constexpr Particle() : pose_(0.0, 0.0, 0.0), w_(0.0){};
 
         /**
          * @brief Constructor with pose and weight parameters.
@@ -55,7 +55,7 @@ namespace als_ros2
          * @param yaw The yaw angle of the pose.
          * @param w The weight of the particle.
          */
-        Particle(double x, double y, double yaw, double w) : pose_(x, y, yaw), w_(w){};
+        constexpr Particle(double x, double y, double yaw, double w) : pose_(x, y, yaw), w_(w){};
 
         /**
          * @brief Constructor with pose and weight parameters.
@@ -63,47 +63,42 @@ namespace als_ros2
          * @param p The pose of the particle.
          * @param w The weight of the particle.
          */
-        Particle(Pose p, double w) : pose_(p), w_(w){};
-
-        /**
-         * @brief Destructor.
-         */
-        ~Particle(){};
+        constexpr Particle(const Pose &p, double w) : pose_(p), w_(w){};
 
         /**
          * @brief Get the x-coordinate of the particle's pose.
          *
          * @return The x-coordinate.
          */
-        inline double getX(void) { return pose_.getX(); }
+        constexpr double getX(void) const { return pose_.getX(); }
 
         /**
          * @brief Get the y-coordinate of the particle's pose.
          *
          * @return The y-coordinate.
          */
-        inline double getY(void) { return pose_.getY(); }
+        constexpr double getY(void) const { return pose_.getY(); }
 
         /**
          * @brief Get the yaw angle of the particle's pose.
          *
          * @return The yaw angle.
          */
-        inline double getYaw(void) { return pose_.getYaw(); }
+        constexpr double getYaw(void) const { return pose_.getYaw(); }
 
         /**
          * @brief Get the pose of the particle.
          *
          * @return The pose.
          */
-        inline Pose getPose(void) { return pose_; }
+        constexpr Pose getPose(void) const { return pose_; }
 
         /**
          * @brief Get the weight of the particle.
          *
          * @return The weight.
          */
-        inline double getW(void) { return w_; }
+        constexpr double getW(void) const { return w_; }
 
         /**
          * @brief Set the x-coordinate of the particle's pose.
@@ -140,7 +135,7 @@ namespace als_ros2
          *
          * @param p The new pose.
          */
-        inline void setPose(Pose p) { pose_.setPose(p); }
+        inline void setPose(const Pose &p) { pose_.setPose(p); }
 
         /**
          * @brief Set the weight of the particle.
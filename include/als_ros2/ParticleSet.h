@@ -0,0 +1,353 @@
+/****************************************************************************
+ * als_ros: An Advanced Localization System for ROS use with 2D LiDAR
+ * Copyright (C) 2022 Naoki Akai
+ *
+ * Licensed under the Apache License, Version 2.0 (the “License”);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an “AS IS” BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @author Naoki Akai
+ * modified by: Roald Ong
+ ****************************************************************************/
+
+#ifndef __PARTICLE_SET_H__
+#define __PARTICLE_SET_H__
+
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <new>
+#include <vector>
+#include <geometry_msgs/msg/pose_array.hpp>
+#include "als_ros2/Pose.h"
+#include "als_ros2/Particle.h"
+#include "als_ros2/MaskedMean.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace als_ros2
+{
+
+    /**
+     * @brief Allocator of cache line aligned arrays.
+     */
+    template <typename T>
+    struct AlignedAllocator
+    {
+        typedef T value_type;
+        static constexpr size_t ALIGNMENT = 64;
+
+        AlignedAllocator(void) {}
+        template <typename U>
+        AlignedAllocator(const AlignedAllocator<U> &) {}
+
+        T *allocate(size_t n) { return static_cast<T *>(::operator new(n * sizeof(T), std::align_val_t(ALIGNMENT))); }
+        void deallocate(T *p, size_t) { ::operator delete(p, std::align_val_t(ALIGNMENT)); }
+
+        template <typename U>
+        bool operator==(const AlignedAllocator<U> &) const { return true; }
+        template <typename U>
+        bool operator!=(const AlignedAllocator<U> &) const { return false; }
+    }; // struct AlignedAllocator
+
+    /**
+     * @brief Particles of a particle filter stored as a structure of arrays.
+     *
+     * The x, y, yaw, and weight of the particles are held in separate cache line aligned arrays
+     * in double or float precision, so motion and measurement models can run over the raw
+     * arrays and the weight reductions run four (AVX2) or two (NEON) values at a time. The
+     * reductions accumulate in double precision for both element types. Setting a pose does not
+     * wrap its yaw; normalizeYaws wraps all of them in one pass.
+     */
+    template <typename T = double>
+    class ParticleSet
+    {
+    public:
+        typedef std::vector<T, AlignedAllocator<T>> Array;
+
+    private:
+        Array xs_, ys_, yaws_, ws_;
+        Array resampledXs_, resampledYs_, resampledYaws_; // swapped with the poses by resampling
+
+#if defined(__AVX2__)
+        static inline double reduce(__m256d v)
+        {
+            __m128d v2 = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+            return _mm_cvtsd_f64(_mm_add_sd(v2, _mm_unpackhi_pd(v2, v2)));
+        }
+#endif
+
+#if defined(__AVX2__)
+        static inline __m256d squareInRange(__m256d x, __m256d vzero, __m256d vmax)
+        {
+            __m256d m = _mm256_and_pd(_mm256_cmp_pd(x, vzero, _CMP_GE_OQ), _mm256_cmp_pd(x, vmax, _CMP_LE_OQ));
+            x = _mm256_and_pd(x, m);
+            return _mm256_mul_pd(x, x);
+        }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+        static inline float64x2_t squareInRange(float64x2_t x, float64x2_t vzero, float64x2_t vmax)
+        {
+            uint64x2_t m = vandq_u64(vcgeq_f64(x, vzero), vcleq_f64(x, vmax));
+            x = vreinterpretq_f64_u64(vandq_u64(vreinterpretq_u64_f64(x), m));
+            return vmulq_f64(x, x);
+        }
+#endif
+
+        // the sum of the squares of the values in [0, maxVal], the same values that MaskedMean::sum adds
+        static double sumSquares(const double *vals, size_t num, double maxVal)
+        {
+            size_t i = 0;
+            double s = 0.0;
+#if defined(__AVX2__)
+            __m256d vzero = _mm256_setzero_pd(), vmax = _mm256_set1_pd(maxVal);
+            __m256d sum0 = _mm256_setzero_pd(), sum1 = _mm256_setzero_pd();
+            for (; i + 8 <= num; i += 8)
+            {
+                sum0 = _mm256_add_pd(sum0, squareInRange(_mm256_loadu_pd(&vals[i]), vzero, vmax));
+                sum1 = _mm256_add_pd(sum1, squareInRange(_mm256_loadu_pd(&vals[i + 4]), vzero, vmax));
+            }
+            s = reduce(_mm256_add_pd(sum0, sum1));
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+            float64x2_t vzero = vdupq_n_f64(0.0), vmax = vdupq_n_f64(maxVal);
+            float64x2_t sum0 = vzero, sum1 = vzero;
+            for (; i + 4 <= num; i += 4)
+            {
+                sum0 = vaddq_f64(sum0, squareInRange(vld1q_f64(&vals[i]), vzero, vmax));
+                sum1 = vaddq_f64(sum1, squareInRange(vld1q_f64(&vals[i + 2]), vzero, vmax));
+            }
+            s = vaddvq_f64(vaddq_f64(sum0, sum1));
+#endif
+            for (; i < num; ++i)
+            {
+                if (0.0 <= vals[i] && vals[i] <= maxVal)
+                    s += vals[i] * vals[i];
+            }
+            return s;
+        }
+
+        static double sumSquares(const float *vals, size_t num, double maxVal)
+        {
+            size_t i = 0;
+            double s = 0.0;
+#if defined(__AVX2__)
+            __m256d vzero = _mm256_setzero_pd(), vmax = _mm256_set1_pd(maxVal);
+            __m256d sum0 = _mm256_setzero_pd(), sum1 = _mm256_setzero_pd();
+            for (; i + 8 <= num; i += 8)
+            {
+                __m256 x = _mm256_loadu_ps(&vals[i]);
+                sum0 = _mm256_add_pd(sum0, squareInRange(_mm256_cvtps_pd(_mm256_castps256_ps128(x)), vzero, vmax));
+                sum1 = _mm256_add_pd(sum1, squareInRange(_mm256_cvtps_pd(_mm256_extractf128_ps(x, 1)), vzero, vmax));
+            }
+            s = reduce(_mm256_add_pd(sum0, sum1));
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+            float64x2_t vzero = vdupq_n_f64(0.0), vmax = vdupq_n_f64(maxVal);
+            float64x2_t sum0 = vzero, sum1 = vzero;
+            for (; i + 4 <= num; i += 4)
+            {
+                float32x4_t x = vld1q_f32(&vals[i]);
+                sum0 = vaddq_f64(sum0, squareInRange(vcvt_f64_f32(vget_low_f32(x)), vzero, vmax));
+                sum1 = vaddq_f64(sum1, squareInRange(vcvt_high_f64_f32(x), vzero, vmax));
+            }
+            s = vaddvq_f64(vaddq_f64(sum0, sum1));
+#endif
+            for (; i < num; ++i)
+            {
+                double x = (double)vals[i];
+                if (0.0 <= x && x <= maxVal)
+                    s += x * x;
+            }
+            return s;
+        }
+
+        // the sum of the finite non-negative weights
+        inline double sumWeights(void) const
+        {
+            double sum;
+            int count;
+            MaskedMean::sum(ws_.data(), ws_.size(), (double)std::numeric_limits<T>::max(), &sum, &count);
+            return sum;
+        }
+
+    public:
+        ParticleSet(void) {}
+
+        explicit ParticleSet(size_t num) { resize(num); }
+
+        /**
+         * @brief Resizes the set. Added particles are at the origin with a weight of 0.
+         * @param num The number of particles.
+         */
+        void resize(size_t num)
+        {
+            xs_.resize(num, (T)0);
+            ys_.resize(num, (T)0);
+            yaws_.resize(num, (T)0);
+            ws_.resize(num, (T)0);
+        }
+
+        inline size_t size(void) const { return xs_.size(); }
+        inline bool empty(void) const { return xs_.empty(); }
+
+        inline T getX(size_t i) const { return xs_[i]; }
+        inline T getY(size_t i) const { return ys_[i]; }
+        inline T getYaw(size_t i) const { return yaws_[i]; }
+        inline T getW(size_t i) const { return ws_[i]; }
+        inline Pose getPose(size_t i) const { return Pose((double)xs_[i], (double)ys_[i], (double)yaws_[i]); }
+        inline Particle getParticle(size_t i) const { return Particle((double)xs_[i], (double)ys_[i], (double)yaws_[i], (double)ws_[i]); }
+
+        inline void setPose(size_t i, T x, T y, T yaw) { xs_[i] = x, ys_[i] = y, yaws_[i] = yaw; }
+        inline void setW(size_t i, T w) { ws_[i] = w; }
+        inline void setParticle(size_t i, const Particle &p) { setPose(i, (T)p.getX(), (T)p.getY(), (T)p.getYaw()), ws_[i] = (T)p.getW(); }
+
+        inline T *getXs(void) { return xs_.data(); }
+        inline T *getYs(void) { return ys_.data(); }
+        inline T *getYaws(void) { return yaws_.data(); }
+        inline T *getWs(void) { return ws_.data(); }
+        inline const T *getXs(void) const { return xs_.data(); }
+        inline const T *getYs(void) const { return ys_.data(); }
+        inline const T *getYaws(void) const { return yaws_.data(); }
+        inline const T *getWs(void) const { return ws_.data(); }
+
+        /**
+         * @brief Wraps the yaw angles of all particles into [-pi, pi].
+         */
+        void normalizeYaws(void)
+        {
+            T *yaws = yaws_.data();
+            for (size_t i = 0; i < yaws_.size(); ++i)
+                yaws[i] = Pose::normalizeYaw(yaws[i]);
+        }
+
+        /**
+         * @brief Sets all weights to 1 / n.
+         */
+        void setUniformWeights(void)
+        {
+            if (!ws_.empty())
+                ws_.assign(ws_.size(), (T)(1.0 / (double)ws_.size()));
+        }
+
+        /**
+         * @brief Normalizes the weights to a sum of 1.
+         *
+         * Negative, infinite, and NaN weights are set to 0. If no weight is left, the weights
+         * are set to 1 / n.
+         *
+         * @return The sum of the weights before the normalization.
+         */
+        double normalizeWeights(void)
+        {
+            double sum = sumWeights();
+            if (!(sum > 0.0) || !std::isfinite(sum))
+            {
+                setUniformWeights();
+                return sum;
+            }
+            T scale = (T)(1.0 / sum), maxW = std::numeric_limits<T>::max();
+            T *ws = ws_.data();
+            for (size_t i = 0; i < ws_.size(); ++i)
+            {
+                T w = ws[i];
+                ws[i] = ((T)0 <= w && w <= maxW) ? w * scale : (T)0;
+            }
+            return sum;
+        }
+
+        /**
+         * @brief Computes the effective sample size (sum w)^2 / sum w^2 of the finite non-negative weights.
+         * @return The effective sample size, 0 if all weights are 0.
+         */
+        double computeEffectiveSampleSize(void) const
+        {
+            double sum = sumWeights();
+            double squaresSum = sumSquares(ws_.data(), ws_.size(), (double)std::numeric_limits<T>::max());
+            if (!(squaresSum > 0.0) || !std::isfinite(squaresSum))
+                return 0.0;
+            return sum * sum / squaresSum;
+        }
+
+        /**
+         * @brief Resamples the particles with systematic resampling and sets the weights to 1 / n.
+         *
+         * Particle i of the new set is the particle whose cumulative weight interval contains
+         * (i + u) / n of the weight sum, so the resampling needs one uniform number and one pass.
+         * The weights must be finite and non-negative, which normalizeWeights ensures.
+         *
+         * @param u A uniform random number in [0, 1).
+         */
+        void resampleSystematic(double u)
+        {
+            size_t num = size();
+            if (num == 0)
+                return;
+            double sum = sumWeights();
+            if (!(sum > 0.0) || !std::isfinite(sum))
+            {
+                setUniformWeights();
+                return;
+            }
+
+            resampledXs_.resize(num);
+            resampledYs_.resize(num);
+            resampledYaws_.resize(num);
+            double step = sum / (double)num;
+            double cumulativeW = (double)ws_[0];
+            size_t j = 0;
+            for (size_t i = 0; i < num; ++i)
+            {
+                double target = ((double)i + u) * step;
+                while (cumulativeW <= target && j + 1 < num)
+                    cumulativeW += (double)ws_[++j];
+                resampledXs_[i] = xs_[j];
+                resampledYs_[i] = ys_[j];
+                resampledYaws_[i] = yaws_[j];
+            }
+            xs_.swap(resampledXs_);
+            ys_.swap(resampledYs_);
+            yaws_.swap(resampledYaws_);
+            setUniformWeights();
+        }
+
+        /**
+         * @brief Writes the poses to a pose array. The header is left to the caller.
+         *
+         * The orientation of a pose with only a yaw angle is (0, 0, sin(yaw / 2), cos(yaw / 2)),
+         * so it is written directly instead of through a tf2 quaternion built from roll, pitch,
+         * and yaw.
+         *
+         * @param poses The pose array.
+         */
+        void toPoseArray(geometry_msgs::msg::PoseArray &poses) const
+        {
+            size_t num = size();
+            poses.poses.resize(num);
+            for (size_t i = 0; i < num; ++i)
+            {
+                geometry_msgs::msg::Pose &pose = poses.poses[i];
+                double halfYaw = 0.5 * (double)yaws_[i];
+                pose.position.x = (double)xs_[i];
+                pose.position.y = (double)ys_[i];
+                pose.position.z = 0.0;
+                pose.orientation.x = 0.0;
+                pose.orientation.y = 0.0;
+                pose.orientation.z = sin(halfYaw);
+                pose.orientation.w = cos(halfYaw);
+            }
+        }
+    }; // class ParticleSet
+
+} // namespace als_ros2
+
+#endif // __PARTICLE_SET_H__
@@ -37,19 +37,31 @@ namespace als_ros2
         /**
          * @brief Modifies the yaw angle to be within the range [-pi, pi].
          */
-        void modifyYaw(void)
+        inline void modifyYaw(void) { yaw_ = normalizeYaw(yaw_); }
+
+    public:
+        /**
+         * @brief Wraps an angle into [-pi, pi] without a loop.
+         *
+         * The number of turns is rounded to the nearest integer with std::rint and subtracted, so
+         * the cost does not depend on the angle and the rounding compiles to an instruction
+         * without a branch. A NaN angle, e.g. the yaw of a degenerate quaternion, stays NaN, and
+         * angles at +-pi may end up one rounding step outside the range.
+         *
+         * @param yaw The angle [rad].
+         * @return The wrapped angle [rad].
+         */
+        template <typename T>
+        static inline T normalizeYaw(T yaw)
         {
-            while (yaw_ < -M_PI)
-                yaw_ += 2.0 * M_PI;
-            while (yaw_ > M_PI)
-                yaw_ -= 2.0 * M_PI;
+            T turns = yaw * (T)(0.5 / M_PI);
+            return yaw - std::rint(turns) * (T)(2.0 * M_PI);
         }
 
-    public:
         /**
          * @brief Default constructor. Initializes the pose with zero values.
          */
-        Pose() : x_(0.0), y_(0.0), yaw_(0.0){};
+        constexpr Pose() : x_(0.0), y_(0.0), yaw_(0.0){};
 
         /**
          * @brief Constructor that initializes the pose with the given values.
@@ -57,12 +69,7 @@ namespace als_ros2
          * @param y The y-coordinate of the pose.
          * @param yaw The yaw angle of the pose.
          */
-        Pose(double x, double y, double yaw) : x_(x), y_(y), yaw_(yaw){};
-
-        /**
-         * @brief Destructor.
-         */
-        ~Pose(){};
+        constexpr Pose(double x, double y, double yaw) : x_(x), y_(y), yaw_(yaw){};
 
         /**
          * @brief Sets the x-coordinate of the pose.
@@ -94,31 +101,31 @@ namespace als_ros2
          * @brief Sets the pose with the values from another pose.
          * @param p The pose to copy the values from.
          */
-        inline void setPose(Pose p) { x_ = p.x_, y_ = p.y_, yaw_ = p.yaw_, modifyYaw(); }
+        inline void setPose(const Pose &p) { x_ = p.x_, y_ = p.y_, yaw_ = p.yaw_, modifyYaw(); }
 
         /**
          * @brief Gets the x-coordinate of the pose.
          * @return The x-coordinate.
          */
-        inline double getX(void) { return x_; }
+        constexpr double getX(void) const { return x_; }
 
         /**
          * @brief Gets the y-coordinate of the pose.
          * @return The y-coordinate.
          */
-        inline double getY(void) { return y_; }
+        constexpr double getY(void) const { return y_; }
 
         /**
          * @brief Gets the yaw angle of the pose.
          * @return The yaw angle.
          */
-        inline double getYaw(void) { return yaw_; }
+        constexpr double getYaw(void) const { return yaw_; }
 
         /**
          * @brief Gets a copy of the pose.
          * @return A new pose object with the same values.
          */
-        inline Pose getPose(void) { return Pose(x_, y_, yaw_); }
+        constexpr Pose getPose(void) const { return Pose(x_, y_, yaw_); }
 
     }; // class Pose
 
@@ -0,0 +1,144 @@
+/****************************************************************************
+ * als_ros: An Advanced Localization System for ROS use with 2D LiDAR
+ * Copyright (C) 2022 Naoki Akai
+ *
+ * Licensed under the Apache License, Version 2.0 (the “License”);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an “AS IS” BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @author Naoki Akai
+ * modified by: Roald Ong
+ ****************************************************************************/
+
+#ifndef __RAY_CASTER_H__
+#define __RAY_CASTER_H__
+
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+namespace als_ros2
+{
+
+    /**
+     * @brief Table of the cosine and sine of the beam angles of a scan.
+     *
+     * The table depends only on the scan geometry, so it is rebuilt only when the first angle,
+     * the angle increment, or the number of beams changes. The direction of beam j rotated by
+     * the sensor yaw is obtained with two multiplications instead of calling cos and sin.
+     */
+    class BeamTable
+    {
+    private:
+        double angleMin_, angleIncrement_;
+        int beamsNum_;
+        std::vector<double> cos_, sin_;
+
+    public:
+        BeamTable(void) : angleMin_(0.0), angleIncrement_(0.0), beamsNum_(-1) {}
+
+        /**
+         * @brief Rebuilds the table if the scan geometry changed.
+         * @param angleMin The angle of the first beam [rad].
+         * @param angleIncrement The angle increment between beams [rad].
+         * @param beamsNum The number of beams.
+         */
+        void update(double angleMin, double angleIncrement, int beamsNum)
+        {
+            if (angleMin == angleMin_ && angleIncrement == angleIncrement_ && beamsNum == beamsNum_)
+                return;
+            angleMin_ = angleMin;
+            angleIncrement_ = angleIncrement;
+            beamsNum_ = beamsNum;
+            cos_.resize(beamsNum);
+            sin_.resize(beamsNum);
+            for (int j = 0; j < beamsNum; ++j)
+            {
+                double t = (double)j * angleIncrement + angleMin;
+                cos_[j] = cos(t);
+                sin_[j] = sin(t);
+            }
+        }
+
+        inline int getBeamsNum(void) { return beamsNum_; }
+        inline double getCos(int j) { return cos_[j]; }
+        inline double getSin(int j) { return sin_[j]; }
+        inline const double *getCosData(void) { return cos_.data(); }
+        inline const double *getSinData(void) { return sin_.data(); }
+    }; // class BeamTable
+
+    /**
+     * @brief Integer grid ray traversal used to build occupancy grids from scans.
+     */
+    class RayCaster
+    {
+    public:
+        /**
+         * @brief Visits the cells on the Bresenham line from (u0, v0) to (u1, v1), excluding (u1, v1).
+         * @param u0 The column of the start cell.
+         * @param v0 The row of the start cell.
+         * @param u1 The column of the end cell.
+         * @param v1 The row of the end cell.
+         * @param visit Called as visit(u, v) for every traversed cell.
+         */
+        template <typename Visitor>
+        static inline void traverse(int u0, int v0, int u1, int v1, Visitor visit)
+        {
+            int du = abs(u1 - u0), dv = -abs(v1 - v0);
+            int su = (u0 < u1) ? 1 : -1, sv = (v0 < v1) ? 1 : -1;
+            int err = du + dv;
+            while (u0 != u1 || v0 != v1)
+            {
+                visit(u0, v0);
+                int e2 = 2 * err;
+                if (e2 >= dv)
+                    err += dv, u0 += su;
+                if (e2 <= du)
+                    err += du, v0 += sv;
+            }
+        }
+
+        /**
+         * @brief Marks the cells from (u0, v0) to (u1, v1) as free and (u1, v1) as occupied.
+         * @param data The row-major occupancy values.
+         * @param width The number of columns of the grid.
+         * @param height The number of rows of the grid.
+         * @param u0 The column of the sensor cell.
+         * @param v0 The row of the sensor cell.
+         * @param u1 The column of the hit cell.
+         * @param v1 The row of the hit cell.
+         */
+        static inline void castRay(signed char *data, int width, int height, int u0, int v0, int u1, int v1)
+        {
+            traverse(u0, v0, u1, v1, [data, width, height](int u, int v)
+                     {
+                         if (0 <= u && u < width && 0 <= v && v < height)
+                             data[v * width + u] = 0; });
+            if (0 <= u1 && u1 < width && 0 <= v1 && v1 < height)
+                data[v1 * width + u1] = 100;
+        }
+
+        /**
+         * @brief Converts a metric coordinate to a cell index without a division.
+         * @param val The coordinate [m].
+         * @param origin The coordinate of the grid origin [m].
+         * @param invResolution The inverse of the grid resolution [1/m].
+         * @return The cell index.
+         */
+        static inline int toCell(double val, double origin, double invResolution)
+        {
+            return (int)floor((val - origin) * invResolution);
+        }
+    }; // class RayCaster
+
+} // namespace als_ros2
+
+#endif // __RAY_CASTER_H__
@@ -0,0 +1,281 @@
+/****************************************************************************
+ * als_ros: An Advanced Localization System for ROS use with 2D LiDAR
+ * Copyright (C) 2022 Naoki Akai
+ *
+ * Licensed under the Apache License, Version 2.0 (the “License”);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an “AS IS” BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @author Naoki Akai
+ * modified by: Roald Ong
+ ****************************************************************************/
+
+#ifndef __ROLLING_LOCAL_MAP_H__
+#define __ROLLING_LOCAL_MAP_H__
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <vector>
+#include "als_ros2/RayCaster.h"
+
+namespace als_ros2
+{
+
+    /**
+     * @brief Local occupancy grid that is updated incrementally from key scans.
+     *
+     * The grid keeps per-cell hit and free counts. Every key scan contributes at most one hit
+     * and one free count to a cell, and the cells it touched are remembered so that the scan
+     * can be subtracted again when it is evicted. The grid is addressed as a ring buffer over
+     * global cell indices, so moving the window only clears the cells that leave it; cells
+     * that leave the window are forgotten, as in a rolling window costmap.
+     */
+    class RollingLocalMap
+    {
+    private:
+        struct ScanCells
+        {
+            uint32_t stamp;              // stamp of the update that added the scan
+            std::vector<uint32_t> cells; // (slot << 1) | isHit
+        };
+
+        int size_;
+        double resolution_;
+        int originU_, originV_; // global cell index of the lower left cell of the window
+
+        std::vector<uint16_t> hitCounts_, freeCounts_;
+        std::vector<uint32_t> clearStamps_;
+        std::vector<uint32_t> visitStamps_;
+        std::vector<uint8_t> visitFlags_;
+        std::deque<ScanCells> scans_;
+        uint32_t stamp_;
+        BeamTable beamTable_;
+
+        inline int wrap(int g)
+        {
+            int m = g % size_;
+            return (m < 0) ? m + size_ : m;
+        }
+
+        inline int globalCell2Slot(int gu, int gv)
+        {
+            return wrap(gv) * size_ + wrap(gu);
+        }
+
+        inline void clearSlot(int slot)
+        {
+            hitCounts_[slot] = freeCounts_[slot] = 0;
+            clearStamps_[slot] = stamp_;
+        }
+
+        inline void visit(int gu, int gv, bool isHit, std::vector<uint32_t> &cells)
+        {
+            if (gu < originU_ || originU_ + size_ <= gu || gv < originV_ || originV_ + size_ <= gv)
+                return;
+            int slot = globalCell2Slot(gu, gv);
+            if (visitStamps_[slot] != stamp_)
+            {
+                visitStamps_[slot] = stamp_;
+                visitFlags_[slot] = 0;
+            }
+            uint8_t flag = isHit ? 2 : 1;
+            if (visitFlags_[slot] & flag)
+                return;
+            visitFlags_[slot] |= flag;
+            if (isHit)
+                hitCounts_[slot]++;
+            else
+                freeCounts_[slot]++;
+            cells.push_back(((uint32_t)slot << 1) | (isHit ? 1u : 0u));
+        }
+
+    public:
+        RollingLocalMap(void) : size_(0), resolution_(0.0), originU_(0), originV_(0), stamp_(0) {}
+
+        /**
+         * @brief Allocates the grid and forgets all scans.
+         * @param size The number of cells of each side of the window.
+         * @param resolution The cell size [m].
+         */
+        void reset(int size, double resolution)
+        {
+            size_ = size;
+            resolution_ = resolution;
+            originU_ = originV_ = 0;
+            stamp_ = 0;
+            hitCounts_.assign(size_ * size_, 0);
+            freeCounts_.assign(size_ * size_, 0);
+            clearStamps_.assign(size_ * size_, 0);
+            visitStamps_.assign(size_ * size_, 0);
+            visitFlags_.assign(size_ * size_, 0);
+            scans_.clear();
+        }
+
+        inline bool isInitialized(void) { return size_ > 0; }
+        inline int getSize(void) { return size_; }
+        inline double getResolution(void) { return resolution_; }
+        inline int getScansNum(void) { return (int)scans_.size(); }
+        inline double getOriginX(void) { return (double)originU_ * resolution_; }
+        inline double getOriginY(void) { return (double)originV_ * resolution_; }
+
+        /**
+         * @brief Moves the window so that its lower left corner is at the cell containing (x, y).
+         *
+         * Only the rows and columns that leave the window are cleared.
+         *
+         * @param x The x coordinate of the new lower left corner [m].
+         * @param y The y coordinate of the new lower left corner [m].
+         */
+        void moveTo(double x, double y)
+        {
+            int newOriginU = (int)floor(x / resolution_);
+            int newOriginV = (int)floor(y / resolution_);
+            int du = newOriginU - originU_;
+            int dv = newOriginV - originV_;
+            if (du == 0 && dv == 0)
+                return;
+
+            if (abs(du) >= size_ || abs(dv) >= size_)
+            {
+                for (int slot = 0; slot < size_ * size_; ++slot)
+                    clearSlot(slot);
+            }
+            else
+            {
+                // columns and rows of the old window that are not included in the new window
+                int uBegin = (du > 0) ? originU_ : newOriginU + size_;
+                int uEnd = (du > 0) ? newOriginU : originU_ + size_;
+                for (int gu = uBegin; gu < uEnd; ++gu)
+                {
+                    int su = wrap(gu);
+                    for (int sv = 0; sv < size_; ++sv)
+                        clearSlot(sv * size_ + su);
+                }
+                int vBegin = (dv > 0) ? originV_ : newOriginV + size_;
+                int vEnd = (dv > 0) ? newOriginV : originV_ + size_;
+                for (int gv = vBegin; gv < vEnd; ++gv)
+                {
+                    int sv = wrap(gv);
+                    for (int su = 0; su < size_; ++su)
+                        clearSlot(sv * size_ + su);
+                }
+            }
+            originU_ = newOriginU;
+            originV_ = newOriginV;
+        }
+
+        /**
+         * @brief Adds the rays of a scan to the grid.
+         * @param ranges The ranges of the scan.
+         * @param angleMin The angle of the first beam [rad].
+         * @param angleIncrement The angle increment between beams [rad].
+         * @param rangeMin The minimum valid range [m].
+         * @param rangeMax The maximum valid range [m].
+         * @param minDist Beams that are shorter than this are ignored [m].
+         * @param sensorX The x coordinate of the sensor [m].
+         * @param sensorY The y coordinate of the sensor [m].
+         * @param sensorYaw The yaw angle of the sensor [rad].
+         * @param isReversed If true, beam j is read from ranges[n - 1 - j].
+         */
+        void addScan(const std::vector<float> &ranges, double angleMin, double angleIncrement, double rangeMin, double rangeMax,
+                     double minDist, double sensorX, double sensorY, double sensorYaw, bool isReversed)
+        {
+            stamp_++;
+            ScanCells scan;
+            scan.stamp = stamp_;
+            double invResolution = 1.0 / resolution_;
+            double sc = cos(sensorYaw);
+            double ss = sin(sensorYaw);
+            int u0 = (int)floor(sensorX * invResolution);
+            int v0 = (int)floor(sensorY * invResolution);
+            int beamsNum = (int)ranges.size();
+            beamTable_.update(angleMin, angleIncrement, beamsNum);
+            for (int j = 0; j < beamsNum; ++j)
+            {
+                double range = ranges[isReversed ? beamsNum - 1 - j : j];
+                if (range < rangeMin || rangeMax < range)
+                    continue;
+                if (range < minDist)
+                    continue;
+
+                double bc = beamTable_.getCos(j), bs = beamTable_.getSin(j);
+                int u1 = (int)floor((range * (bc * sc - bs * ss) + sensorX) * invResolution);
+                int v1 = (int)floor((range * (bs * sc + bc * ss) + sensorY) * invResolution);
+                RayCaster::traverse(u0, v0, u1, v1, [this, &scan](int gu, int gv)
+                                    { visit(gu, gv, false, scan.cells); });
+                visit(u1, v1, true, scan.cells);
+            }
+            scans_.push_back(std::move(scan));
+        }
+
+        /**
+         * @brief Subtracts the rays of the oldest scan from the grid.
+         */
+        void removeOldestScan(void)
+        {
+            if (scans_.empty())
+                return;
+            ScanCells &scan = scans_.front();
+            for (int i = 0; i < (int)scan.cells.size(); ++i)
+            {
+                int slot = (int)(scan.cells[i] >> 1);
+                // the contribution was already dropped when the cell left the window
+                if (clearStamps_[slot] >= scan.stamp)
+                    continue;
+                if (scan.cells[i] & 1u)
+                    hitCounts_[slot]--;
+                else
+                    freeCounts_[slot]--;
+            }
+            scans_.pop_front();
+        }
+
+        /**
+         * @brief Writes the window as occupancy values in row-major order.
+         *
+         * A cell is occupied (100) when it was hit at least as often as it was passed through,
+         * free (0) when it was only passed through, and unknown (-1) otherwise.
+         *
+         * @param data The occupancy values of the window.
+         */
+        void getData(std::vector<signed char> &data)
+        {
+            data.resize(size_ * size_);
+            int su0 = wrap(originU_), sv0 = wrap(originV_);
+            for (int v = 0; v < size_; ++v)
+            {
+                int sv = sv0 + v;
+                if (sv >= size_)
+                    sv -= size_;
+                signed char *row = &data[v * size_];
+                for (int u = 0; u < size_; ++u)
+                {
+                    int su = su0 + u;
+                    if (su >= size_)
+                        su -= size_;
+                    int slot = sv * size_ + su;
+                    uint16_t hit = hitCounts_[slot], free = freeCounts_[slot];
+                    if (hit > 0 && hit >= free)
+                        row[u] = 100;
+                    else if (free > 0)
+                        row[u] = 0;
+                    else
+                        row[u] = -1;
+                }
+            }
+        }
+    }; // class RollingLocalMap
+
+} // namespace als_ros2
+
+#endif // __ROLLING_LOCAL_MAP_H__
@@ -0,0 +1,266 @@
+/****************************************************************************
+ * als_ros: An Advanced Localization System for ROS use with 2D LiDAR
+ * Copyright (C) 2022 Naoki Akai
+ *
+ * Licensed under the Apache License, Version 2.0 (the “License”);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an “AS IS” BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @author Naoki Akai
+ * modified by: Roald Ong
+ ****************************************************************************/
+
+#ifndef __SDF_FEATURE_CACHE_H__
+#define __SDF_FEATURE_CACHE_H__
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <system_error>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "als_ros2/Keypoint.h"
+#include "als_ros2/SDFFeatureSet.h"
+
+namespace als_ros2
+{
+
+    /**
+     * @brief Binary on-disk cache of the global SDF keypoints and their orientation features.
+     *
+     * A cache file consists of a fixed header followed by a keypoint record array and a feature
+     * record array. All records are 8-byte aligned plain data so the file can be memory-mapped
+     * and read in place. The key stored in the header is a 64-bit FNV-1a hash of everything that
+     * determines the keypoints: the occupancy grid, its geometry, and the detection parameters.
+     */
+    class SDFFeatureCache
+    {
+    public:
+        static const int HIST_SIZE = SDFFeatureSet::HIST_SIZE;
+
+    private:
+        static const uint32_t VERSION = 1;
+
+        struct Header
+        {
+            char magic[8];
+            uint32_t version;
+            uint32_t histSize;
+            uint64_t key;
+            uint64_t keypointsNum;
+        };
+
+        struct KeypointRecord
+        {
+            int32_t u, v;
+            double x, y;
+            int32_t type;
+            int32_t padding;
+        };
+
+        struct FeatureRecord
+        {
+            double dominantOrientation;
+            double averageSDF;
+            int32_t relativeOrientationHist[HIST_SIZE];
+            int32_t padding;
+        };
+
+        std::string cacheDir_;
+        uint64_t hash_;
+
+        inline void addBytes(const void *data, size_t size)
+        {
+            const unsigned char *bytes = (const unsigned char *)data;
+            for (size_t i = 0; i < size; ++i)
+            {
+                hash_ ^= (uint64_t)bytes[i];
+                hash_ *= 1099511628211ULL;
+            }
+        }
+
+    public:
+        SDFFeatureCache(void) { resetKey(); }
+
+        inline void setCacheDir(std::string cacheDir) { cacheDir_ = cacheDir; }
+        inline bool isEnabled(void) { return !cacheDir_.empty(); }
+
+        /**
+         * @brief Resets the hash that is used as the cache key.
+         */
+        inline void resetKey(void) { hash_ = 14695981039346656037ULL ^ (uint64_t)VERSION; }
+
+        /**
+         * @brief Adds a value to the cache key.
+         * @param val The value to add.
+         */
+        template <typename T>
+        inline void addToKey(const T &val) { addBytes(&val, sizeof(T)); }
+
+        /**
+         * @brief Adds an array to the cache key.
+         * @param data The array.
+         * @param size The number of elements of the array.
+         */
+        template <typename T>
+        inline void addToKey(const T *data, size_t size) { addBytes(data, sizeof(T) * size); }
+
+        inline uint64_t getKey(void) { return hash_; }
+
+        /**
+         * @brief Gets the path of the cache file for the current key.
+         * @return The path of the cache file.
+         */
+        std::string getFilePath(void)
+        {
+            char name[64];
+            snprintf(name, sizeof(name), "sdf_features_%016llx.bin", (unsigned long long)hash_);
+            std::string dir = cacheDir_;
+            if (!dir.empty() && dir.back() != '/')
+                dir += "/";
+            return dir + name;
+        }
+
+        /**
+         * @brief Loads the keypoints and features from the cache file for the current key.
+         * @param keypoints The loaded keypoints.
+         * @param features The loaded features.
+         * @return True if a valid cache file was found, false otherwise.
+         */
+        bool load(std::vector<Keypoint> &keypoints, SDFFeatureSet &features)
+        {
+            std::string filePath = getFilePath();
+            int fd = open(filePath.c_str(), O_RDONLY);
+            if (fd < 0)
+                return false;
+            struct stat st;
+            if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(Header))
+            {
+                close(fd);
+                return false;
+            }
+            size_t fileSize = (size_t)st.st_size;
+            void *addr = mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd);
+            if (addr == MAP_FAILED)
+                return false;
+
+            const Header *header = (const Header *)addr;
+            bool isValid = memcmp(header->magic, "ALSSDFC", 8) == 0 && header->version == VERSION &&
+                           header->histSize == (uint32_t)HIST_SIZE && header->key == hash_ &&
+                           fileSize == sizeof(Header) + header->keypointsNum * (sizeof(KeypointRecord) + sizeof(FeatureRecord));
+            if (isValid)
+            {
+                size_t num = (size_t)header->keypointsNum;
+                const KeypointRecord *keypointRecords = (const KeypointRecord *)((const char *)addr + sizeof(Header));
+                const FeatureRecord *featureRecords = (const FeatureRecord *)(keypointRecords + num);
+                keypoints.resize(num);
+                features.resize((int)num);
+                int hist[HIST_SIZE];
+                for (size_t i = 0; i < num; ++i)
+                {
+                    const KeypointRecord &k = keypointRecords[i];
+                    keypoints[i] = Keypoint(k.u, k.v, k.x, k.y, (char)k.type);
+                    const FeatureRecord &f = featureRecords[i];
+                    for (int j = 0; j < HIST_SIZE; ++j)
+                        hist[j] = f.relativeOrientationHist[j];
+                    features.set((int)i, f.dominantOrientation, f.averageSDF, hist);
+                }
+            }
+            munmap(addr, fileSize);
+            return isValid;
+        }
+
+        /**
+         * @brief Saves the keypoints and features to the cache file for the current key.
+         *
+         * The file is written to a temporary file of a unique name first and then renamed, so a
+         * concurrently starting node never maps a partially written file, and nodes saving the
+         * same key at the same time do not write into each other's temporary file.
+         *
+         * @param keypoints The keypoints to save.
+         * @param features The features to save.
+         * @return True if the file was written, false otherwise.
+         */
+        bool save(std::vector<Keypoint> &keypoints, SDFFeatureSet &features)
+        {
+            std::error_code ec;
+            std::filesystem::create_directories(cacheDir_, ec);
+            if (ec)
+                return false;
+
+            std::string filePath = getFilePath();
+            std::vector<char> tmpFilePath(filePath.begin(), filePath.end());
+            const char suffix[] = ".XXXXXX";
+            tmpFilePath.insert(tmpFilePath.end(), suffix, suffix + sizeof(suffix));
+            int fd = mkstemp(tmpFilePath.data());
+            if (fd < 0)
+                return false;
+            // mkstemp creates the file readable by the owner only
+            fchmod(fd, 0644);
+            FILE *fp = fdopen(fd, "wb");
+            if (fp == NULL)
+            {
+                close(fd);
+                remove(tmpFilePath.data());
+                return false;
+            }
+
+            Header header;
+            memset(&header, 0, sizeof(Header));
+            memcpy(header.magic, "ALSSDFC", 8);
+            header.version = VERSION;
+            header.histSize = HIST_SIZE;
+            header.key = hash_;
+            header.keypointsNum = (uint64_t)keypoints.size();
+
+            std::vector<KeypointRecord> keypointRecords(keypoints.size());
+            std::vector<FeatureRecord> featureRecords(features.size());
+            memset(keypointRecords.data(), 0, sizeof(KeypointRecord) * keypointRecords.size());
+            memset(featureRecords.data(), 0, sizeof(FeatureRecord) * featureRecords.size());
+            for (size_t i = 0; i < keypoints.size(); ++i)
+            {
+                keypointRecords[i].u = keypoints[i].getU();
+                keypointRecords[i].v = keypoints[i].getV();
+                keypointRecords[i].x = keypoints[i].getX();
+                keypointRecords[i].y = keypoints[i].getY();
+                keypointRecords[i].type = keypoints[i].getType();
+                featureRecords[i].dominantOrientation = features.getDominantOrientation((int)i);
+                featureRecords[i].averageSDF = features.getAverageSDF((int)i);
+                for (int j = 0; j < HIST_SIZE; ++j)
+                    featureRecords[i].relativeOrientationHist[j] = features.getRelativeOrientationHist((int)i, j);
+            }
+
+            bool isWritten = fwrite(&header, sizeof(Header), 1, fp) == 1;
+            if (!keypointRecords.empty())
+            {
+                isWritten = isWritten && fwrite(keypointRecords.data(), sizeof(KeypointRecord), keypointRecords.size(), fp) == keypointRecords.size();
+                isWritten = isWritten && fwrite(featureRecords.data(), sizeof(FeatureRecord), featureRecords.size(), fp) == featureRecords.size();
+            }
+            isWritten = (fclose(fp) == 0) && isWritten;
+            if (!isWritten || rename(tmpFilePath.data(), filePath.c_str()) != 0)
+            {
+                remove(tmpFilePath.data());
+                return false;
+            }
+            return true;
+        }
+    }; // class SDFFeatureCache
+
+} // namespace als_ros2
+
+#endif // __SDF_FEATURE_CACHE_H__
@@ -0,0 +1,411 @@
+/****************************************************************************
+ * als_ros: An Advanced Localization System for ROS use with 2D LiDAR
+ * Copyright (C) 2022 Naoki Akai
+ *
+ * Licensed under the Apache License, Version 2.0 (the “License”);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an “AS IS” BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @author Naoki Akai
+ * modified by: Roald Ong
+ ****************************************************************************/
+
+#ifndef __SDF_FEATURE_INDEX_H__
+#define __SDF_FEATURE_INDEX_H__
+
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <climits>
+#include <cstdlib>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include "als_ros2/Keypoint.h"
+#include "als_ros2/SDFFeatureSet.h"
+
+namespace als_ros2
+{
+
+    /**
+     * @brief Search index over the global SDF keypoints used to find feature correspondences.
+     *
+     * Keypoints are bucketed by type and sorted by average SDF inside each bucket, so the
+     * average SDF gate becomes a contiguous rank range. A KD-tree is built over each bucket
+     * whose levels alternate between splitting on the rank and splitting on the widest
+     * relative orientation histogram bin. Every node keeps the bounding box of its histograms
+     * and the range of original keypoint indices it contains, which allows exact branch and
+     * bound queries that reproduce the brute-force scan of the original keypoint list.
+     */
+    class SDFFeatureIndex
+    {
+    public:
+        static const int HIST_SIZE = SDFFeatureSet::HIST_SIZE;
+        static const int HIST_STRIDE = SDFFeatureSet::HIST_STRIDE;
+
+    private:
+        static const int LEAF_SIZE = 16;
+
+        struct Entry
+        {
+            int index;           // index in the global keypoint list
+            int rank;            // position in the average SDF order of the bucket
+            uint16_t hist[HIST_STRIDE]; // padded relative orientation histogram
+        };
+
+        struct Node
+        {
+            int begin, end;
+            int left, right;
+            int minRank, maxRank;
+            int minIndex, maxIndex;
+            uint16_t lo[HIST_STRIDE], hi[HIST_STRIDE];
+        };
+
+        struct Bucket
+        {
+            std::vector<double> averageSDFs; // sorted, averageSDFs[rank]
+            std::vector<Entry> entries;      // permuted so that every node covers [begin, end)
+            std::vector<Node> nodes;         // nodes[0] is the root
+        };
+
+        struct Location
+        {
+            int bucket; // -1: not indexed
+            int entry;
+        };
+
+        Bucket buckets_[3];              // keypoint types -1, 0, and 1
+        std::vector<Location> locations_; // the entry of every global keypoint
+
+        // the ratio test of the best and the second best histogram distance
+        static inline bool passesRatioTest(int min1, int min2) { return (float)min1 * 1.5f < (float)min2; }
+
+        inline int type2bucket(char type)
+        {
+            if (type < -1 || 1 < type)
+                return -1;
+            return (int)type + 1;
+        }
+
+        int buildNode(Bucket &bucket, int begin, int end, int depth)
+        {
+            Node node;
+            node.begin = begin, node.end = end;
+            node.left = node.right = -1;
+            node.minRank = node.minIndex = INT_MAX;
+            node.maxRank = node.maxIndex = INT_MIN;
+            for (int k = 0; k < HIST_STRIDE; ++k)
+                node.lo[k] = UINT16_MAX, node.hi[k] = 0;
+            for (int i = begin; i < end; ++i)
+            {
+                const Entry &e = bucket.entries[i];
+                node.minRank = std::min(node.minRank, e.rank);
+                node.maxRank = std::max(node.maxRank, e.rank);
+                node.minIndex = std::min(node.minIndex, e.index);
+                node.maxIndex = std::max(node.maxIndex, e.index);
+                for (int k = 0; k < HIST_STRIDE; ++k)
+                {
+                    node.lo[k] = std::min(node.lo[k], e.hist[k]);
+                    node.hi[k] = std::max(node.hi[k], e.hist[k]);
+                }
+            }
+
+            int nodeIdx = (int)bucket.nodes.size();
+            bucket.nodes.push_back(node);
+            if (end - begin <= LEAF_SIZE)
+                return nodeIdx;
+
+            int splitDim = -1; // -1: rank, 0-16: histogram bin
+            if (depth % 2 == 1)
+            {
+                int maxSpread = 0;
+                for (int k = 0; k < HIST_SIZE; ++k)
+                {
+                    if (node.hi[k] - node.lo[k] > maxSpread)
+                    {
+                        maxSpread = node.hi[k] - node.lo[k];
+                        splitDim = k;
+                    }
+                }
+            }
+
+            int mid = begin + (end - begin) / 2;
+            std::nth_element(bucket.entries.begin() + begin, bucket.entries.begin() + mid, bucket.entries.begin() + end,
+                             [splitDim](const Entry &a, const Entry &b)
+                             {
+                                 if (splitDim < 0)
+                                     return a.rank < b.rank;
+                                 return a.hist[splitDim] < b.hist[splitDim];
+                             });
+            int left = buildNode(bucket, begin, mid, depth + 1);
+            int right = buildNode(bucket, mid, end, depth + 1);
+            bucket.nodes[nodeIdx].left = left;
+            bucket.nodes[nodeIdx].right = right;
+            return nodeIdx;
+        }
+
+        inline int computeLowerBound(const Node &node, const uint16_t *hist)
+        {
+            return SDFFeatureSet::computeL1DistanceToBox(hist, node.lo, node.hi);
+        }
+
+        inline int computeDistance(const Entry &e, const uint16_t *hist)
+        {
+            return SDFFeatureSet::computeL1Distance(e.hist, hist);
+        }
+
+        /*
+         * Finds the entry with the smallest histogram distance among the entries whose rank is
+         * in [rankMin, rankMax] and whose index is less than indexLimit. Ties are broken by the
+         * smaller index, i.e., the entry that the brute-force scan visits first.
+         */
+        void searchNearest(Bucket &bucket, int nodeIdx, const uint16_t *hist, int rankMin, int rankMax, int indexLimit,
+                           int *minSum, int *minIdx)
+        {
+            const Node &node = bucket.nodes[nodeIdx];
+            if (node.maxRank < rankMin || rankMax < node.minRank || node.minIndex >= indexLimit)
+                return;
+            int lb = computeLowerBound(node, hist);
+            if (lb > *minSum || (lb == *minSum && node.minIndex > *minIdx))
+                return;
+
+            if (node.left < 0)
+            {
+                for (int i = node.begin; i < node.end; ++i)
+                {
+                    const Entry &e = bucket.entries[i];
+                    if (e.rank < rankMin || rankMax < e.rank || e.index >= indexLimit)
+                        continue;
+                    int sum = computeDistance(e, hist);
+                    if (sum < *minSum || (sum == *minSum && e.index < *minIdx))
+                    {
+                        *minSum = sum;
+                        *minIdx = e.index;
+                    }
+                }
+                return;
+            }
+
+            int lbLeft = computeLowerBound(bucket.nodes[node.left], hist);
+            int lbRight = computeLowerBound(bucket.nodes[node.right], hist);
+            int first = node.left, second = node.right;
+            if (lbRight < lbLeft)
+                std::swap(first, second);
+            searchNearest(bucket, first, hist, rankMin, rankMax, indexLimit, minSum, minIdx);
+            searchNearest(bucket, second, hist, rankMin, rankMax, indexLimit, minSum, minIdx);
+        }
+
+        /*
+         * Finds the entry with the smallest index greater than indexFloor among the entries
+         * whose rank is in [rankMin, rankMax], and returns its histogram distance.
+         */
+        void searchNextIndex(Bucket &bucket, int nodeIdx, const uint16_t *hist, int rankMin, int rankMax, int indexFloor,
+                             int *nextIdx, int *nextSum)
+        {
+            const Node &node = bucket.nodes[nodeIdx];
+            if (node.maxRank < rankMin || rankMax < node.minRank || node.maxIndex <= indexFloor)
+                return;
+            if (std::max(node.minIndex, indexFloor + 1) >= *nextIdx)
+                return;
+
+            if (node.left < 0)
+            {
+                for (int i = node.begin; i < node.end; ++i)
+                {
+                    const Entry &e = bucket.entries[i];
+                    if (e.rank < rankMin || rankMax < e.rank || e.index <= indexFloor || e.index >= *nextIdx)
+                        continue;
+                    *nextIdx = e.index;
+                    *nextSum = computeDistance(e, hist);
+                }
+                return;
+            }
+
+            int first = node.left, second = node.right;
+            if (bucket.nodes[second].minIndex < bucket.nodes[first].minIndex)
+                std::swap(first, second);
+            searchNextIndex(bucket, first, hist, rankMin, rankMax, indexFloor, nextIdx, nextSum);
+            searchNextIndex(bucket, second, hist, rankMin, rankMax, indexFloor, nextIdx, nextSum);
+        }
+
+    public:
+        SDFFeatureIndex(void) {}
+
+        /**
+         * @brief Builds the index from the global keypoints and their features.
+         * @param keypoints The global SDF keypoints.
+         * @param features The features of the global SDF keypoints.
+         */
+        void build(std::vector<Keypoint> &keypoints, SDFFeatureSet &features)
+        {
+            for (int b = 0; b < 3; ++b)
+            {
+                buckets_[b].averageSDFs.clear();
+                buckets_[b].entries.clear();
+                buckets_[b].nodes.clear();
+            }
+
+            std::vector<int> members[3];
+            for (int i = 0; i < (int)keypoints.size(); ++i)
+            {
+                int b = type2bucket(keypoints[i].getType());
+                if (b >= 0)
+                    members[b].push_back(i);
+            }
+
+            for (int b = 0; b < 3; ++b)
+            {
+                Bucket &bucket = buckets_[b];
+                std::vector<int> &idxs = members[b];
+                std::stable_sort(idxs.begin(), idxs.end(), [&features](int i, int j)
+                                 { return features.getAverageSDF(i) < features.getAverageSDF(j); });
+
+                bucket.averageSDFs.resize(idxs.size());
+                bucket.entries.resize(idxs.size());
+                for (int r = 0; r < (int)idxs.size(); ++r)
+                {
+                    int i = idxs[r];
+                    bucket.averageSDFs[r] = features.getAverageSDF(i);
+                    bucket.entries[r].index = i;
+                    bucket.entries[r].rank = r;
+                    memcpy(bucket.entries[r].hist, features.getRelativeOrientationHist(i), sizeof(uint16_t) * HIST_STRIDE);
+                }
+                if (!bucket.entries.empty())
+                    buildNode(bucket, 0, (int)bucket.entries.size(), 0);
+            }
+
+            Location notIndexed = {-1, -1};
+            locations_.assign(keypoints.size(), notIndexed);
+            for (int b = 0; b < 3; ++b)
+            {
+                for (int e = 0; e < (int)buckets_[b].entries.size(); ++e)
+                {
+                    Location loc = {b, e};
+                    locations_[buckets_[b].entries[e].index] = loc;
+                }
+            }
+        }
+
+        /**
+         * @brief Finds the global keypoint corresponding to a local keypoint.
+         *
+         * The result is identical to scanning all global keypoints in order, keeping the best and
+         * the previously best histogram distance, and accepting the best one when it passes the
+         * 1.5 ratio test or when it is the only candidate.
+         *
+         * @param type The type of the local keypoint.
+         * @param averageSDF The average SDF of the local keypoint.
+         * @param relOrientHist The padded relative orientation histogram of the local keypoint.
+         * @param averageSDFDeltaTH The threshold of the average SDF difference.
+         * @return The index of the corresponding global keypoint, or -1 if there is none.
+         */
+        int findCorrespondingFeature(char type, double averageSDF, const uint16_t *relOrientHist, double averageSDFDeltaTH)
+        {
+            int b = type2bucket(type);
+            if (b < 0)
+                return -1;
+            Bucket &bucket = buckets_[b];
+            if (bucket.entries.empty())
+                return -1;
+
+            // ranks whose average SDF passes fabs(averageSDF - sdf) <= averageSDFDeltaTH
+            std::vector<double> &sdfs = bucket.averageSDFs;
+            int rankMin = (int)(std::partition_point(sdfs.begin(), sdfs.end(), [averageSDF, averageSDFDeltaTH](double sdf)
+                                                     { return averageSDF - sdf > averageSDFDeltaTH; }) -
+                                sdfs.begin());
+            int rankMax = (int)(std::partition_point(sdfs.begin(), sdfs.end(), [averageSDF, averageSDFDeltaTH](double sdf)
+                                                     { return !(averageSDF - sdf < -averageSDFDeltaTH); }) -
+                                sdfs.begin()) -
+                          1;
+            if (rankMin > rankMax)
+                return -1;
+
+            const uint16_t *hist = relOrientHist;
+            int min1 = INT_MAX, idx1 = INT_MAX;
+            searchNearest(bucket, 0, hist, rankMin, rankMax, INT_MAX, &min1, &idx1);
+            if (rankMin == rankMax)
+                return idx1;
+
+            // the second minimum of the scan is the best distance seen before idx1,
+            // or the distance of the second visited candidate if idx1 was visited first
+            int min2 = INT_MAX, idx2 = INT_MAX;
+            searchNearest(bucket, 0, hist, rankMin, rankMax, idx1, &min2, &idx2);
+            if (idx2 == INT_MAX)
+                searchNextIndex(bucket, 0, hist, rankMin, rankMax, idx1, &idx2, &min2);
+
+            if (passesRatioTest(min1, min2))
+                return idx1;
+            return -1;
+        }
+
+        /**
+         * @brief Same as above among a subset of the global keypoints.
+         *
+         * The result is identical to the scan of findCorrespondingFeature over the candidates in
+         * the given order instead of all global keypoints.
+         *
+         * @param type The type of the local keypoint.
+         * @param averageSDF The average SDF of the local keypoint.
+         * @param relOrientHist The padded relative orientation histogram of the local keypoint.
+         * @param averageSDFDeltaTH The threshold of the average SDF difference.
+         * @param candidateIndices The indices of the candidate global keypoints.
+         * @return The index of the corresponding global keypoint, or -1 if there is none.
+         */
+        int findCorrespondingFeatureInSubset(char type, double averageSDF, const uint16_t *relOrientHist, double averageSDFDeltaTH,
+                                             const std::vector<int> &candidateIndices)
+        {
+            int b = type2bucket(type);
+            if (b < 0)
+                return -1;
+            Bucket &bucket = buckets_[b];
+            int visitedNum = 0, idx1 = -1, min1 = INT_MAX, min2 = INT_MAX;
+            for (int k = 0; k < (int)candidateIndices.size(); ++k)
+            {
+                int j = candidateIndices[k];
+                const Location &loc = locations_[j];
+                if (loc.bucket != b)
+                    continue;
+                const Entry &e = bucket.entries[loc.entry];
+                if (fabs(averageSDF - bucket.averageSDFs[e.rank]) > averageSDFDeltaTH)
+                    continue;
+                int sum = computeDistance(e, relOrientHist);
+                // the second candidate replaces the first one on a tie, later ones only when they are better
+                if (visitedNum == 0 || (visitedNum == 1 && sum <= min1) || sum < min1)
+                {
+                    min2 = min1;
+                    min1 = sum;
+                    idx1 = j;
+                }
+                else if (visitedNum == 1)
+                {
+                    min2 = sum;
+                }
+                visitedNum++;
+            }
+            if (visitedNum == 1 || (visitedNum > 1 && passesRatioTest(min1, min2)))
+                return idx1;
+            return -1;
+        }
+
+        /**
+         * @brief Gets the number of indexed keypoints.
+         * @return The number of indexed keypoints.
+         */
+        inline int size(void)
+        {
+            return (int)(buckets_[0].entries.size() + buckets_[1].entries.size() + buckets_[2].entries.size());
+        }
+    }; // class SDFFeatureIndex
+
+} // namespace als_ros2
+
+#endif // __SDF_FEATURE_INDEX_H__
@@ -0,0 +1,183 @@
+/****************************************************************************
+ * als_ros: An Advanced Localization System for ROS use with 2D LiDAR
+ * Copyright (C) 2022 Naoki Akai
+ *
+ * Licensed under the Apache License, Version 2.0 (the “License”);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an “AS IS” BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @author Naoki Akai
+ * modified by: Roald Ong
+ ****************************************************************************/
+
+#ifndef __SDF_FEATURE_SET_H__
+#define __SDF_FEATURE_SET_H__
+
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace als_ros2
+{
+
+    /**
+     * @brief SDF orientation features of a keypoint list stored as a structure of arrays.
+     *
+     * The relative orientation histograms are stored as one contiguous 16-bit matrix whose rows
+     * are padded with zeros to HIST_STRIDE lanes, so a row is exactly 64 bytes and the L1
+     * distance between two rows is computed with two 256-bit (or four 128-bit) SAD steps.
+     * Histogram counts are saturated to INT16_MAX, which is only reached for feature windows
+     * larger than 181 x 181 cells.
+     */
+    class SDFFeatureSet
+    {
+    public:
+        static const int HIST_SIZE = 17;
+        static const int HIST_STRIDE = 32;
+        static const int HIST_MAX = 32767;
+
+    private:
+        std::vector<double> dominantOrientations_;
+        std::vector<double> averageSDFs_;
+        std::vector<uint16_t> hists_;
+
+    public:
+        SDFFeatureSet(void) {}
+
+        /**
+         * @brief Resizes the set. New features are zero.
+         * @param num The number of features.
+         */
+        void resize(int num)
+        {
+            dominantOrientations_.resize(num, 0.0);
+            averageSDFs_.resize(num, 0.0);
+            hists_.resize((size_t)num * HIST_STRIDE, 0);
+        }
+
+        inline int size(void) { return (int)averageSDFs_.size(); }
+
+        /**
+         * @brief Sets a feature.
+         * @param i The index of the feature.
+         * @param dominantOrientation The dominant orientation [rad].
+         * @param averageSDF The average signed distance field value.
+         * @param relativeOrientationHist The HIST_SIZE bins of the relative orientation histogram.
+         */
+        void set(int i, double dominantOrientation, double averageSDF, const int *relativeOrientationHist)
+        {
+            dominantOrientations_[i] = dominantOrientation;
+            averageSDFs_[i] = averageSDF;
+            uint16_t *hist = &hists_[(size_t)i * HIST_STRIDE];
+            for (int k = 0; k < HIST_SIZE; ++k)
+            {
+                int val = relativeOrientationHist[k];
+                hist[k] = (uint16_t)((val < 0) ? 0 : ((val > HIST_MAX) ? HIST_MAX : val));
+            }
+            for (int k = HIST_SIZE; k < HIST_STRIDE; ++k)
+                hist[k] = 0;
+        }
+
+        inline double getDominantOrientation(int i) { return dominantOrientations_[i]; }
+        inline double getAverageSDF(int i) { return averageSDFs_[i]; }
+        inline const uint16_t *getRelativeOrientationHist(int i) { return &hists_[(size_t)i * HIST_STRIDE]; }
+        inline int getRelativeOrientationHist(int i, int k) { return hists_[(size_t)i * HIST_STRIDE + k]; }
+
+        /**
+         * @brief Computes the L1 distance between two padded histogram rows.
+         * @param a The first row of HIST_STRIDE lanes.
+         * @param b The second row of HIST_STRIDE lanes.
+         * @return The sum of the absolute differences.
+         */
+        static inline int computeL1Distance(const uint16_t *a, const uint16_t *b)
+        {
+#if defined(__AVX2__)
+            __m256i a0 = _mm256_loadu_si256((const __m256i *)a), a1 = _mm256_loadu_si256((const __m256i *)(a + 16));
+            __m256i b0 = _mm256_loadu_si256((const __m256i *)b), b1 = _mm256_loadu_si256((const __m256i *)(b + 16));
+            __m256i d0 = _mm256_or_si256(_mm256_subs_epu16(a0, b0), _mm256_subs_epu16(b0, a0));
+            __m256i d1 = _mm256_or_si256(_mm256_subs_epu16(a1, b1), _mm256_subs_epu16(b1, a1));
+            // the lanes are at most HIST_MAX, so the signed pairwise sums do not overflow
+            __m256i ones = _mm256_set1_epi16(1);
+            __m256i acc = _mm256_add_epi32(_mm256_madd_epi16(d0, ones), _mm256_madd_epi16(d1, ones));
+            __m128i acc4 = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+            acc4 = _mm_add_epi32(acc4, _mm_shuffle_epi32(acc4, _MM_SHUFFLE(1, 0, 3, 2)));
+            acc4 = _mm_add_epi32(acc4, _mm_shuffle_epi32(acc4, _MM_SHUFFLE(2, 3, 0, 1)));
+            return _mm_cvtsi128_si32(acc4);
+#elif defined(__ARM_NEON)
+            uint32x4_t acc = vdupq_n_u32(0);
+            for (int k = 0; k < HIST_STRIDE; k += 8)
+                acc = vpadalq_u16(acc, vabdq_u16(vld1q_u16(a + k), vld1q_u16(b + k)));
+            return (int)vaddvq_u32(acc);
+#else
+            int sum = 0;
+            for (int k = 0; k < HIST_SIZE; ++k)
+                sum += abs((int)a[k] - (int)b[k]);
+            return sum;
+#endif
+        }
+
+        /**
+         * @brief Computes the L1 distance from a padded row to the box [lo, hi].
+         *
+         * This is a lower bound of the L1 distance from the row to every row inside the box.
+         *
+         * @param hist The row of HIST_STRIDE lanes.
+         * @param lo The lower corner of the box.
+         * @param hi The upper corner of the box.
+         * @return The lower bound.
+         */
+        static inline int computeL1DistanceToBox(const uint16_t *hist, const uint16_t *lo, const uint16_t *hi)
+        {
+#if defined(__AVX2__)
+            __m256i h0 = _mm256_loadu_si256((const __m256i *)hist), h1 = _mm256_loadu_si256((const __m256i *)(hist + 16));
+            __m256i l0 = _mm256_loadu_si256((const __m256i *)lo), l1 = _mm256_loadu_si256((const __m256i *)(lo + 16));
+            __m256i u0 = _mm256_loadu_si256((const __m256i *)hi), u1 = _mm256_loadu_si256((const __m256i *)(hi + 16));
+            // at most one of the two terms of a lane is nonzero
+            __m256i d0 = _mm256_or_si256(_mm256_subs_epu16(l0, h0), _mm256_subs_epu16(h0, u0));
+            __m256i d1 = _mm256_or_si256(_mm256_subs_epu16(l1, h1), _mm256_subs_epu16(h1, u1));
+            __m256i ones = _mm256_set1_epi16(1);
+            __m256i acc = _mm256_add_epi32(_mm256_madd_epi16(d0, ones), _mm256_madd_epi16(d1, ones));
+            __m128i acc4 = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+            acc4 = _mm_add_epi32(acc4, _mm_shuffle_epi32(acc4, _MM_SHUFFLE(1, 0, 3, 2)));
+            acc4 = _mm_add_epi32(acc4, _mm_shuffle_epi32(acc4, _MM_SHUFFLE(2, 3, 0, 1)));
+            return _mm_cvtsi128_si32(acc4);
+#elif defined(__ARM_NEON)
+            uint32x4_t acc = vdupq_n_u32(0);
+            for (int k = 0; k < HIST_STRIDE; k += 8)
+            {
+                uint16x8_t h = vld1q_u16(hist + k);
+                uint16x8_t d = vorrq_u16(vqsubq_u16(vld1q_u16(lo + k), h), vqsubq_u16(h, vld1q_u16(hi + k)));
+                acc = vpadalq_u16(acc, d);
+            }
+            return (int)vaddvq_u32(acc);
+#else
+            int lb = 0;
+            for (int k = 0; k < HIST_SIZE; ++k)
+            {
+                if (hist[k] < lo[k])
+                    lb += lo[k] - hist[k];
+                else if (hist[k] > hi[k])
+                    lb += hist[k] - hi[k];
+            }
+            return lb;
+#endif
+        }
+    }; // class SDFFeatureSet
+
+} // namespace als_ros2
+
+#endif // __SDF_FEATURE_SET_H__
@@ -0,0 +1,247 @@
+/****************************************************************************
+ * als_ros: An Advanced Localization System for ROS use with 2D LiDAR
+ * Copyright (C) 2022 Naoki Akai
+ *
+ * Licensed under the Apache License, Version 2.0 (the “License”);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an “AS IS” BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @author Naoki Akai
+ * modified by: Roald Ong
+ ****************************************************************************/
+
+
+#ifndef __SDF_KEYPOINT_DETECTOR_H__
+#define __SDF_KEYPOINT_DETECTOR_H__
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+#include "als_ros2/Keypoint.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace als_ros2
+{
+
+    /**
+     * @brief Row-major detector of the extrema and saddle points of a distance field.
+     *
+     * A cell is a candidate if it is free, at least minDist away from the map, and its first
+     * derivatives are below the gradient threshold. The derivatives, the Hessian, and its
+     * determinant are computed for whole rows with 8 (AVX2) or 4 (NEON) lanes at once. The
+     * second derivatives are evaluated in double precision and rounded to float as before, so
+     * the vector paths yield the same keypoints as the scalar one.
+     */
+    class SDFKeypointDetector
+    {
+    private:
+        float minDist_, gradientSquareTH_;
+
+        // the smallest float that is not less than val, so that f < val <=> f < roundUp(val) for every float f
+        static inline float roundUp(double val)
+        {
+            float f = (float)val;
+            if ((double)f < val)
+                f = nextafterf(f, INFINITY);
+            return f;
+        }
+
+        static inline void addKeypoint(int u, int v, float dxx, float det, std::vector<Keypoint> &keypoints)
+        {
+            if (det > 0.0f && dxx < 0.0f) // local maxima
+                keypoints.push_back(Keypoint(u, v, 0.0, 0.0, 1));
+            else if (det > 0.0f && dxx > 0.0f) // local minima
+                keypoints.push_back(Keypoint(u, v, 0.0, 0.0, -1));
+            else if (det < 0.0f) // saddle
+                keypoints.push_back(Keypoint(u, v, 0.0, 0.0, 0));
+        }
+
+        inline void detectScalar(const float *r0, const float *r1, const float *r2, const signed char *data, int v, int u,
+                                 std::vector<Keypoint> &keypoints)
+        {
+            if (data[u] != 0 || !(r1[u] >= minDist_))
+                return;
+            float dx = -r0[u - 1] - r1[u - 1] - r2[u - 1] + r0[u + 1] + r1[u + 1] + r2[u + 1];
+            float dy = -r0[u - 1] - r0[u] - r0[u + 1] + r2[u - 1] + r2[u] + r2[u + 1];
+            float dxx = r1[u - 1] - 2.0 * r1[u] + r1[u + 1];
+            float dyy = r0[u] - 2.0 * r1[u] + r2[u];
+            float dxy = r0[u - 1] - r0[u] - r1[u - 1] + 2.0 * r1[u] - r1[u + 1] - r2[u] + r2[u + 1];
+            float det = dxx * dyy - dxy * dxy;
+            if (dx * dx < gradientSquareTH_ && dy * dy < gradientSquareTH_)
+                addKeypoint(u, v, dxx, det, keypoints);
+        }
+
+#if defined(__AVX2__)
+        static inline __m256 toFloat(__m256d lo, __m256d hi)
+        {
+            return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(lo)), _mm256_cvtpd_ps(hi), 1);
+        }
+
+        // (a - 2 b) + c in double precision for the lower and upper 4 lanes
+        static inline __m256 secondDiff(__m256 a, __m256 b, __m256 c)
+        {
+            __m256d two = _mm256_set1_pd(2.0);
+            __m256d lo = _mm256_add_pd(_mm256_sub_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(a)), _mm256_mul_pd(two, _mm256_cvtps_pd(_mm256_castps256_ps128(b)))),
+                                       _mm256_cvtps_pd(_mm256_castps256_ps128(c)));
+            __m256d hi = _mm256_add_pd(_mm256_sub_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(a, 1)), _mm256_mul_pd(two, _mm256_cvtps_pd(_mm256_extractf128_ps(b, 1)))),
+                                       _mm256_cvtps_pd(_mm256_extractf128_ps(c, 1)));
+            return toFloat(lo, hi);
+        }
+
+        // (((t + 2 b) - c) - d) + e in double precision for 4 lanes
+        static inline __m256d mixedDiff4(__m128 t, __m128 b, __m128 c, __m128 d, __m128 e)
+        {
+            __m256d s = _mm256_add_pd(_mm256_cvtps_pd(t), _mm256_mul_pd(_mm256_set1_pd(2.0), _mm256_cvtps_pd(b)));
+            s = _mm256_sub_pd(_mm256_sub_pd(s, _mm256_cvtps_pd(c)), _mm256_cvtps_pd(d));
+            return _mm256_add_pd(s, _mm256_cvtps_pd(e));
+        }
+#endif
+
+    public:
+        SDFKeypointDetector(void) : minDist_(0.0f), gradientSquareTH_(0.0f) {}
+
+        /**
+         * @brief Sets the thresholds of the detector.
+         * @param minDist The minimum distance of a keypoint from the map.
+         * @param gradientSquareTH The threshold of the squared first derivatives.
+         */
+        void setThresholds(double minDist, double gradientSquareTH)
+        {
+            minDist_ = roundUp(minDist);
+            gradientSquareTH_ = roundUp(gradientSquareTH);
+        }
+
+        inline float getMinDist(void) { return minDist_; }
+        inline float getGradientSquareTH(void) { return gradientSquareTH_; }
+
+        /**
+         * @brief Detects the keypoints of the rows [vBegin, vEnd) in row-major order.
+         *
+         * The border rows and columns are skipped. The keypoints have cell indices only.
+         *
+         * @param dist The distance field in row-major order.
+         * @param stride The number of floats between two rows of the distance field.
+         * @param data The occupancy values of the map in row-major order.
+         * @param width The number of columns of the map.
+         * @param height The number of rows of the map.
+         * @param vBegin The first row.
+         * @param vEnd The row after the last row.
+         * @param keypoints The detected keypoints are appended to this.
+         */
+        void detectRows(const float *dist, size_t stride, const signed char *data, int width, int height, int vBegin, int vEnd,
+                        std::vector<Keypoint> &keypoints)
+        {
+            for (int v = std::max(vBegin, 1); v < std::min(vEnd, height - 1); ++v)
+            {
+                const float *r0 = dist + (v - 1) * stride;
+                const float *r1 = dist + v * stride;
+                const float *r2 = dist + (v + 1) * stride;
+                const signed char *row = data + (size_t)v * width;
+                int u = 1;
+#if defined(__AVX2__)
+                __m256 minDist = _mm256_set1_ps(minDist_), th = _mm256_set1_ps(gradientSquareTH_);
+                __m256 zero = _mm256_setzero_ps(), signMask = _mm256_set1_ps(-0.0f);
+                for (; u + 8 <= width - 1; u += 8)
+                {
+                    __m256 c = _mm256_loadu_ps(r1 + u);
+                    __m256 isFar = _mm256_cmp_ps(c, minDist, _CMP_GE_OQ);
+                    if (_mm256_movemask_ps(isFar) == 0)
+                        continue;
+                    __m256 am = _mm256_loadu_ps(r0 + u - 1), a = _mm256_loadu_ps(r0 + u), ap = _mm256_loadu_ps(r0 + u + 1);
+                    __m256 cm = _mm256_loadu_ps(r1 + u - 1), cp = _mm256_loadu_ps(r1 + u + 1);
+                    __m256 bm = _mm256_loadu_ps(r2 + u - 1), b = _mm256_loadu_ps(r2 + u), bp = _mm256_loadu_ps(r2 + u + 1);
+                    __m256 dx = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_sub_ps(_mm256_sub_ps(_mm256_xor_ps(am, signMask), cm), bm), ap), cp), bp);
+                    __m256 dy = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_sub_ps(_mm256_sub_ps(_mm256_xor_ps(am, signMask), a), ap), bm), b), bp);
+                    __m256 mask = _mm256_and_ps(isFar, _mm256_and_ps(_mm256_cmp_ps(_mm256_mul_ps(dx, dx), th, _CMP_LT_OQ),
+                                                                     _mm256_cmp_ps(_mm256_mul_ps(dy, dy), th, _CMP_LT_OQ)));
+                    int bits = _mm256_movemask_ps(mask);
+                    if (bits == 0)
+                        continue;
+                    __m256 dxx = secondDiff(cm, c, cp);
+                    __m256 dyy = secondDiff(a, c, b);
+                    __m256 t = _mm256_sub_ps(_mm256_sub_ps(am, a), cm);
+                    __m256 dxy = toFloat(mixedDiff4(_mm256_castps256_ps128(t), _mm256_castps256_ps128(c), _mm256_castps256_ps128(cp),
+                                                    _mm256_castps256_ps128(b), _mm256_castps256_ps128(bp)),
+                                         mixedDiff4(_mm256_extractf128_ps(t, 1), _mm256_extractf128_ps(c, 1), _mm256_extractf128_ps(cp, 1),
+                                                    _mm256_extractf128_ps(b, 1), _mm256_extractf128_ps(bp, 1)));
+                    __m256 det = _mm256_sub_ps(_mm256_mul_ps(dxx, dyy), _mm256_mul_ps(dxy, dxy));
+                    // cells that can never become keypoints are dropped before the scalar classification
+                    __m256 isTyped = _mm256_or_ps(_mm256_cmp_ps(det, zero, _CMP_LT_OQ),
+                                                  _mm256_and_ps(_mm256_cmp_ps(det, zero, _CMP_GT_OQ), _mm256_cmp_ps(dxx, zero, _CMP_NEQ_OQ)));
+                    bits &= _mm256_movemask_ps(isTyped);
+                    if (bits == 0)
+                        continue;
+                    alignas(32) float dxxs[8], dets[8];
+                    _mm256_store_ps(dxxs, dxx);
+                    _mm256_store_ps(dets, det);
+                    for (int k = 0; k < 8; ++k)
+                    {
+                        if ((bits >> k) & 1 && row[u + k] == 0)
+                            addKeypoint(u + k, v, dxxs[k], dets[k], keypoints);
+                    }
+                }
+#elif defined(__ARM_NEON)
+                float32x4_t minDist = vdupq_n_f32(minDist_), th = vdupq_n_f32(gradientSquareTH_);
+                float64x2_t two = vdupq_n_f64(2.0);
+                for (; u + 4 <= width - 1; u += 4)
+                {
+                    float32x4_t c = vld1q_f32(r1 + u);
+                    uint32x4_t isFar = vcgeq_f32(c, minDist);
+                    if (vmaxvq_u32(isFar) == 0)
+                        continue;
+                    float32x4_t am = vld1q_f32(r0 + u - 1), a = vld1q_f32(r0 + u), ap = vld1q_f32(r0 + u + 1);
+                    float32x4_t cm = vld1q_f32(r1 + u - 1), cp = vld1q_f32(r1 + u + 1);
+                    float32x4_t bm = vld1q_f32(r2 + u - 1), b = vld1q_f32(r2 + u), bp = vld1q_f32(r2 + u + 1);
+                    float32x4_t dx = vaddq_f32(vaddq_f32(vaddq_f32(vsubq_f32(vsubq_f32(vnegq_f32(am), cm), bm), ap), cp), bp);
+                    float32x4_t dy = vaddq_f32(vaddq_f32(vaddq_f32(vsubq_f32(vsubq_f32(vnegq_f32(am), a), ap), bm), b), bp);
+                    uint32x4_t mask = vandq_u32(isFar, vandq_u32(vcltq_f32(vmulq_f32(dx, dx), th), vcltq_f32(vmulq_f32(dy, dy), th)));
+                    if (vmaxvq_u32(mask) == 0)
+                        continue;
+                    float64x2_t dxxLo = vaddq_f64(vsubq_f64(vcvt_f64_f32(vget_low_f32(cm)), vmulq_f64(two, vcvt_f64_f32(vget_low_f32(c)))), vcvt_f64_f32(vget_low_f32(cp)));
+                    float64x2_t dxxHi = vaddq_f64(vsubq_f64(vcvt_high_f64_f32(cm), vmulq_f64(two, vcvt_high_f64_f32(c))), vcvt_high_f64_f32(cp));
+                    float64x2_t dyyLo = vaddq_f64(vsubq_f64(vcvt_f64_f32(vget_low_f32(a)), vmulq_f64(two, vcvt_f64_f32(vget_low_f32(c)))), vcvt_f64_f32(vget_low_f32(b)));
+                    float64x2_t dyyHi = vaddq_f64(vsubq_f64(vcvt_high_f64_f32(a), vmulq_f64(two, vcvt_high_f64_f32(c))), vcvt_high_f64_f32(b));
+                    float32x4_t t = vsubq_f32(vsubq_f32(am, a), cm);
+                    float64x2_t dxyLo = vaddq_f64(vcvt_f64_f32(vget_low_f32(t)), vmulq_f64(two, vcvt_f64_f32(vget_low_f32(c))));
+                    dxyLo = vaddq_f64(vsubq_f64(vsubq_f64(dxyLo, vcvt_f64_f32(vget_low_f32(cp))), vcvt_f64_f32(vget_low_f32(b))), vcvt_f64_f32(vget_low_f32(bp)));
+                    float64x2_t dxyHi = vaddq_f64(vcvt_high_f64_f32(t), vmulq_f64(two, vcvt_high_f64_f32(c)));
+                    dxyHi = vaddq_f64(vsubq_f64(vsubq_f64(dxyHi, vcvt_high_f64_f32(cp)), vcvt_high_f64_f32(b)), vcvt_high_f64_f32(bp));
+                    float32x4_t dxx = vcvt_high_f32_f64(vcvt_f32_f64(dxxLo), dxxHi);
+                    float32x4_t dyy = vcvt_high_f32_f64(vcvt_f32_f64(dyyLo), dyyHi);
+                    float32x4_t dxy = vcvt_high_f32_f64(vcvt_f32_f64(dxyLo), dxyHi);
+                    float32x4_t det = vsubq_f32(vmulq_f32(dxx, dyy), vmulq_f32(dxy, dxy));
+                    uint32_t masks[4];
+                    float dxxs[4], dets[4];
+                    vst1q_u32(masks, mask);
+                    vst1q_f32(dxxs, dxx);
+                    vst1q_f32(dets, det);
+                    for (int k = 0; k < 4; ++k)
+                    {
+                        if (masks[k] && row[u + k] == 0)
+                            addKeypoint(u + k, v, dxxs[k], dets[k], keypoints);
+                    }
+                }
+#endif
+                for (; u < width - 1; ++u)
+                    detectScalar(r0, r1, r2, row, v, u, keypoints);
+            }
+        }
+    }; // class SDFKeypointDetector
+
+} // namespace als_ros2
+
+#endif // __SDF_KEYPOINT_DETECTOR_H__
@@ -0,0 +1,194 @@
+/****************************************************************************
+ * als_ros: An Advanced Localization System for ROS use with 2D LiDAR
+ * Copyright (C) 2022 Naoki Akai
+ *
+ * Licensed under the Apache License, Version 2.0 (the “License”);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an “AS IS” BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @author Naoki Akai
+ * modified by: Roald Ong
+ ****************************************************************************/
+
+#ifndef __SDF_MATCHING_REGIONS_H__
+#define __SDF_MATCHING_REGIONS_H__
+
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <vector>
+#include "als_ros2/Keypoint.h"
+
+namespace als_ros2
+{
+
+    /**
+     * @brief Square regions of the global map that partition the global SDF keypoints.
+     *
+     * Regions are selected by votes of coarse correspondences and by circles around prior
+     * poses, and the keypoints of the selected regions form the candidate list of the
+     * full-resolution matching. The regions only depend on the keypoint coordinates, so the
+     * index of a region is stable until the next build.
+     */
+    class SDFMatchingRegions
+    {
+    private:
+        double regionSize_;
+        double minX_, minY_;
+        int cols_, rows_;
+        std::vector<std::vector<int>> keypointIndices_;
+        std::vector<uint8_t> isSelected_;
+        std::vector<int> votes_;
+
+        inline bool intersectsCircle(int id, double x, double y, double radius)
+        {
+            double x0 = minX_ + (double)(id % cols_) * regionSize_;
+            double y0 = minY_ + (double)(id / cols_) * regionSize_;
+            double dx = std::max(std::max(x0 - x, x - (x0 + regionSize_)), 0.0);
+            double dy = std::max(std::max(y0 - y, y - (y0 + regionSize_)), 0.0);
+            return dx * dx + dy * dy <= radius * radius;
+        }
+
+    public:
+        SDFMatchingRegions(void) : regionSize_(1.0), minX_(0.0), minY_(0.0), cols_(0), rows_(0) {}
+
+        /**
+         * @brief Assigns the keypoints to the regions.
+         * @param keypoints The global SDF keypoints.
+         * @param regionSize The side length of a region [m].
+         */
+        void build(std::vector<Keypoint> &keypoints, double regionSize)
+        {
+            regionSize_ = regionSize;
+            cols_ = rows_ = 0;
+            keypointIndices_.clear();
+            if (keypoints.empty() || regionSize <= 0.0)
+                return;
+
+            double maxX = keypoints[0].getX(), maxY = keypoints[0].getY();
+            minX_ = maxX, minY_ = maxY;
+            for (int i = 1; i < (int)keypoints.size(); ++i)
+            {
+                minX_ = std::min(minX_, keypoints[i].getX());
+                minY_ = std::min(minY_, keypoints[i].getY());
+                maxX = std::max(maxX, keypoints[i].getX());
+                maxY = std::max(maxY, keypoints[i].getY());
+            }
+            cols_ = (int)((maxX - minX_) / regionSize_) + 1;
+            rows_ = (int)((maxY - minY_) / regionSize_) + 1;
+            keypointIndices_.resize(cols_ * rows_);
+            for (int i = 0; i < (int)keypoints.size(); ++i)
+                keypointIndices_[getRegionID(keypoints[i].getX(), keypoints[i].getY())].push_back(i);
+            isSelected_.assign(cols_ * rows_, 0);
+            votes_.assign(cols_ * rows_, 0);
+        }
+
+        inline int getRegionsNum(void) { return cols_ * rows_; }
+
+        /**
+         * @brief Gets the region containing a point, clamped to the regions.
+         * @param x The x coordinate [m].
+         * @param y The y coordinate [m].
+         * @return The index of the region.
+         */
+        inline int getRegionID(double x, double y)
+        {
+            int c = std::min(std::max((int)floor((x - minX_) / regionSize_), 0), cols_ - 1);
+            int r = std::min(std::max((int)floor((y - minY_) / regionSize_), 0), rows_ - 1);
+            return r * cols_ + c;
+        }
+
+        inline void getRegionCenter(int id, double *x, double *y)
+        {
+            *x = minX_ + ((double)(id % cols_) + 0.5) * regionSize_;
+            *y = minY_ + ((double)(id / cols_) + 0.5) * regionSize_;
+        }
+
+        inline double getRegionSize(void) { return regionSize_; }
+
+        inline void selectAll(void) { std::fill(isSelected_.begin(), isSelected_.end(), 1); }
+        inline void selectNone(void) { std::fill(isSelected_.begin(), isSelected_.end(), 0); }
+
+        /**
+         * @brief Selects the regions that intersect a circle.
+         */
+        void selectCircle(double x, double y, double radius)
+        {
+            for (int id = 0; id < cols_ * rows_; ++id)
+            {
+                if (intersectsCircle(id, x, y, radius))
+                    isSelected_[id] = 1;
+            }
+        }
+
+        /**
+         * @brief Deselects the regions that do not intersect a circle.
+         */
+        void restrictToCircle(double x, double y, double radius)
+        {
+            for (int id = 0; id < cols_ * rows_; ++id)
+            {
+                if (!intersectsCircle(id, x, y, radius))
+                    isSelected_[id] = 0;
+            }
+        }
+
+        inline void clearVotes(void) { std::fill(votes_.begin(), votes_.end(), 0); }
+
+        /**
+         * @brief Votes for the region containing a point if the point lies inside the regions.
+         */
+        inline void vote(double x, double y)
+        {
+            if (cols_ == 0 || x < minX_ || y < minY_ || minX_ + cols_ * regionSize_ <= x || minY_ + rows_ * regionSize_ <= y)
+                return;
+            votes_[getRegionID(x, y)]++;
+        }
+
+        /**
+         * @brief Gets the most voted regions.
+         * @param num The maximum number of regions.
+         * @return The indices of the regions with at least one vote, in descending order of votes.
+         */
+        std::vector<int> getMostVotedRegions(int num)
+        {
+            std::vector<int> ids;
+            for (int id = 0; id < cols_ * rows_; ++id)
+            {
+                if (votes_[id] > 0)
+                    ids.push_back(id);
+            }
+            std::stable_sort(ids.begin(), ids.end(), [this](int a, int b)
+                             { return votes_[a] > votes_[b]; });
+            if ((int)ids.size() > num)
+                ids.resize(num);
+            return ids;
+        }
+
+        /**
+         * @brief Gets the keypoints of the selected regions.
+         * @param indices The indices of the keypoints in ascending order.
+         */
+        void getSelectedKeypointIndices(std::vector<int> &indices)
+        {
+            indices.clear();
+            for (int id = 0; id < cols_ * rows_; ++id)
+            {
+                if (isSelected_[id])
+                    indices.insert(indices.end(), keypointIndices_[id].begin(), keypointIndices_[id].end());
+            }
+            std::sort(indices.begin(), indices.end());
+        }
+    }; // class SDFMatchingRegions
+
+} // namespace als_ros2
+
+#endif // __SDF_MATCHING_REGIONS_H__
@@ -0,0 +1,209 @@
+/****************************************************************************
+ * als_ros: An Advanced Localization System for ROS use with 2D LiDAR
+ * Copyright (C) 2022 Naoki Akai
+ *
+ * Licensed under the Apache License, Version 2.0 (the “License”);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an “AS IS” BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @author Naoki Akai
+ * modified by: Roald Ong
+ ****************************************************************************/
+
+#ifndef __SDF_OPENCL_PIPELINE_H__
+#define __SDF_OPENCL_PIPELINE_H__
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include <opencv2/core/ocl.hpp>
+#include "als_ros2/Keypoint.h"
+#include "als_ros2/SDFKeypointDetector.h"
+
+namespace als_ros2
+{
+
+    /**
+     * @brief Distance field, blur, and keypoint detection of a map on an OpenCL device.
+     *
+     * The map is uploaded once per update and the binarization, the distance transform, the
+     * resolution scaling, and the blur run on cv::UMat through OpenCV's transparent API. The
+     * keypoint test of SDFKeypointDetector runs in a kernel that appends the keypoints to a
+     * compact list, so only the list and the blurred field for the features are downloaded.
+     * The kernel evaluates the second derivatives in double precision if the device supports
+     * it, like the CPU detector; the blur is OpenCV's OpenCL implementation, so the keypoints
+     * can differ from the CPU path where a derivative is at a threshold.
+     *
+     * OpenCV has no OpenCL distance transform, so that step runs on the host through the
+     * transparent API and its mapping of the buffers.
+     */
+    class SDFOpenCLPipeline
+    {
+    private:
+        cv::UMat map_, binMap_, distMap_, blurredDistMap_;
+        cv::UMat keypointCodes_, keypointsNum_; // (cell << 2) | type code of the detected keypoints
+        cv::ocl::Kernel kernel_;
+        bool isKernelCreated_;
+        int width_, height_;
+
+        static const char *getKernelSource(void)
+        {
+            return R"(
+#if defined(cl_khr_fp64)
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+typedef double real_t;
+#else
+typedef float real_t;
+#endif
+#pragma OPENCL FP_CONTRACT OFF
+
+#define DIST(v, u) (*(__global const float *)(dist + distOffset + (v) * distStep + (u) * 4))
+
+__kernel void detectSDFKeypoints(__global const uchar *dist, int distStep, int distOffset, int rows, int cols,
+                                 __global const uchar *data, int dataStep, int dataOffset,
+                                 __global int *codes, __global int *codesNum, int maxCodesNum,
+                                 float minDist, float gradientSquareTH)
+{
+    int u = get_global_id(0), v = get_global_id(1);
+    if (u < 1 || cols - 1 <= u || v < 1 || rows - 1 <= v)
+        return;
+    float c = DIST(v, u);
+    if (data[dataOffset + v * dataStep + u] != 0 || !(c >= minDist))
+        return;
+    float am = DIST(v - 1, u - 1), a = DIST(v - 1, u), ap = DIST(v - 1, u + 1);
+    float cm = DIST(v, u - 1), cp = DIST(v, u + 1);
+    float bm = DIST(v + 1, u - 1), b = DIST(v + 1, u), bp = DIST(v + 1, u + 1);
+    float dx = -am - cm - bm + ap + cp + bp;
+    float dy = -am - a - ap + bm + b + bp;
+    if (!(dx * dx < gradientSquareTH && dy * dy < gradientSquareTH))
+        return;
+    real_t two = (real_t)2;
+    float dxx = (float)(((real_t)cm - two * (real_t)c) + (real_t)cp);
+    float dyy = (float)(((real_t)a - two * (real_t)c) + (real_t)b);
+    float dxy = (float)(((((real_t)((am - a) - cm) + two * (real_t)c) - (real_t)cp) - (real_t)b) + (real_t)bp);
+    float det = dxx * dyy - dxy * dxy;
+    int code;
+    if (det > 0.0f && dxx < 0.0f)
+        code = 1;
+    else if (det > 0.0f && dxx > 0.0f)
+        code = 2;
+    else if (det < 0.0f)
+        code = 3;
+    else
+        return;
+    int i = atomic_inc(codesNum);
+    if (i < maxCodesNum)
+        codes[i] = ((v * cols + u) << 2) | code;
+}
+)";
+        }
+
+    public:
+        SDFOpenCLPipeline(void) : isKernelCreated_(false), width_(0), height_(0) {}
+
+        static inline bool isAvailable(void) { return cv::ocl::haveOpenCL(); }
+
+        /**
+         * @brief Uploads a map and builds its distance field in meters.
+         * @param data The occupancy values of the map in row-major order.
+         * @param width The number of columns of the map.
+         * @param height The number of rows of the map.
+         * @param resolution The cell size of the map [m].
+         */
+        void buildDistanceField(const signed char *data, int width, int height, float resolution)
+        {
+            width_ = width;
+            height_ = height;
+            cv::Mat(height, width, CV_8UC1, (void *)data).copyTo(map_);
+            cv::compare(map_, cv::Scalar(100), binMap_, cv::CMP_NE);
+            cv::distanceTransform(binMap_, distMap_, cv::DIST_L2, 5);
+            cv::multiply(distMap_, cv::Scalar(resolution), distMap_);
+        }
+
+        /**
+         * @brief Blurs the distance field as the CPU path does.
+         */
+        void blur(void)
+        {
+            cv::GaussianBlur(distMap_, blurredDistMap_, cv::Size(5, 5), 5);
+            std::swap(distMap_, blurredDistMap_);
+        }
+
+        /**
+         * @brief Detects the keypoints of the distance field.
+         * @param minDist The minimum distance of a keypoint from the map.
+         * @param gradientSquareTH The threshold of the squared first derivatives.
+         * @param keypoints The keypoints with cell indices only, in no particular order.
+         * @return False if the kernel cannot be built or run, true otherwise.
+         */
+        bool detectKeypoints(double minDist, double gradientSquareTH, std::vector<Keypoint> &keypoints)
+        {
+            keypoints.clear();
+            if (!isKernelCreated_)
+            {
+                isKernelCreated_ = true;
+                kernel_.create("detectSDFKeypoints", cv::ocl::ProgramSource(getKernelSource()), "");
+            }
+            if (kernel_.empty())
+                return false;
+            if (width_ <= 2 || height_ <= 2)
+                return true;
+
+            // the thresholds are rounded as in the CPU detector
+            SDFKeypointDetector detector;
+            detector.setThresholds(minDist, gradientSquareTH);
+            int maxCodesNum = std::max(1024, width_ * height_ / 64);
+            if (keypointCodes_.cols < maxCodesNum)
+                keypointCodes_.create(1, maxCodesNum, CV_32SC1);
+            keypointsNum_.create(1, 1, CV_32SC1);
+            int codesNum = 0;
+            while (true)
+            {
+                keypointsNum_.setTo(cv::Scalar(0));
+                size_t globalSize[2] = {(size_t)width_, (size_t)height_};
+                kernel_.args(cv::ocl::KernelArg::ReadOnly(distMap_), cv::ocl::KernelArg::ReadOnlyNoSize(map_),
+                             cv::ocl::KernelArg::PtrWriteOnly(keypointCodes_), cv::ocl::KernelArg::PtrReadWrite(keypointsNum_),
+                             (int)keypointCodes_.cols, detector.getMinDist(), detector.getGradientSquareTH());
+                if (!kernel_.run(2, globalSize, NULL, true))
+                    return false;
+                codesNum = keypointsNum_.getMat(cv::ACCESS_READ).at<int>(0, 0);
+                if (codesNum <= keypointCodes_.cols)
+                    break;
+                // the list overflowed, so it is grown and the detection is repeated
+                keypointCodes_.create(1, codesNum, CV_32SC1);
+            }
+            if (codesNum == 0)
+                return true;
+
+            cv::Mat codes;
+            keypointCodes_(cv::Rect(0, 0, codesNum, 1)).copyTo(codes);
+            const int *codesData = codes.ptr<int>(0);
+            const char types[4] = {0, 1, -1, 0};
+            keypoints.reserve(codesNum);
+            for (int i = 0; i < codesNum; ++i)
+            {
+                int n = codesData[i] >> 2;
+                keypoints.push_back(Keypoint(n % width_, n / width_, 0.0, 0.0, types[codesData[i] & 3]));
+            }
+            return true;
+        }
+
+        /**
+         * @brief Downloads the distance field.
+         * @param distMap The distance field.
+         */
+        void download(cv::Mat &distMap) { distMap_.copyTo(distMap); }
+    }; // class SDFOpenCLPipeline
+
+} // namespace als_ros2
+
+#endif // __SDF_OPENCL_PIPELINE_H__
@@ -0,0 +1,203 @@
+/****************************************************************************
+ * als_ros: An Advanced Localization System for ROS use with 2D LiDAR
+ * Copyright (C) 2022 Naoki Akai
+ *
+ * Licensed under the Apache License, Version 2.0 (the “License”);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an “AS IS” BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @author Naoki Akai
+ * modified by: Roald Ong
+ ****************************************************************************/
+
+
+#ifndef __SDF_ORIENTATION_MAP_H__
+#define __SDF_ORIENTATION_MAP_H__
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+#include "als_ros2/SDFFeatureSet.h"
+
+namespace als_ros2
+{
+
+    /**
+     * @brief Dense gradient orientations and a summed-area table of a distance field.
+     *
+     * The orientation of every cell is computed once per distance field instead of once per
+     * feature window that contains the cell, and the average SDF of a window is read from the
+     * summed-area table with four lookups. A cell stores the 10-degree bin of its orientation,
+     * and whether the orientation lies exactly on the lower bin edge, so that the relative
+     * orientation histogram derived from the bin counts is the same as the one computed from
+     * the orientations themselves.
+     */
+    class SDFOrientationMap
+    {
+    public:
+        static const int ORIENTATION_BINS_NUM = 36;
+
+    private:
+        static const int CODES_NUM = 2 * ORIENTATION_BINS_NUM;
+        static const uint8_t INVALID_CODE = 255;
+
+        int width_, height_;
+        std::vector<uint8_t> codes_; // (bin << 1) | isInsideBin
+        std::vector<double> sums_;   // (width + 1) x (height + 1), cells of the first row and column are excluded
+
+        inline double getSum(int u0, int v0, int u1, int v1)
+        {
+            int w = width_ + 1;
+            return sums_[v1 * w + u1] - sums_[v0 * w + u1] - sums_[v1 * w + u0] + sums_[v0 * w + u0];
+        }
+
+    public:
+        SDFOrientationMap(void) : width_(0), height_(0) {}
+
+        /**
+         * @brief Allocates the maps for a distance field.
+         * @param width The number of columns of the distance field.
+         * @param height The number of rows of the distance field.
+         */
+        void reset(int width, int height)
+        {
+            width_ = width;
+            height_ = height;
+            codes_.assign((size_t)width * height, (uint8_t)INVALID_CODE);
+            sums_.assign((size_t)(width + 1) * (height + 1), 0.0);
+        }
+
+        /**
+         * @brief Computes the orientations of the rows [vBegin, vEnd).
+         *
+         * Rows of disjoint ranges can be computed concurrently. The gradient of the last row and
+         * column uses the border cell in place of the missing neighbour.
+         *
+         * @param dist The distance field in row-major order.
+         * @param stride The number of floats between two rows of the distance field.
+         * @param vBegin The first row.
+         * @param vEnd The row after the last row.
+         */
+        void buildRows(const float *dist, size_t stride, int vBegin, int vEnd)
+        {
+            for (int v = std::max(vBegin, 1); v < vEnd; ++v)
+            {
+                const float *r0 = dist + (v - 1) * stride;
+                const float *r1 = dist + v * stride;
+                const float *r2 = dist + ((v + 1 < height_) ? v + 1 : v) * stride;
+                uint8_t *codes = &codes_[(size_t)v * width_];
+                for (int u = 1; u < width_; ++u)
+                {
+                    int ur = (u + 1 < width_) ? u + 1 : u;
+                    float dx = -r0[u - 1] - r1[u - 1] - r2[u - 1] + r0[ur] + r1[ur] + r2[ur];
+                    float dy = -r0[u - 1] - r0[u] - r0[ur] + r2[u - 1] + r2[u] + r2[ur];
+                    double t = atan2((double)dy, (double)dx) * 180.0 / M_PI;
+                    if (t < 0.0)
+                        t += 360.0;
+                    int bin = (int)(t / 10.0);
+                    if (0 <= bin && bin < ORIENTATION_BINS_NUM)
+                        codes[u] = (uint8_t)((bin << 1) | ((t == (double)bin * 10.0) ? 0 : 1));
+                }
+            }
+        }
+
+        /**
+         * @brief Builds the summed-area table of the distance field.
+         * @param dist The distance field in row-major order.
+         * @param stride The number of floats between two rows of the distance field.
+         */
+        void buildSums(const float *dist, size_t stride)
+        {
+            int w = width_ + 1;
+            for (int v = 1; v < height_; ++v)
+            {
+                const float *row = dist + v * stride;
+                double rowSum = 0.0;
+                for (int u = 1; u < width_; ++u)
+                {
+                    rowSum += (double)row[u];
+                    sums_[(v + 1) * w + u + 1] = sums_[v * w + u + 1] + rowSum;
+                }
+            }
+        }
+
+        /**
+         * @brief Computes the feature of the window of radius r around a cell.
+         *
+         * Cells of the first row and column are not part of any window.
+         *
+         * @param uo The column of the keypoint.
+         * @param vo The row of the keypoint.
+         * @param r The radius of the window in cells.
+         * @param features The feature set to write to.
+         * @param idx The index of the feature.
+         */
+        void computeFeature(int uo, int vo, int r, SDFFeatureSet &features, int idx)
+        {
+            int u0 = std::max(uo - r, 1), u1 = std::min(uo + r + 1, width_);
+            int v0 = std::max(vo - r, 1), v1 = std::min(vo + r + 1, height_);
+            int counts[CODES_NUM] = {0};
+            int cellNum = 0;
+            double distSum = 0.0;
+            if (u0 < u1 && v0 < v1)
+            {
+                cellNum = (u1 - u0) * (v1 - v0);
+                distSum = getSum(u0, v0, u1, v1);
+                for (int v = v0; v < v1; ++v)
+                {
+                    const uint8_t *codes = &codes_[(size_t)v * width_];
+                    for (int u = u0; u < u1; ++u)
+                    {
+                        if (codes[u] != INVALID_CODE)
+                            counts[codes[u]]++;
+                    }
+                }
+            }
+
+            int maxVal = counts[0] + counts[1];
+            int domBin = 0;
+            for (int b = 1; b < ORIENTATION_BINS_NUM; ++b)
+            {
+                int val = counts[2 * b] + counts[2 * b + 1];
+                if (val > maxVal)
+                {
+                    maxVal = val;
+                    domBin = b;
+                }
+            }
+            double domOrient = (double)domBin * 10.0;
+
+            // every orientation inside a bin falls into the same relative bin, so the bin centre stands for them
+            int relOrientHist[SDFFeatureSet::HIST_SIZE] = {0};
+            for (int c = 0; c < CODES_NUM; ++c)
+            {
+                if (counts[c] == 0)
+                    continue;
+                double t = (double)(c >> 1) * 10.0 + ((c & 1) ? 5.0 : 0.0);
+                double dt = domOrient - t;
+                while (dt > 180.0)
+                    dt -= 360.0;
+                while (dt < -180.0)
+                    dt += 360.0;
+                int relOrientIdx = (int)(fabs(dt) / 10.0);
+                if (0 <= relOrientIdx && relOrientIdx < SDFFeatureSet::HIST_SIZE)
+                    relOrientHist[relOrientIdx] += counts[c];
+            }
+
+            features.set(idx, domOrient * M_PI / 180.0, (double)(float)(distSum / (double)cellNum), relOrientHist);
+        }
+    }; // class SDFOrientationMap
+
+} // namespace als_ros2
+
+#endif // __SDF_ORIENTATION_MAP_H__
@@ -0,0 +1,172 @@
+/****************************************************************************
+ * als_ros: An Advanced Localization System for ROS use with 2D LiDAR
+ * Copyright (C) 2022 Naoki Akai
+ *
+ * Licensed under the Apache License, Version 2.0 (the “License”);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an “AS IS” BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @author Naoki Akai
+ * modified by: Roald Ong
+ ****************************************************************************/
+
+
+#ifndef __STAGE_PROFILER_H__
+#define __STAGE_PROFILER_H__
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace als_ros2
+{
+
+    /**
+     * @brief Rolling windows of latency and count samples with percentile summaries.
+     *
+     * Every series keeps its most recent samples in a fixed ring, so recording is a store
+     * under a mutex and the percentiles are computed only when a summary is requested.
+     */
+    class StageProfiler
+    {
+    public:
+        struct Summary
+        {
+            std::string name;
+            long samplesNum;
+            double p50, p95, p99, max;
+        };
+
+    private:
+        struct Series
+        {
+            std::string name;
+            std::vector<double> samples;
+            long samplesNum;
+        };
+
+        std::mutex mutex_;
+        std::vector<Series> series_;
+        int windowSize_;
+
+        static inline double getPercentile(std::vector<double> &sorted, double p)
+        {
+            int idx = (int)ceil(p * (double)sorted.size()) - 1;
+            return sorted[std::min(std::max(idx, 0), (int)sorted.size() - 1)];
+        }
+
+    public:
+        StageProfiler(void) : windowSize_(1) {}
+
+        /**
+         * @brief Defines the series and forgets all samples.
+         * @param names The names of the series; series i is recorded with index i.
+         * @param windowSize The number of recent samples a summary is computed from.
+         */
+        void reset(const std::vector<std::string> &names, int windowSize)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            windowSize_ = std::max(windowSize, 1);
+            series_.resize(names.size());
+            for (size_t i = 0; i < names.size(); ++i)
+            {
+                series_[i].name = names[i];
+                series_[i].samples.assign(windowSize_, 0.0);
+                series_[i].samplesNum = 0;
+            }
+        }
+
+        /**
+         * @brief Records a sample.
+         * @param id The index of the series.
+         * @param val The sample.
+         */
+        inline void record(int id, double val)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            Series &s = series_[id];
+            s.samples[s.samplesNum % windowSize_] = val;
+            s.samplesNum++;
+        }
+
+        /**
+         * @brief Computes the percentiles of the recent samples of every series that has samples.
+         * @return The summaries in the order of the series.
+         */
+        std::vector<Summary> summarize(void)
+        {
+            std::vector<Summary> summaries;
+            std::vector<double> sorted;
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (size_t i = 0; i < series_.size(); ++i)
+            {
+                Series &s = series_[i];
+                if (s.samplesNum == 0)
+                    continue;
+                int num = (int)std::min(s.samplesNum, (long)windowSize_);
+                sorted.assign(s.samples.begin(), s.samples.begin() + num);
+                std::sort(sorted.begin(), sorted.end());
+                Summary summary;
+                summary.name = s.name;
+                summary.samplesNum = s.samplesNum;
+                summary.p50 = getPercentile(sorted, 0.50);
+                summary.p95 = getPercentile(sorted, 0.95);
+                summary.p99 = getPercentile(sorted, 0.99);
+                summary.max = sorted.back();
+                summaries.push_back(summary);
+            }
+            return summaries;
+        }
+    }; // class StageProfiler
+
+    /**
+     * @brief Steady clock that records the time since its previous lap in milliseconds.
+     */
+    class StageClock
+    {
+    private:
+        std::chrono::steady_clock::time_point start_, last_;
+
+    public:
+        StageClock(void) : start_(std::chrono::steady_clock::now()), last_(start_) {}
+
+        inline void lap(StageProfiler &profiler, int id)
+        {
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            profiler.record(id, std::chrono::duration<double, std::milli>(now - last_).count());
+            last_ = now;
+        }
+
+        inline void total(StageProfiler &profiler, int id)
+        {
+            profiler.record(id, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_).count());
+        }
+    }; // class StageClock
+
+} // namespace als_ros2
+
+// the instrumentation compiles to nothing unless ALS_ROS2_ENABLE_PROFILING is defined
+#if defined(ALS_ROS2_ENABLE_PROFILING)
+#define ALS_ROS2_PROFILE_START(clock) als_ros2::StageClock clock
+#define ALS_ROS2_PROFILE_LAP(clock, profiler, id) (clock).lap(profiler, id)
+#define ALS_ROS2_PROFILE_TOTAL(clock, profiler, id) (clock).total(profiler, id)
+#define ALS_ROS2_PROFILE_COUNT(profiler, id, val) (profiler).record(id, (double)(val))
+#else
+#define ALS_ROS2_PROFILE_START(clock)
+#define ALS_ROS2_PROFILE_LAP(clock, profiler, id) ((void)0)
+#define ALS_ROS2_PROFILE_TOTAL(clock, profiler, id) ((void)0)
+#define ALS_ROS2_PROFILE_COUNT(profiler, id, val) ((void)sizeof(val)) // marks the counted variables as used without evaluating them
+#endif
+
+#endif // __STAGE_PROFILER_H__
@@ -0,0 +1,189 @@
+/****************************************************************************
+ * als_ros: An Advanced Localization System for ROS use with 2D LiDAR
+ * Copyright (C) 2022 Naoki Akai
+ *
+ * Licensed under the Apache License, Version 2.0 (the “License”);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an “AS IS” BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @author Naoki Akai
+ * modified by: Roald Ong
+ ****************************************************************************/
+
+#ifndef __TRANSFORM_2D_H__
+#define __TRANSFORM_2D_H__
+
+#include <cmath>
+
+namespace als_ros2
+{
+
+    /**
+     * @brief Rigid 2D transform with its rotation cached.
+     *
+     * The cosine and sine of the yaw angle are computed once when the transform is set, so
+     * transforming a point costs four multiplications. The batched methods work on structures
+     * of arrays and have no dependencies between points, so the compiler can vectorize them.
+     */
+    class Transform2D
+    {
+    private:
+        double x_, y_, yaw_, cos_, sin_;
+
+    public:
+        Transform2D(void) : x_(0.0), y_(0.0), yaw_(0.0), cos_(1.0), sin_(0.0) {}
+
+        Transform2D(double x, double y, double yaw) { set(x, y, yaw); }
+
+        /**
+         * @brief Sets the transform.
+         * @param x The x coordinate of the child frame in the parent frame [m].
+         * @param y The y coordinate of the child frame in the parent frame [m].
+         * @param yaw The yaw angle of the child frame in the parent frame [rad].
+         */
+        inline void set(double x, double y, double yaw)
+        {
+            x_ = x, y_ = y, yaw_ = yaw;
+            cos_ = cos(yaw), sin_ = sin(yaw);
+        }
+
+        inline double getX(void) { return x_; }
+        inline double getY(void) { return y_; }
+        inline double getYaw(void) { return yaw_; }
+        inline double getCos(void) { return cos_; }
+        inline double getSin(void) { return sin_; }
+
+        /**
+         * @brief Rotates a vector by the yaw angle.
+         */
+        inline void rotate(double x, double y, double *rx, double *ry)
+        {
+            *rx = x * cos_ - y * sin_;
+            *ry = x * sin_ + y * cos_;
+        }
+
+        /**
+         * @brief Transforms a point from the child frame to the parent frame.
+         */
+        inline void transform(double x, double y, double *tx, double *ty)
+        {
+            *tx = x * cos_ - y * sin_ + x_;
+            *ty = x * sin_ + y * cos_ + y_;
+        }
+
+        /**
+         * @brief Transforms a point from the parent frame to the child frame.
+         */
+        inline void inverseTransform(double x, double y, double *tx, double *ty)
+        {
+            double dx = x - x_, dy = y - y_;
+            *tx = dx * cos_ + dy * sin_;
+            *ty = -dx * sin_ + dy * cos_;
+        }
+
+        /**
+         * @brief Transforms points from the child frame to the parent frame. The output may alias the input.
+         * @param num The number of points.
+         * @param xs The x coordinates in the child frame.
+         * @param ys The y coordinates in the child frame.
+         * @param txs The x coordinates in the parent frame.
+         * @param tys The y coordinates in the parent frame.
+         */
+        void transformPoints(int num, const double *xs, const double *ys, double *txs, double *tys)
+        {
+            double c = cos_, s = sin_, x0 = x_, y0 = y_;
+            for (int i = 0; i < num; ++i)
+            {
+                double x = xs[i], y = ys[i];
+                txs[i] = x * c - y * s + x0;
+                tys[i] = x * s + y * c + y0;
+            }
+        }
+
+        /**
+         * @brief Transforms points from the parent frame to the child frame. The output may alias the input.
+         */
+        void inverseTransformPoints(int num, const double *xs, const double *ys, double *txs, double *tys)
+        {
+            double c = cos_, s = sin_, x0 = x_, y0 = y_;
+            for (int i = 0; i < num; ++i)
+            {
+                double dx = xs[i] - x0, dy = ys[i] - y0;
+                txs[i] = dx * c + dy * s;
+                tys[i] = -dx * s + dy * c;
+            }
+        }
+    }; // class Transform2D
+
+    /**
+     * @brief Transform between the frame of an occupancy grid and its cells.
+     *
+     * Holds the grid origin as a Transform2D and the resolution, so the conversions between
+     * metric coordinates and cell indices need no trigonometry. Cell indices are truncated
+     * towards zero as in the original xy2uv.
+     */
+    class GridTransform
+    {
+    private:
+        Transform2D origin_;
+        double resolution_, invResolution_;
+
+    public:
+        GridTransform(void) : resolution_(1.0), invResolution_(1.0) {}
+
+        GridTransform(double originX, double originY, double originYaw, double resolution) { set(originX, originY, originYaw, resolution); }
+
+        /**
+         * @brief Sets the grid geometry.
+         * @param originX The x coordinate of the grid origin [m].
+         * @param originY The y coordinate of the grid origin [m].
+         * @param originYaw The yaw angle of the grid origin [rad].
+         * @param resolution The cell size [m].
+         */
+        inline void set(double originX, double originY, double originYaw, double resolution)
+        {
+            origin_.set(originX, originY, originYaw);
+            resolution_ = resolution;
+            invResolution_ = 1.0 / resolution;
+        }
+
+        inline Transform2D &getOrigin(void) { return origin_; }
+        inline double getResolution(void) { return resolution_; }
+        inline double getInvResolution(void) { return invResolution_; }
+
+        /**
+         * @brief Converts a point to continuous grid coordinates in cells.
+         */
+        inline void xy2grid(double x, double y, double *gu, double *gv)
+        {
+            double xx, yy;
+            origin_.inverseTransform(x, y, &xx, &yy);
+            *gu = xx * invResolution_;
+            *gv = yy * invResolution_;
+        }
+
+        inline void xy2uv(double x, double y, int *u, int *v)
+        {
+            double xx, yy;
+            origin_.inverseTransform(x, y, &xx, &yy);
+            *u = (int)(xx / resolution_);
+            *v = (int)(yy / resolution_);
+        }
+
+        inline void uv2xy(int u, int v, double *x, double *y)
+        {
+            origin_.transform((double)u * resolution_, (double)v * resolution_, x, y);
+        }
+    }; // class GridTransform
+
+} // namespace als_ros2
+
+#endif // __TRANSFORM_2D_H__
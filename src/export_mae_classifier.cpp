@@ -0,0 +1,37 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <als_ros2/MAEClassifier.h>
+
+
+// converts the text files of an MAE classifier into the binary model classifier.bin
+// usage: export_mae_classifier <classifiers_dir> [mae_step=0.001]
+int main(int argc, char * argv[])
+{
+  if (argc < 2)
+  {
+    fprintf(stderr, "usage: %s <classifiers_dir> [mae_step=0.001]\n", argv[0]);
+    return 1;
+  }
+  std::string classifiersDir = argv[1];
+  if (classifiersDir.back() != '/')
+    classifiersDir += "/";
+  double maeStep = (argc >= 3) ? atof(argv[2]) : 0.001;
+  if (maeStep <= 0.0)
+  {
+    fprintf(stderr, "mae_step must be positive\n");
+    return 1;
+  }
+
+  als_ros2::MAEClassifier classifier;
+  classifier.setClassifierDir(classifiersDir);
+  classifier.readClassifierParams();
+  classifier.buildDecisionTable(maeStep);
+  if (!classifier.writeDecisionTable())
+  {
+    fprintf(stderr, "cannot write %sclassifier.bin\n", classifiersDir.c_str());
+    return 1;
+  }
+  printf("binary model for the MAE classifier was saved at %sclassifier.bin\n", classifiersDir.c_str());
+  return 0;
+}
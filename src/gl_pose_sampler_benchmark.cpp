@@ -0,0 +1,722 @@
+/****************************************************************************
+ * als_ros: An Advanced Localization System for ROS use with 2D LiDAR
+ * Copyright (C) 2022 Naoki Akai
+ *
+ * Licensed under the Apache License, Version 2.0 (the “License”);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an “AS IS” BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @author Naoki Akai
+ * modified by: Roald Ong
+ ****************************************************************************/
+
+/*
+ * Offline benchmark of the GL pose sampler stages without ROS.
+ *
+ * Usage:
+ *   gl_pose_sampler_benchmark [benchmark flags] [--map=<map.yaml>] [--scans=<scans.txt>]
+ *       [--map_sizes=50,100] [--beams_nums=360,1080] [--key_scans_num=20] [--threads_num=1]
+ *       [--scan_range=20] [--random_seed=0] [--incremental_local_map]
+ *
+ * Without --map, square maps of rooms with the side lengths of --map_sizes [m] are generated.
+ * With --map, the map is loaded from a map_server YAML file and --map_sizes are scale factors
+ * of its resolution. Without --scans, the scans are ray cast along a path through the map
+ * with the beam counts of --beams_nums. A scan file has one scan per line:
+ *   <angle_min> <angle_increment> <range_min> <range_max> <odom_x> <odom_y> <odom_yaw> <n> <r_0> ... <r_n-1>
+ * and its scans are decimated to the beam counts of --beams_nums. Every update of the end to
+ * end benchmark pushes the next key scan and runs estimatePoses, so its time per iteration is
+ * the latency of one update. The *_opencl stages run the distance field, the blur, and the
+ * keypoint detection on the OpenCL pipeline, including the uploads and downloads, and are
+ * skipped if no OpenCL device is available; detect_keypoints_opencl counts the keypoints that
+ * differ from the CPU detection as cpu_mismatches.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include <als_ros2/GLPoseSamplerCore.h>
+
+namespace als_ros2
+{
+
+    struct BenchmarkOptions
+    {
+        std::string mapFile, scansFile;
+        std::vector<double> mapSizes;
+        std::vector<int> beamsNums;
+        int keyScansNum;
+        int threadsNum;
+        double scanRange;
+        double resolution;
+        bool useIncrementalLocalMap;
+        int randomSeed;
+
+        BenchmarkOptions(void) : mapSizes({50.0, 100.0}), beamsNums({360, 1080}), keyScansNum(20), threadsNum(1),
+                                 scanRange(20.0), resolution(0.05), useIncrementalLocalMap(false), randomSeed(0) {}
+    };
+
+    /**
+     * @brief GLPoseSamplerCore whose parameters are set from the benchmark options.
+     */
+    class BenchmarkSampler : public GLPoseSamplerCore
+    {
+    public:
+        void configure(const BenchmarkOptions &options)
+        {
+            preprocessingThreadsNum_ = poseGenerationThreadsNum_ = options.threadsNum;
+            useIncrementalLocalMap_ = options.useIncrementalLocalMap;
+            setRandomSeed((uint64_t)options.randomSeed);
+        }
+
+        inline double getGradientSquareTH(void) { return gradientSquareTH_; }
+        inline double getMapResolution(void) { return mapResolution_; }
+        inline double getKeypointsMinDistFromMap(void) { return keypointsMinDistFromMap_; }
+    }; // class BenchmarkSampler
+
+    struct ScanRecord
+    {
+        sensor_msgs::msg::LaserScan::ConstSharedPtr scan;
+        Pose odomPose;
+    };
+
+    /**
+     * @brief A map, a key scan sequence, and the intermediate results of the first update.
+     *
+     * The dataset is built when one of its benchmarks runs first, so filtered out
+     * configurations cost nothing.
+     */
+    class BenchmarkDataset
+    {
+    private:
+        BenchmarkOptions options_;
+        double mapSize_;
+        int beamsNum_;
+        bool isBuilt_;
+        std::string error_;
+
+        /*
+         * Parses the flat key: value pairs of a map_server YAML file.
+         */
+        bool loadMap(const std::string &yamlFile, double scale, nav_msgs::msg::OccupancyGrid &map)
+        {
+            std::ifstream ifs(yamlFile);
+            if (!ifs)
+            {
+                error_ = "cannot open " + yamlFile;
+                return false;
+            }
+            std::string image;
+            double resolution = 0.05, originX = 0.0, originY = 0.0, originYaw = 0.0;
+            double occupiedTH = 0.65, freeTH = 0.196;
+            int negate = 0;
+            std::string line;
+            while (std::getline(ifs, line))
+            {
+                size_t colon = line.find(':');
+                if (colon == std::string::npos || line[0] == '#')
+                    continue;
+                std::string key = line.substr(0, colon);
+                std::string val = line.substr(colon + 1);
+                key.erase(0, key.find_first_not_of(" \t"));
+                key.erase(key.find_last_not_of(" \t") + 1);
+                val.erase(0, val.find_first_not_of(" \t\"'"));
+                val.erase(val.find_last_not_of(" \t\r\"'") + 1);
+                if (key == "image")
+                    image = val;
+                else if (key == "resolution")
+                    resolution = atof(val.c_str());
+                else if (key == "negate")
+                    negate = atoi(val.c_str());
+                else if (key == "occupied_thresh")
+                    occupiedTH = atof(val.c_str());
+                else if (key == "free_thresh")
+                    freeTH = atof(val.c_str());
+                else if (key == "origin")
+                    sscanf(val.c_str(), "[%lf , %lf , %lf]", &originX, &originY, &originYaw);
+            }
+            if (!image.empty() && image[0] != '/')
+            {
+                size_t slash = yamlFile.find_last_of('/');
+                if (slash != std::string::npos)
+                    image = yamlFile.substr(0, slash + 1) + image;
+            }
+            cv::Mat img = cv::imread(image, cv::IMREAD_GRAYSCALE);
+            if (img.empty())
+            {
+                error_ = "cannot read " + image;
+                return false;
+            }
+            if (scale != 1.0)
+                cv::resize(img, img, cv::Size((int)(img.cols * scale), (int)(img.rows * scale)), 0, 0, cv::INTER_NEAREST);
+
+            map.info.width = img.cols;
+            map.info.height = img.rows;
+            map.info.resolution = resolution / scale;
+            map.info.origin.position.x = originX;
+            map.info.origin.position.y = originY;
+            tf2::Quaternion q;
+            q.setRPY(0, 0, originYaw);
+            map.info.origin.orientation = tf2::toMsg(q);
+            map.data.resize((size_t)img.cols * img.rows);
+            for (int row = 0; row < img.rows; ++row)
+            {
+                // the first image row is the top of the map
+                const uchar *pixels = img.ptr<uchar>(row);
+                signed char *cells = &map.data[(size_t)(img.rows - 1 - row) * img.cols];
+                for (int col = 0; col < img.cols; ++col)
+                {
+                    double p = negate ? (double)pixels[col] / 255.0 : (255.0 - (double)pixels[col]) / 255.0;
+                    if (p > occupiedTH)
+                        cells[col] = 100;
+                    else if (p < freeTH)
+                        cells[col] = 0;
+                    else
+                        cells[col] = -1;
+                }
+            }
+            return true;
+        }
+
+        /*
+         * Generates a square map of 10 m rooms with doors and pillars. The path at y = 5 m runs
+         * through the doors of the first row of rooms.
+         */
+        void generateMap(double size, nav_msgs::msg::OccupancyGrid &map)
+        {
+            double resolution = options_.resolution;
+            int cellsNum = (int)(size / resolution);
+            map.info.width = map.info.height = cellsNum;
+            map.info.resolution = resolution;
+            map.info.origin.orientation.w = 1.0;
+            map.data.assign((size_t)cellsNum * cellsNum, 0);
+            int wallCells = std::max(1, (int)(0.1 / resolution));
+            int roomCells = (int)(10.0 / resolution);
+            int doorHalfCells = (int)(1.0 / resolution);
+            for (int v = 0; v < cellsNum; ++v)
+            {
+                for (int u = 0; u < cellsNum; ++u)
+                {
+                    bool isBorder = u < wallCells || v < wallCells || u >= cellsNum - wallCells || v >= cellsNum - wallCells;
+                    bool isVerticalWall = u % roomCells < wallCells && abs(v % roomCells - roomCells / 2) > doorHalfCells;
+                    bool isHorizontalWall = v % roomCells < wallCells && abs(u % roomCells - roomCells / 2) > doorHalfCells;
+                    if (isBorder || isVerticalWall || isHorizontalWall)
+                        map.data[(size_t)v * cellsNum + u] = 100;
+                }
+            }
+
+            std::mt19937 engine(1);
+            std::uniform_real_distribution<double> position(0.5, size - 0.5);
+            int pillarCells = std::max(1, (int)(0.3 / resolution));
+            int pillarsNum = (int)(size * size / 20.0);
+            for (int i = 0; i < pillarsNum; ++i)
+            {
+                double x = position(engine), y = position(engine);
+                if (y < 10.0 && fabs(y - 5.0) < 2.0)
+                    continue;
+                int u0 = (int)(x / resolution), v0 = (int)(y / resolution);
+                for (int v = v0; v < v0 + pillarCells && v < cellsNum; ++v)
+                {
+                    for (int u = u0; u < u0 + pillarCells && u < cellsNum; ++u)
+                        map.data[(size_t)v * cellsNum + u] = 100;
+                }
+            }
+        }
+
+        /*
+         * Loads the scan file and keeps the scans that are key scans for the default intervals.
+         */
+        bool loadScans(const std::string &scansFile, std::vector<ScanRecord> &scans)
+        {
+            std::ifstream ifs(scansFile);
+            if (!ifs)
+            {
+                error_ = "cannot open " + scansFile;
+                return false;
+            }
+            std::string line;
+            Pose prevOdomPose;
+            while (std::getline(ifs, line))
+            {
+                if (line.empty() || line[0] == '#')
+                    continue;
+                std::istringstream iss(line);
+                auto scan = std::make_shared<sensor_msgs::msg::LaserScan>();
+                double x, y, yaw;
+                int n;
+                iss >> scan->angle_min >> scan->angle_increment >> scan->range_min >> scan->range_max >> x >> y >> yaw >> n;
+                if (!iss || n <= 0)
+                    continue;
+                scan->ranges.resize(n);
+                for (int j = 0; j < n; ++j)
+                    iss >> scan->ranges[j];
+                if (!iss)
+                    continue;
+
+                double dyaw = yaw - prevOdomPose.getYaw();
+                dyaw = atan2(sin(dyaw), cos(dyaw));
+                if (!scans.empty() && hypot(x - prevOdomPose.getX(), y - prevOdomPose.getY()) <= 0.25 && fabs(dyaw) <= 5.0 * M_PI / 180.0)
+                    continue;
+                prevOdomPose.setPose(x, y, yaw);
+                scan->angle_max = scan->angle_min + scan->angle_increment * (float)(n - 1);
+                scans.push_back({decimateScan(scan), Pose(x, y, yaw)});
+            }
+            if (scans.empty())
+            {
+                error_ = "no scans in " + scansFile;
+                return false;
+            }
+            return true;
+        }
+
+        sensor_msgs::msg::LaserScan::ConstSharedPtr decimateScan(const sensor_msgs::msg::LaserScan::SharedPtr &scan)
+        {
+            int n = (int)scan->ranges.size();
+            if (beamsNum_ <= 0 || beamsNum_ >= n)
+                return scan;
+            int stride = n / beamsNum_;
+            std::vector<float> ranges;
+            for (int j = 0; j < n; j += stride)
+                ranges.push_back(scan->ranges[j]);
+            scan->ranges.swap(ranges);
+            scan->angle_increment *= (float)stride;
+            return scan;
+        }
+
+        /*
+         * Ray casts scans with a step of the key scan interval along a slightly winding path.
+         */
+        void generateScans(const nav_msgs::msg::OccupancyGrid &map, std::vector<ScanRecord> &scans)
+        {
+            int width = map.info.width, height = map.info.height;
+            double resolution = map.info.resolution;
+            double originX = map.info.origin.position.x, originY = map.info.origin.position.y;
+            double length = std::min((double)width * resolution - 2.0, 50.0);
+            double step = 0.5 * resolution;
+            for (double s = 0.0; s < length; s += 0.3)
+            {
+                double x = originX + 1.0 + s;
+                double y = originY + 5.0 + 0.5 * sin(s / 3.0);
+                double yaw = atan2(0.5 / 3.0 * cos(s / 3.0), 1.0);
+
+                auto scan = std::make_shared<sensor_msgs::msg::LaserScan>();
+                scan->angle_min = -M_PI;
+                scan->angle_increment = 2.0 * M_PI / beamsNum_;
+                scan->angle_max = scan->angle_min + scan->angle_increment * (float)(beamsNum_ - 1);
+                scan->range_min = 0.1;
+                scan->range_max = options_.scanRange;
+                scan->ranges.resize(beamsNum_);
+                for (int j = 0; j < beamsNum_; ++j)
+                {
+                    double t = yaw + scan->angle_min + scan->angle_increment * j;
+                    double dx = cos(t), dy = sin(t);
+                    float range = std::numeric_limits<float>::infinity();
+                    for (double r = scan->range_min; r < scan->range_max; r += step)
+                    {
+                        int u = (int)floor((x + r * dx - originX) / resolution);
+                        int v = (int)floor((y + r * dy - originY) / resolution);
+                        if (u < 0 || width <= u || v < 0 || height <= v)
+                            break;
+                        if (map.data[(size_t)v * width + u] == 100)
+                        {
+                            range = (float)r;
+                            break;
+                        }
+                    }
+                    scan->ranges[j] = range;
+                }
+                scans.push_back({scan, Pose(x, y, yaw)});
+            }
+        }
+
+    public:
+        std::string label;
+        nav_msgs::msg::OccupancyGrid::ConstSharedPtr map;
+        std::vector<ScanRecord> scans;
+        std::unique_ptr<BenchmarkSampler> sampler;
+        KeyScanRing keyScans; // filled with the first key_scans_num scans
+        nav_msgs::msg::OccupancyGrid localMap;
+        cv::Mat localDistMap; // blurred
+        std::vector<Keypoint> localSDFKeypoints;
+        SDFFeatureSet localSDFOrientationFeatures;
+        std::vector<int> correspondingIndices;
+        geometry_msgs::msg::PoseArray poses;
+
+        BenchmarkDataset(const BenchmarkOptions &options, double mapSize, int beamsNum)
+            : options_(options), mapSize_(mapSize), beamsNum_(beamsNum), isBuilt_(false)
+        {
+            char name[64];
+            if (options_.mapFile.empty())
+                snprintf(name, sizeof(name), "map:%gm/beams:%d", mapSize_, beamsNum_);
+            else
+                snprintf(name, sizeof(name), "map:x%g/beams:%d", mapSize_, beamsNum_);
+            label = name;
+        }
+
+        inline const BenchmarkOptions &getOptions(void) { return options_; }
+
+        /**
+         * @brief Builds the dataset if it was not built yet.
+         * @return An empty string on success, the error message otherwise.
+         */
+        std::string build(void)
+        {
+            if (isBuilt_)
+                return error_;
+            isBuilt_ = true;
+
+            auto mapMsg = std::make_shared<nav_msgs::msg::OccupancyGrid>();
+            if (options_.mapFile.empty())
+                generateMap(mapSize_, *mapMsg);
+            else if (!loadMap(options_.mapFile, mapSize_, *mapMsg))
+                return error_;
+            map = mapMsg;
+            if (options_.scansFile.empty())
+                generateScans(*map, scans);
+            else if (!loadScans(options_.scansFile, scans))
+                return error_;
+            if ((int)scans.size() < options_.keyScansNum)
+            {
+                error_ = "fewer scans than key_scans_num";
+                return error_;
+            }
+
+            sampler.reset(new BenchmarkSampler());
+            sampler->configure(options_);
+            sampler->updateMap(map);
+            keyScans.reset(options_.keyScansNum);
+            for (int i = 0; i < options_.keyScansNum; ++i)
+                keyScans.push(scans[i].scan, scans[i].odomPose);
+
+            Pose &odomPose = scans[options_.keyScansNum - 1].odomPose;
+            localMap = sampler->buildLocalMap(keyScans);
+            localDistMap = sampler->buildDistanceFieldMap(localMap);
+            cv::GaussianBlur(localDistMap, localDistMap, cv::Size(5, 5), 5);
+            localSDFKeypoints = sampler->detectKeypoints(localMap, localDistMap, sampler->getGradientSquareTH());
+            localSDFOrientationFeatures = sampler->calculateFeatures(localDistMap, sampler->getMapResolution(), localSDFKeypoints);
+            correspondingIndices = sampler->findCorrespondingFeatures(localSDFKeypoints, localSDFOrientationFeatures);
+            sampler->setMatchingRateScan(keyScans.getScan(keyScans.getSize() - 1), keyScans.isReversed());
+            poses = sampler->generatePoses(odomPose, localSDFKeypoints, localSDFOrientationFeatures, correspondingIndices);
+            return error_;
+        }
+    }; // class BenchmarkDataset
+
+    typedef void (*StageBenchmark)(benchmark::State &state, BenchmarkDataset &data);
+
+    void benchmarkUpdateMap(benchmark::State &state, BenchmarkDataset &data)
+    {
+        for (auto _ : state)
+        {
+            state.PauseTiming();
+            std::unique_ptr<BenchmarkSampler> sampler(new BenchmarkSampler());
+            sampler->configure(data.getOptions());
+            state.ResumeTiming();
+            sampler->updateMap(data.map);
+            state.PauseTiming();
+            state.counters["global_keypoints"] = sampler->getSDFKeypointsNum();
+            sampler.reset();
+            state.ResumeTiming();
+        }
+    }
+
+    void benchmarkBuildLocalMap(benchmark::State &state, BenchmarkDataset &data)
+    {
+        for (auto _ : state)
+            benchmark::DoNotOptimize(data.sampler->buildLocalMap(data.keyScans));
+    }
+
+    void benchmarkDistanceField(benchmark::State &state, BenchmarkDataset &data)
+    {
+        for (auto _ : state)
+            benchmark::DoNotOptimize(data.sampler->buildDistanceFieldMap(data.localMap));
+    }
+
+    void benchmarkGaussianBlur(benchmark::State &state, BenchmarkDataset &data)
+    {
+        cv::Mat localDistMap = data.sampler->buildDistanceFieldMap(data.localMap);
+        cv::Mat blurredMap;
+        for (auto _ : state)
+        {
+            cv::GaussianBlur(localDistMap, blurredMap, cv::Size(5, 5), 5);
+            benchmark::ClobberMemory();
+        }
+    }
+
+    void benchmarkDetectKeypoints(benchmark::State &state, BenchmarkDataset &data)
+    {
+        for (auto _ : state)
+            benchmark::DoNotOptimize(data.sampler->detectKeypoints(data.localMap, data.localDistMap, data.sampler->getGradientSquareTH()));
+        state.counters["local_keypoints"] = (double)data.localSDFKeypoints.size();
+    }
+
+    void benchmarkCalculateFeatures(benchmark::State &state, BenchmarkDataset &data)
+    {
+        for (auto _ : state)
+            benchmark::DoNotOptimize(data.sampler->calculateFeatures(data.localDistMap, data.sampler->getMapResolution(), data.localSDFKeypoints));
+        state.SetItemsProcessed(state.iterations() * (int64_t)data.localSDFKeypoints.size());
+    }
+
+    void benchmarkFindCorrespondences(benchmark::State &state, BenchmarkDataset &data)
+    {
+        for (auto _ : state)
+            benchmark::DoNotOptimize(data.sampler->findCorrespondingFeatures(data.localSDFKeypoints, data.localSDFOrientationFeatures));
+        state.SetItemsProcessed(state.iterations() * (int64_t)data.localSDFKeypoints.size());
+    }
+
+    void benchmarkGeneratePoses(benchmark::State &state, BenchmarkDataset &data)
+    {
+        Pose &odomPose = data.scans[data.getOptions().keyScansNum - 1].odomPose;
+        data.sampler->setMatchingRateScan(data.keyScans.getScan(data.keyScans.getSize() - 1), data.keyScans.isReversed());
+        for (auto _ : state)
+            benchmark::DoNotOptimize(data.sampler->generatePoses(odomPose, data.localSDFKeypoints, data.localSDFOrientationFeatures,
+                                                                 data.correspondingIndices));
+        state.counters["poses"] = (double)data.poses.poses.size();
+    }
+
+    void benchmarkComputeMatchingRate(benchmark::State &state, BenchmarkDataset &data)
+    {
+        // the poses of the key scans are near the true poses, so most of them are not rejected early
+        std::vector<Pose> poses;
+        for (int i = 0; i < (int)data.scans.size(); ++i)
+            poses.push_back(data.scans[i].odomPose);
+        data.sampler->setMatchingRateScan(data.keyScans.getScan(data.keyScans.getSize() - 1), data.keyScans.isReversed());
+        for (auto _ : state)
+        {
+            for (int i = 0; i < (int)poses.size(); ++i)
+                benchmark::DoNotOptimize(data.sampler->computeMatchingRate(poses[i]));
+        }
+        state.SetItemsProcessed(state.iterations() * (int64_t)poses.size());
+    }
+
+    bool checkOpenCL(benchmark::State &state)
+    {
+        if (SDFOpenCLPipeline::isAvailable())
+            return true;
+        state.SkipWithError("no OpenCL device is available");
+        return false;
+    }
+
+    void benchmarkDistanceFieldOpenCL(benchmark::State &state, BenchmarkDataset &data)
+    {
+        if (!checkOpenCL(state))
+            return;
+        SDFOpenCLPipeline pipeline;
+        cv::Mat localDistMap;
+        nav_msgs::msg::OccupancyGrid &map = data.localMap;
+        for (auto _ : state)
+        {
+            pipeline.buildDistanceField(map.data.data(), (int)map.info.width, (int)map.info.height, map.info.resolution);
+            pipeline.download(localDistMap);
+        }
+    }
+
+    void benchmarkGaussianBlurOpenCL(benchmark::State &state, BenchmarkDataset &data)
+    {
+        if (!checkOpenCL(state))
+            return;
+        SDFOpenCLPipeline pipeline;
+        nav_msgs::msg::OccupancyGrid &map = data.localMap;
+        pipeline.buildDistanceField(map.data.data(), (int)map.info.width, (int)map.info.height, map.info.resolution);
+        cv::ocl::finish();
+        for (auto _ : state)
+        {
+            pipeline.blur();
+            cv::ocl::finish();
+        }
+    }
+
+    void benchmarkDetectKeypointsOpenCL(benchmark::State &state, BenchmarkDataset &data)
+    {
+        if (!checkOpenCL(state))
+            return;
+        SDFOpenCLPipeline pipeline;
+        nav_msgs::msg::OccupancyGrid &map = data.localMap;
+        pipeline.buildDistanceField(map.data.data(), (int)map.info.width, (int)map.info.height, map.info.resolution);
+        pipeline.blur();
+        std::vector<Keypoint> keypoints;
+        for (auto _ : state)
+        {
+            if (!pipeline.detectKeypoints(data.sampler->getKeypointsMinDistFromMap(), data.sampler->getGradientSquareTH(), keypoints))
+            {
+                state.SkipWithError("the keypoint kernel cannot be built");
+                return;
+            }
+        }
+
+        // the CPU keypoints are in column-major order
+        auto isBefore = [](Keypoint &a, Keypoint &b)
+        { return a.getU() < b.getU() || (a.getU() == b.getU() && (a.getV() < b.getV() || (a.getV() == b.getV() && a.getType() < b.getType()))); };
+        std::vector<Keypoint> cpuKeypoints = data.localSDFKeypoints, mismatches;
+        std::sort(keypoints.begin(), keypoints.end(), isBefore);
+        std::sort(cpuKeypoints.begin(), cpuKeypoints.end(), isBefore);
+        std::set_symmetric_difference(keypoints.begin(), keypoints.end(), cpuKeypoints.begin(), cpuKeypoints.end(),
+                                      std::back_inserter(mismatches), isBefore);
+        state.counters["local_keypoints"] = (double)keypoints.size();
+        state.counters["cpu_mismatches"] = (double)mismatches.size();
+    }
+
+    void benchmarkEndToEnd(benchmark::State &state, BenchmarkDataset &data)
+    {
+        KeyScanRing keyScans = data.keyScans;
+        int next = data.getOptions().keyScansNum;
+        nav_msgs::msg::OccupancyGrid localMap;
+        std::vector<Keypoint> localSDFKeypoints;
+        geometry_msgs::msg::PoseArray poses;
+        double keypointsNum = 0.0, posesNum = 0.0;
+        for (auto _ : state)
+        {
+            ScanRecord &record = data.scans[next];
+            keyScans.push(record.scan, record.odomPose);
+            next = (next + 1) % (int)data.scans.size();
+            data.sampler->estimatePoses(keyScans, record.odomPose, false, Pose(), localMap, localSDFKeypoints, poses);
+            keypointsNum += (double)localSDFKeypoints.size();
+            posesNum += (double)poses.poses.size();
+        }
+        state.SetItemsProcessed(state.iterations());
+        state.counters["local_keypoints"] = benchmark::Counter(keypointsNum, benchmark::Counter::kAvgIterations);
+        state.counters["poses"] = benchmark::Counter(posesNum, benchmark::Counter::kAvgIterations);
+    }
+
+    void benchmarkEndToEndOpenCL(benchmark::State &state, BenchmarkDataset &data)
+    {
+        if (!checkOpenCL(state))
+            return;
+        data.sampler->setUseOpenCL(true);
+        benchmarkEndToEnd(state, data);
+        data.sampler->setUseOpenCL(false);
+    }
+
+    void runStageBenchmark(benchmark::State &state, BenchmarkDataset *data, StageBenchmark func)
+    {
+        std::string error = data->build();
+        if (!error.empty())
+        {
+            state.SkipWithError(error.c_str());
+            return;
+        }
+        func(state, *data);
+    }
+
+    std::vector<double> parseList(const std::string &val)
+    {
+        std::vector<double> list;
+        std::istringstream iss(val);
+        std::string item;
+        while (std::getline(iss, item, ','))
+            list.push_back(atof(item.c_str()));
+        return list;
+    }
+
+    bool parseOptions(int argc, char **argv, BenchmarkOptions &options)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            size_t eq = arg.find('=');
+            std::string key = arg.substr(0, eq);
+            std::string val = (eq == std::string::npos) ? "" : arg.substr(eq + 1);
+            if (key == "--map")
+                options.mapFile = val;
+            else if (key == "--scans")
+                options.scansFile = val;
+            else if (key == "--map_sizes")
+                options.mapSizes = parseList(val);
+            else if (key == "--beams_nums")
+            {
+                options.beamsNums.clear();
+                for (double b : parseList(val))
+                    options.beamsNums.push_back((int)b);
+            }
+            else if (key == "--key_scans_num")
+                options.keyScansNum = atoi(val.c_str());
+            else if (key == "--threads_num")
+                options.threadsNum = atoi(val.c_str());
+            else if (key == "--scan_range")
+                options.scanRange = atof(val.c_str());
+            else if (key == "--resolution")
+                options.resolution = atof(val.c_str());
+            else if (key == "--random_seed")
+                options.randomSeed = atoi(val.c_str());
+            else if (key == "--incremental_local_map")
+                options.useIncrementalLocalMap = true;
+            else
+            {
+                fprintf(stderr, "unknown option: %s\n", argv[i]);
+                return false;
+            }
+        }
+        if (options.mapSizes.empty() || options.beamsNums.empty() || options.keyScansNum < 1)
+        {
+            fprintf(stderr, "map_sizes and beams_nums must not be empty and key_scans_num must be positive\n");
+            return false;
+        }
+        return true;
+    }
+
+} // namespace als_ros2
+
+
+int main(int argc, char * argv[])
+{
+  benchmark::Initialize(&argc, argv);
+  als_ros2::BenchmarkOptions options;
+  if (!als_ros2::parseOptions(argc, argv, options))
+    return 1;
+
+  const std::vector<std::pair<std::string, als_ros2::StageBenchmark>> stages = {
+    {"update_map", als_ros2::benchmarkUpdateMap},
+    {"build_local_map", als_ros2::benchmarkBuildLocalMap},
+    {"distance_field", als_ros2::benchmarkDistanceField},
+    {"gaussian_blur", als_ros2::benchmarkGaussianBlur},
+    {"detect_keypoints", als_ros2::benchmarkDetectKeypoints},
+    {"calculate_features", als_ros2::benchmarkCalculateFeatures},
+    {"find_correspondences", als_ros2::benchmarkFindCorrespondences},
+    {"generate_poses", als_ros2::benchmarkGeneratePoses},
+    {"compute_matching_rate", als_ros2::benchmarkComputeMatchingRate},
+    {"end_to_end", als_ros2::benchmarkEndToEnd},
+    {"distance_field_opencl", als_ros2::benchmarkDistanceFieldOpenCL},
+    {"gaussian_blur_opencl", als_ros2::benchmarkGaussianBlurOpenCL},
+    {"detect_keypoints_opencl", als_ros2::benchmarkDetectKeypointsOpenCL},
+    {"end_to_end_opencl", als_ros2::benchmarkEndToEndOpenCL}};
+
+  // the datasets outlive the benchmarks that refer to them
+  std::vector<std::unique_ptr<als_ros2::BenchmarkDataset>> datasets;
+  for (double mapSize : options.mapSizes)
+  {
+    for (int beamsNum : options.beamsNums)
+    {
+      datasets.emplace_back(new als_ros2::BenchmarkDataset(options, mapSize, beamsNum));
+      als_ros2::BenchmarkDataset *data = datasets.back().get();
+      for (const auto &stage : stages)
+      {
+        std::string name = stage.first + "/" + data->label;
+        als_ros2::StageBenchmark func = stage.second;
+        benchmark::RegisterBenchmark(name.c_str(), [data, func](benchmark::State &state)
+                                     { als_ros2::runStageBenchmark(state, data, func); })
+            ->Unit(benchmark::kMillisecond)
+            ->UseRealTime();
+      }
+    }
+  }
+
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
@@ -0,0 +1,5 @@
+#include <als_ros2/GLPoseSampler.h>
+#include <rclcpp_components/register_node_macro.hpp>
+
+
+RCLCPP_COMPONENTS_REGISTER_NODE(als_ros2::GLPoseSampler)
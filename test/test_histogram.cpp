@@ -0,0 +1,101 @@
+/*
+ * Checks that Histogram::getProbabilities looks up the same probabilities as getProbability,
+ * in particular for values a few ulps around the bin edges, in the scalar build as well as
+ * in the AVX2 build.
+ */
+
+#include <cmath>
+#include <limits>
+#include <random>
+#include <vector>
+#include <gtest/gtest.h>
+#include "als_ros2/Histogram.h"
+
+using namespace als_ros2;
+
+namespace
+{
+
+    // bins of different counts, so that neighbouring bins have different probabilities
+    Histogram makeHistogram(double binWidth, double minValue, double maxValue)
+    {
+        std::vector<double> values;
+        int binsNum = (int)((maxValue - minValue) / binWidth) + 1;
+        for (int i = 0; i < binsNum; ++i)
+        {
+            for (int j = 0; j <= i % 5; ++j)
+                values.push_back(minValue + ((double)i + 0.5) * binWidth);
+        }
+        return Histogram(std::move(values), binWidth, minValue, maxValue);
+    }
+
+    void expectSameProbabilities(Histogram &histogram, const std::vector<double> &values)
+    {
+        std::vector<double> probabilities(values.size());
+        histogram.getProbabilities(values.data(), values.size(), probabilities.data());
+        for (size_t i = 0; i < values.size(); ++i)
+            ASSERT_EQ(probabilities[i], histogram.getProbability(values[i])) << "value " << values[i];
+    }
+
+    // the values a few ulps around every bin edge and around the range
+    std::vector<double> makeEdgeValues(double binWidth, double minValue, double maxValue)
+    {
+        std::vector<double> values;
+        int binsNum = (int)((maxValue - minValue) / binWidth) + 1;
+        for (int k = -1; k <= binsNum + 1; ++k)
+        {
+            double edge = minValue + (double)k * binWidth;
+            double below = edge, above = edge;
+            values.push_back(edge);
+            for (int n = 0; n < 4; ++n)
+            {
+                below = std::nextafter(below, -std::numeric_limits<double>::infinity());
+                above = std::nextafter(above, std::numeric_limits<double>::infinity());
+                values.push_back(below);
+                values.push_back(above);
+            }
+        }
+        values.push_back(std::nextafter(maxValue, -std::numeric_limits<double>::infinity()));
+        values.push_back(std::numeric_limits<double>::quiet_NaN());
+        values.push_back(std::numeric_limits<double>::infinity());
+        values.push_back(-std::numeric_limits<double>::infinity());
+        return values;
+    }
+
+} // namespace
+
+TEST(Histogram, LooksUpTheBinBelowAnEdge)
+{
+    Histogram histogram = makeHistogram(0.25, 0.0, 2.0);
+    double value = 0.24999999999999997;
+    double probabilities[4];
+    double values[4] = {value, value, value, value};
+    histogram.getProbabilities(values, 4, probabilities);
+    for (int i = 0; i < 4; ++i)
+        EXPECT_EQ(probabilities[i], histogram.getProbability(0.1));
+    EXPECT_EQ(histogram.getProbability(value), histogram.getProbability(0.1));
+    EXPECT_NE(histogram.getProbability(0.1), histogram.getProbability(0.3));
+}
+
+TEST(Histogram, MatchesSingleLookupsAtBinEdges)
+{
+    for (double binWidth : {0.25, 0.1, 0.3})
+    {
+        for (double minValue : {0.0, -1.0, 0.05})
+        {
+            Histogram histogram = makeHistogram(binWidth, minValue, minValue + 2.0);
+            expectSameProbabilities(histogram, makeEdgeValues(binWidth, minValue, minValue + 2.0));
+        }
+    }
+}
+
+TEST(Histogram, MatchesSingleLookupsOfRandomValues)
+{
+    std::mt19937 engine(1);
+    std::uniform_real_distribution<double> dist(-0.5, 3.5);
+    Histogram histogram = makeHistogram(0.1, 0.0, 3.0);
+    std::vector<double> values(1003);
+    for (double &v : values)
+        v = dist(engine);
+    expectSameProbabilities(histogram, values);
+}
@@ -0,0 +1,188 @@
+/*
+ * Checks that SDFFeatureIndex finds the same correspondences as the original brute-force
+ * scan over all global keypoints or over a subset of them, including its ratio test and its
+ * keeping of the previously best distance as the second minimum.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include <gtest/gtest.h>
+#include "als_ros2/SDFFeatureIndex.h"
+
+using namespace als_ros2;
+
+namespace
+{
+
+    struct ReferenceFeature
+    {
+        char type;
+        double averageSDF;
+        std::vector<int> hist;
+    };
+
+    // the correspondence search of the node before the index was added, over the given candidates
+    int findCorrespondingFeatureByScan(const std::vector<ReferenceFeature> &globals, const std::vector<int> &candidateIndices,
+                                       const ReferenceFeature &local, double averageSDFDeltaTH)
+    {
+        bool isFirst = true, isSecond = true;
+        int idx1 = 0, min1 = -1, min2 = -1;
+        for (int j : candidateIndices)
+        {
+            if (local.type != globals[j].type)
+                continue;
+            if (fabs(local.averageSDF - globals[j].averageSDF) > averageSDFDeltaTH)
+                continue;
+            int sum = 0;
+            for (int k = 0; k < SDFFeatureSet::HIST_SIZE; ++k)
+                sum += abs(local.hist[k] - globals[j].hist[k]);
+            if (isFirst)
+            {
+                min1 = sum;
+                idx1 = j;
+                isFirst = false;
+            }
+            else if (isSecond)
+            {
+                if (min1 < sum)
+                {
+                    min2 = sum;
+                }
+                else
+                {
+                    min2 = min1;
+                    min1 = sum;
+                    idx1 = j;
+                }
+                isSecond = false;
+            }
+            else if (min1 > sum)
+            {
+                min2 = min1;
+                min1 = sum;
+                idx1 = j;
+            }
+        }
+        if (min1 >= 0 && min2 >= 0 && (float)min1 * 1.5f < (float)min2)
+            return idx1;
+        else if (min1 >= 0 && min2 < 0)
+            return idx1;
+        return -1;
+    }
+
+    ReferenceFeature makeRandomFeature(std::mt19937 &engine, int histMax)
+    {
+        ReferenceFeature f;
+        f.type = (char)((int)(engine() % 3) - 1);
+        // quantized, so that many candidates lie exactly on the threshold
+        f.averageSDF = (double)(engine() % 40) * 0.1;
+        f.hist.resize(SDFFeatureSet::HIST_SIZE);
+        for (int k = 0; k < SDFFeatureSet::HIST_SIZE; ++k)
+            f.hist[k] = (int)(engine() % (histMax + 1));
+        return f;
+    }
+
+    // queries all global keypoints, or subsets in random order if isSubset is true
+    void runRandomQueries(std::mt19937 &engine, int globalsNum, int histMax, double averageSDFDeltaTH, int queriesNum, bool isSubset = false)
+    {
+        std::vector<ReferenceFeature> globals(globalsNum);
+        std::vector<Keypoint> keypoints(globalsNum);
+        SDFFeatureSet features;
+        features.resize(globalsNum);
+        for (int i = 0; i < globalsNum; ++i)
+        {
+            globals[i] = makeRandomFeature(engine, histMax);
+            keypoints[i] = Keypoint(0, 0, 0.0, 0.0, globals[i].type);
+            features.set(i, 0.0, globals[i].averageSDF, globals[i].hist.data());
+        }
+        SDFFeatureIndex index;
+        index.build(keypoints, features);
+        ASSERT_EQ(index.size(), globalsNum);
+
+        std::vector<int> allIndices(globalsNum);
+        for (int i = 0; i < globalsNum; ++i)
+            allIndices[i] = i;
+        SDFFeatureSet query;
+        query.resize(1);
+        for (int q = 0; q < queriesNum; ++q)
+        {
+            std::vector<int> candidateIndices = allIndices;
+            if (isSubset)
+            {
+                std::shuffle(candidateIndices.begin(), candidateIndices.end(), engine);
+                candidateIndices.resize(engine() % (globalsNum + 1));
+            }
+            ReferenceFeature local = makeRandomFeature(engine, histMax);
+            if (q % 2 == 1)
+            {
+                // a perturbed copy of a global feature, which usually passes the ratio test
+                const ReferenceFeature &g = globals[engine() % globalsNum];
+                local.type = g.type;
+                for (int k = 0; k < SDFFeatureSet::HIST_SIZE; ++k)
+                    local.hist[k] = std::max(0, g.hist[k] + (int)(engine() % 3) - 1);
+            }
+            query.set(0, 0.0, local.averageSDF, local.hist.data());
+            int expected = findCorrespondingFeatureByScan(globals, candidateIndices, local, averageSDFDeltaTH);
+            const uint16_t *hist = query.getRelativeOrientationHist(0);
+            if (!isSubset)
+            {
+                ASSERT_EQ(index.findCorrespondingFeature(local.type, local.averageSDF, hist, averageSDFDeltaTH), expected)
+                    << "query " << q << " of " << globalsNum << " global keypoints";
+            }
+            ASSERT_EQ(index.findCorrespondingFeatureInSubset(local.type, local.averageSDF, hist, averageSDFDeltaTH, candidateIndices), expected)
+                << "query " << q << " of " << candidateIndices.size() << " candidates";
+        }
+    }
+
+} // namespace
+
+TEST(SDFFeatureIndex, MatchesScanOnSmallSets)
+{
+    std::mt19937 engine(1);
+    for (int trial = 0; trial < 20; ++trial)
+        runRandomQueries(engine, 1 + (int)(engine() % 60), 1 + (int)(engine() % 400), (double)(engine() % 4) * 0.3, 300);
+}
+
+TEST(SDFFeatureIndex, MatchesScanOnLargeSets)
+{
+    std::mt19937 engine(2);
+    for (int trial = 0; trial < 10; ++trial)
+        runRandomQueries(engine, 1000 + (int)(engine() % 4000), 1 + (int)(engine() % 400), (double)(engine() % 4) * 0.3, 300);
+}
+
+TEST(SDFFeatureIndex, MatchesScanWithManyTies)
+{
+    // histograms of few distinct values make equal distances, where the scan order decides
+    std::mt19937 engine(3);
+    for (int trial = 0; trial < 10; ++trial)
+        runRandomQueries(engine, 1 + (int)(engine() % 2000), 2, (double)(engine() % 4) * 0.3, 300);
+}
+
+TEST(SDFFeatureIndex, MatchesScanOnCandidateSubsets)
+{
+    std::mt19937 engine(4);
+    for (int trial = 0; trial < 20; ++trial)
+        runRandomQueries(engine, 1 + (int)(engine() % 500), trial % 2 == 0 ? 2 : 400, (double)(engine() % 4) * 0.3, 300, true);
+}
+
+TEST(SDFFeatureIndex, RejectsUnknownTypesAndEmptyIndex)
+{
+    SDFFeatureIndex index;
+    std::vector<Keypoint> keypoints;
+    SDFFeatureSet features;
+    index.build(keypoints, features);
+    uint16_t hist[SDFFeatureSet::HIST_STRIDE] = {0};
+    EXPECT_EQ(index.findCorrespondingFeature(0, 0.0, hist, 1.0), -1);
+
+    keypoints.push_back(Keypoint(0, 0, 0.0, 0.0, 1));
+    features.resize(1);
+    int zeros[SDFFeatureSet::HIST_SIZE] = {0};
+    features.set(0, 0.0, 0.5, zeros);
+    index.build(keypoints, features);
+    EXPECT_EQ(index.findCorrespondingFeature(1, 0.5, hist, 0.1), 0);
+    EXPECT_EQ(index.findCorrespondingFeature(2, 0.5, hist, 0.1), -1);
+    EXPECT_EQ(index.findCorrespondingFeature(1, 0.7, hist, 0.1), -1);
+}
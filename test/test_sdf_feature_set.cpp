@@ -0,0 +1,141 @@
+/*
+ * Checks that SDFFeatureSet holds the same features as the former per-keypoint
+ * SDFOrientationFeature objects and that its L1 distances equal the distances of their
+ * integer histograms, in the scalar build as well as in the AVX2 and NEON builds.
+ */
+
+#include <cmath>
+#include <cstdlib>
+#include <random>
+#include <utility>
+#include <vector>
+#include <gtest/gtest.h>
+#include "als_ros2/SDFFeatureSet.h"
+
+using namespace als_ros2;
+
+namespace
+{
+
+    // a copy that the assertions can bind to by reference
+    const int HIST_MAX = SDFFeatureSet::HIST_MAX;
+
+    // the layout of a feature before SDFFeatureSet
+    struct ReferenceFeature
+    {
+        double dominantOrientation, averageSDF;
+        std::vector<int> hist;
+    };
+
+    ReferenceFeature makeRandomFeature(std::mt19937 &engine, int histMax)
+    {
+        ReferenceFeature f;
+        f.dominantOrientation = (double)(engine() % 36) * 10.0 * M_PI / 180.0;
+        f.averageSDF = (double)(engine() % 1000) * 0.001;
+        f.hist.resize(SDFFeatureSet::HIST_SIZE);
+        for (int k = 0; k < SDFFeatureSet::HIST_SIZE; ++k)
+            f.hist[k] = (int)(engine() % (histMax + 1));
+        return f;
+    }
+
+    int computeL1Distance(const std::vector<int> &a, const std::vector<int> &b)
+    {
+        int sum = 0;
+        for (int k = 0; k < SDFFeatureSet::HIST_SIZE; ++k)
+            sum += abs(a[k] - b[k]);
+        return sum;
+    }
+
+} // namespace
+
+TEST(SDFFeatureSet, HoldsTheFeatures)
+{
+    std::mt19937 engine(1);
+    int num = 500;
+    std::vector<ReferenceFeature> refs(num);
+    SDFFeatureSet features;
+    features.resize(num);
+    for (int i = 0; i < num; ++i)
+    {
+        refs[i] = makeRandomFeature(engine, 2000);
+        features.set(i, refs[i].dominantOrientation, refs[i].averageSDF, refs[i].hist.data());
+    }
+    ASSERT_EQ(features.size(), num);
+    for (int i = 0; i < num; ++i)
+    {
+        EXPECT_EQ(features.getDominantOrientation(i), refs[i].dominantOrientation);
+        EXPECT_EQ(features.getAverageSDF(i), refs[i].averageSDF);
+        for (int k = 0; k < SDFFeatureSet::HIST_SIZE; ++k)
+            EXPECT_EQ(features.getRelativeOrientationHist(i, k), refs[i].hist[k]);
+        // the padding lanes must stay zero for the vector distances
+        for (int k = SDFFeatureSet::HIST_SIZE; k < SDFFeatureSet::HIST_STRIDE; ++k)
+            EXPECT_EQ(features.getRelativeOrientationHist(i)[k], 0);
+    }
+}
+
+TEST(SDFFeatureSet, SaturatesTheCounts)
+{
+    SDFFeatureSet features;
+    features.resize(1);
+    int hist[SDFFeatureSet::HIST_SIZE] = {0};
+    hist[0] = -5;
+    hist[1] = HIST_MAX;
+    hist[2] = HIST_MAX + 1;
+    hist[3] = 1000000;
+    features.set(0, 0.0, 0.0, hist);
+    EXPECT_EQ(features.getRelativeOrientationHist(0, 0), 0);
+    EXPECT_EQ(features.getRelativeOrientationHist(0, 1), HIST_MAX);
+    EXPECT_EQ(features.getRelativeOrientationHist(0, 2), HIST_MAX);
+    EXPECT_EQ(features.getRelativeOrientationHist(0, 3), HIST_MAX);
+}
+
+TEST(SDFFeatureSet, ComputesTheL1DistanceOfTheHistograms)
+{
+    std::mt19937 engine(2);
+    SDFFeatureSet features;
+    features.resize(2);
+    for (int histMax : {3, 400, HIST_MAX})
+    {
+        for (int trial = 0; trial < 2000; ++trial)
+        {
+            ReferenceFeature a = makeRandomFeature(engine, histMax), b = makeRandomFeature(engine, histMax);
+            features.set(0, a.dominantOrientation, a.averageSDF, a.hist.data());
+            features.set(1, b.dominantOrientation, b.averageSDF, b.hist.data());
+            ASSERT_EQ(SDFFeatureSet::computeL1Distance(features.getRelativeOrientationHist(0), features.getRelativeOrientationHist(1)),
+                      computeL1Distance(a.hist, b.hist));
+        }
+    }
+}
+
+TEST(SDFFeatureSet, ComputesTheL1DistanceToABox)
+{
+    std::mt19937 engine(3);
+    SDFFeatureSet features;
+    features.resize(3);
+    for (int histMax : {3, 400, HIST_MAX})
+    {
+        for (int trial = 0; trial < 2000; ++trial)
+        {
+            ReferenceFeature h = makeRandomFeature(engine, histMax), lo = makeRandomFeature(engine, histMax), hi = makeRandomFeature(engine, histMax);
+            for (int k = 0; k < SDFFeatureSet::HIST_SIZE; ++k)
+            {
+                if (lo.hist[k] > hi.hist[k])
+                    std::swap(lo.hist[k], hi.hist[k]);
+            }
+            features.set(0, 0.0, 0.0, h.hist.data());
+            features.set(1, 0.0, 0.0, lo.hist.data());
+            features.set(2, 0.0, 0.0, hi.hist.data());
+            int expected = 0;
+            for (int k = 0; k < SDFFeatureSet::HIST_SIZE; ++k)
+            {
+                if (h.hist[k] < lo.hist[k])
+                    expected += lo.hist[k] - h.hist[k];
+                else if (h.hist[k] > hi.hist[k])
+                    expected += h.hist[k] - hi.hist[k];
+            }
+            ASSERT_EQ(SDFFeatureSet::computeL1DistanceToBox(features.getRelativeOrientationHist(0), features.getRelativeOrientationHist(1),
+                                                            features.getRelativeOrientationHist(2)),
+                      expected);
+        }
+    }
+}
@@ -0,0 +1,147 @@
+/*
+ * Checks that SDFKeypointDetector detects exactly the keypoints of the original per-cell
+ * detection, in the scalar build as well as in the AVX2 and NEON builds.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+#include <gtest/gtest.h>
+#include "als_ros2/SDFKeypointDetector.h"
+
+using namespace als_ros2;
+
+namespace
+{
+
+    struct TestMap
+    {
+        int width, height;
+        size_t stride;
+        std::vector<float> dist;
+        std::vector<signed char> data;
+
+        inline float at(int v, int u) const { return dist[v * stride + u]; }
+    };
+
+    // the keypoint detection of the node before the detector was vectorized, column by column
+    std::vector<Keypoint> detectKeypointsByCell(const TestMap &map, double minDist, double gradientSquareTH)
+    {
+        std::vector<Keypoint> keypoints;
+        for (int u = 1; u < map.width - 1; ++u)
+        {
+            for (int v = 1; v < map.height - 1; ++v)
+            {
+                if (map.data[v * map.width + u] != 0 || map.at(v, u) < minDist)
+                    continue;
+                float dx = -map.at(v - 1, u - 1) - map.at(v, u - 1) - map.at(v + 1, u - 1) + map.at(v - 1, u + 1) + map.at(v, u + 1) + map.at(v + 1, u + 1);
+                float dy = -map.at(v - 1, u - 1) - map.at(v - 1, u) - map.at(v - 1, u + 1) + map.at(v + 1, u - 1) + map.at(v + 1, u) + map.at(v + 1, u + 1);
+                float dxx = map.at(v, u - 1) - 2.0 * map.at(v, u) + map.at(v, u + 1);
+                float dyy = map.at(v - 1, u) - 2.0 * map.at(v, u) + map.at(v + 1, u);
+                float dxy = map.at(v - 1, u - 1) - map.at(v - 1, u) - map.at(v, u - 1) + 2.0 * map.at(v, u) - map.at(v, u + 1) - map.at(v + 1, u) + map.at(v + 1, u + 1);
+                float det = dxx * dyy - dxy * dxy;
+                if (dx * dx < gradientSquareTH && dy * dy < gradientSquareTH)
+                {
+                    if (det > 0.0 && dxx < 0.0)
+                        keypoints.push_back(Keypoint(u, v, 0.0, 0.0, 1));
+                    else if (det > 0.0 && dxx > 0.0)
+                        keypoints.push_back(Keypoint(u, v, 0.0, 0.0, -1));
+                    else if (det < 0.0)
+                        keypoints.push_back(Keypoint(u, v, 0.0, 0.0, 0));
+                }
+            }
+        }
+        return keypoints;
+    }
+
+    TestMap makeMap(int width, int height, size_t stride, int pattern, std::mt19937 &engine)
+    {
+        TestMap map;
+        map.width = width;
+        map.height = height;
+        map.stride = stride;
+        map.dist.assign(stride * height, 0.0f);
+        map.data.resize((size_t)width * height);
+        for (int v = 0; v < height; ++v)
+        {
+            for (int u = 0; u < width; ++u)
+            {
+                float d;
+                if (pattern == 0) // distances to two walls: ridges, valleys, and many exact ties
+                    d = (float)std::min(std::abs(u - width / 3), std::abs(v - height / 4)) * 0.01f;
+                else if (pattern == 1) // smooth extrema and saddles
+                    d = (float)(std::sin(u * 0.1) * std::cos(v * 0.07));
+                else // steps of a coarse quantization
+                    d = (float)(engine() % 7) * 0.05f;
+                map.dist[v * stride + u] = d;
+                int r = (int)(engine() % 130);
+                map.data[v * width + u] = (r < 13) ? 100 : ((r < 23) ? -1 : 0);
+            }
+        }
+        return map;
+    }
+
+    std::vector<Keypoint> detect(const TestMap &map, double minDist, double gradientSquareTH, int rowsPerCall)
+    {
+        SDFKeypointDetector detector;
+        detector.setThresholds(minDist, gradientSquareTH);
+        std::vector<Keypoint> keypoints;
+        for (int v = 0; v < map.height; v += rowsPerCall)
+            detector.detectRows(map.dist.data(), map.stride, map.data.data(), map.width, map.height, v, std::min(v + rowsPerCall, map.height), keypoints);
+        return keypoints;
+    }
+
+    void expectSameKeypoints(std::vector<Keypoint> expected, std::vector<Keypoint> actual)
+    {
+        auto byCell = [](Keypoint &a, Keypoint &b)
+        { return a.getU() < b.getU() || (a.getU() == b.getU() && a.getV() < b.getV()); };
+        std::sort(expected.begin(), expected.end(), byCell);
+        std::sort(actual.begin(), actual.end(), byCell);
+        ASSERT_EQ(actual.size(), expected.size());
+        for (size_t i = 0; i < expected.size(); ++i)
+        {
+            ASSERT_EQ(actual[i].getU(), expected[i].getU()) << "keypoint " << i;
+            ASSERT_EQ(actual[i].getV(), expected[i].getV()) << "keypoint " << i;
+            ASSERT_EQ(actual[i].getType(), expected[i].getType()) << "keypoint " << i;
+        }
+    }
+
+} // namespace
+
+TEST(SDFKeypointDetector, MatchesCellDetection)
+{
+    std::mt19937 engine(3);
+    for (int pattern = 0; pattern < 3; ++pattern)
+    {
+        // a width that is no multiple of the vector widths leaves a scalar tail in every row
+        TestMap map = makeMap(517, 301, 517, pattern, engine);
+        std::vector<Keypoint> expected = detectKeypointsByCell(map, 0.1, 0.01);
+        EXPECT_FALSE(expected.empty()) << "pattern " << pattern;
+        expectSameKeypoints(expected, detect(map, 0.1, 0.01, map.height));
+    }
+}
+
+TEST(SDFKeypointDetector, MatchesCellDetectionInRowChunksAndPaddedRows)
+{
+    std::mt19937 engine(4);
+    for (int pattern = 0; pattern < 3; ++pattern)
+    {
+        TestMap map = makeMap(203, 157, 256, pattern, engine);
+        std::vector<Keypoint> expected = detectKeypointsByCell(map, 0.1, 0.01);
+        for (int rowsPerCall : {1, 7, 64})
+            expectSameKeypoints(expected, detect(map, 0.1, 0.01, rowsPerCall));
+    }
+}
+
+TEST(SDFKeypointDetector, RoundsThresholdsLikeTheDoubleComparison)
+{
+    // thresholds between two floats, where comparing with the float-rounded threshold would differ
+    std::mt19937 engine(5);
+    TestMap map = makeMap(131, 97, 131, 2, engine);
+    for (double minDist : {0.1, 0.15, 0.2000000001, 0.25})
+    {
+        for (double th : {0.01, 0.0025, 0.0225000001})
+            expectSameKeypoints(detectKeypointsByCell(map, minDist, th), detect(map, minDist, th, map.height));
+    }
+}